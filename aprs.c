@@ -0,0 +1,205 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * A long lived APRS-IS session for CWOP.  We log in once and keep
+ * the connection, reading and tossing the server's keepalive chatter
+ * each time we send.  All I/O is non-blocking with a deadline, a
+ * server that stops answering costs at most the timeout, after which
+ * we move on to the next address and back off before trying again.
+ *
+ * http://www.aprs-is.net/Connecting.aspx
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "net.h"
+
+#define APRSBACKOFFMIN  30      /* secs to wait after the first failure */
+#define APRSBACKOFFMAX  (30*60) /* never wait longer than this */
+
+struct wxaprs {
+    wxdns_t dns;                /* where the servers are */
+    int fd;                     /* -1 when not connected */
+    char login[128];            /* "user ... pass ... vers ..." */
+    time_t nexttry;             /* backing off 'til then */
+    int backoff;                /* current backoff in seconds */
+    unsigned long sessions;
+    unsigned long packets;
+};
+
+/* from support.c */
+extern int64_t wxmsnow(void);
+/* from net.c */
+extern void wxdnsinit(wxdns_t *dp, const char *host, const char *port, int ttl);
+extern int wxconnect(wxdns_t *dp, int timeout);
+extern int wxsockwait(int s, short events, int64_t expire);
+extern void wxdnsnext(wxdns_t *dp);
+
+wxaprs_t *
+wxaprsnew(const char *host, const char *port, const char *login)
+{
+    wxaprs_t *ap;
+
+    if ((ap = calloc(1, sizeof(wxaprs_t))) == (wxaprs_t *)0) {
+        perror("wxaprsnew - calloc");
+        return (wxaprs_t *)0;
+    }
+    wxdnsinit(&ap->dns, host, port, WXDNSTTL);
+    ap->fd = -1;
+    (void)snprintf(ap->login, sizeof(ap->login), "%s\r\n", login);
+    return ap;
+}
+
+static void
+wxaprsclose(wxaprs_t *ap)
+{
+    if (ap->fd != -1) {
+        (void)close(ap->fd);
+        ap->fd = -1;
+    }
+}
+
+/*
+ * give up on this server for a while, each failure in a row doubles
+ * the wait
+ */
+static void
+wxaprsfail(wxaprs_t *ap)
+{
+    wxaprsclose(ap);
+    wxdnsnext(&ap->dns);
+    if (ap->backoff < APRSBACKOFFMIN) {
+        ap->backoff = APRSBACKOFFMIN;
+    } else if ((ap->backoff *= 2) > APRSBACKOFFMAX) {
+        ap->backoff = APRSBACKOFFMAX;
+    }
+    ap->nexttry = time((time_t *)0) + ap->backoff;
+}
+
+/*
+ * read whatever the server has sent, if wait is set block 'til
+ * something shows up or the deadline passes.  Returns 0 if the
+ * connection is still good.
+ */
+static int
+wxaprsdrain(wxaprs_t *ap, int wait, int64_t expire)
+{
+    char buf[512];
+    ssize_t rc;
+
+    while (1) {
+        if ((rc = read(ap->fd, buf, sizeof(buf) - 1)) > 0) {
+#ifdef DEBUG_CWOP
+            buf[rc] = '\0';
+            printf("got \"%s\"\n", buf);
+#endif /*DEBUG_CWOP*/
+            wait = 0;
+            continue;
+        }
+        if (rc == 0) {
+            return -1;          /* server hung up */
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            perror("wxaprsdrain - read");
+            return -1;
+        }
+        if (!wait) {
+            return 0;
+        }
+        if (wxsockwait(ap->fd, POLLIN, expire) != 1) {
+            return -1;
+        }
+    }
+}
+
+static int
+wxaprswrite(wxaprs_t *ap, const char *buf, size_t len, int64_t expire)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        if ((rc = write(ap->fd, buf, len)) == -1) {
+            if ((errno != EAGAIN && errno != EINTR) ||
+                wxsockwait(ap->fd, POLLOUT, expire) != 1) {
+                return -1;
+            }
+            continue;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+static int
+wxaprsconnect(wxaprs_t *ap, int64_t expire)
+{
+    if ((ap->fd = wxconnect(&ap->dns, (int)(expire - wxmsnow()))) == -1) {
+        return -1;
+    }
+    /* the server talks first, then we log in */
+    if (wxaprsdrain(ap, 1, expire) != 0 ||
+        wxaprswrite(ap, ap->login, strlen(ap->login), expire) != 0) {
+        fprintf(stderr, "wxaprsconnect - login to %s failed\n", ap->dns.host);
+        wxaprsclose(ap);
+        return -1;
+    }
+    ++ap->sessions;
+    return 0;
+}
+
+/*
+ * send one packet (CRLF terminated) waiting at most timeout ms,
+ * returns 0 on success, -1 if it didn't go (or we're backing off)
+ */
+int
+wxaprssend(wxaprs_t *ap, const char *pkt, int timeout)
+{
+    int64_t expire;
+    int tries;
+
+    if (ap->fd == -1 && time((time_t *)0) < ap->nexttry) {
+        return -1;
+    }
+    expire = wxmsnow() + timeout;
+    for (tries = 0; tries < 2; ++tries) {
+        if (ap->fd == -1 && wxaprsconnect(ap, expire) != 0) {
+            break;
+        }
+        /*
+         * an old session may have been dropped while we weren't
+         * looking, find out before we send into the void
+         */
+        if (wxaprsdrain(ap, 0, expire) == 0 &&
+            wxaprswrite(ap, pkt, strlen(pkt), expire) == 0) {
+            ++ap->packets;
+            ap->backoff = 0;
+            return 0;
+        }
+        wxaprsclose(ap);
+    }
+    wxaprsfail(ap);
+    return -1;
+}
@@ -0,0 +1,374 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Catching up from the console's archive after fwx (or the host) has
+ * been down.  wxlastlogged() finds the time of the newest sample in
+ * the log directory, logged, packed or rolled up, and wxdmpaft() asks
+ * the console for every archive record after it, handing each one to
+ * a callback oldest first.
+ *
+ * The console won't send a page until the previous one is ACKed, so
+ * each page is checked and ACKed the moment its last byte arrives and
+ * only then picked apart, the next page is on the wire while we do.
+ * At 19200 baud that's ~140ms a page, a day of 5 minute records is
+ * 58 pages.
+ */
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "davis.h"
+#include "fwxbin.h"
+#include "fwxroll.h"
+#include "fwxpack.h"
+
+#define ACK 0x06
+#define ACKWAIT 2000            /* ms for the console to answer DMPAFT */
+#define PAGEWAIT 2000           /* ms for a page to arrive */
+#define PAGERETRY 3             /* NAKs before we give up on a page */
+#define TAILLEN 512             /* more than the longest log line */
+
+/* from crc.c */
+extern int wxcrc(unsigned char *buf, int len);
+extern unsigned short wxcrcupdate(unsigned short crc, unsigned char c);
+/* from support.c */
+extern int wxread(int fd, void *buf, size_t len, int timeout);
+extern int wxsend(int fd, const void *buf, size_t len);
+extern int wxwakeup(int fd);
+extern int wxcmd(int fd, char *cmd);
+
+/*
+ * the time of the last line of a CSV log
+ */
+static time_t
+wxlastcsv(int fd)
+{
+    char buf[TAILLEN + 1];
+    char *p;
+    off_t end;
+    ssize_t rc;
+    time_t t;
+
+    t = 0;
+    if ((end = lseek(fd, 0, SEEK_END)) > 0 &&
+        lseek(fd, end > TAILLEN ? end - TAILLEN : 0, SEEK_SET) != -1 &&
+        (rc = read(fd, buf, TAILLEN)) > 0) {
+        /* drop the trailing newline, the last line starts after the one before */
+        if (buf[rc - 1] == '\n') {
+            --rc;
+        }
+        buf[rc] = '\0';
+        p = (p = strrchr(buf, '\n')) ? p + 1 : buf;
+        /* version major, version minor, time */
+        if ((p = strchr(p, ',')) && (p = strchr(p + 1, ','))) {
+            t = (time_t)strtol(p + 1, (char **)0, 10);
+        }
+    }
+    return t;
+}
+
+/*
+ * the time of the last whole record of a binary log
+ */
+static time_t
+wxlastbin(int fd)
+{
+    fwxbhdr_t hdr;
+    fwxbrec_t rec;
+    off_t end;
+    off_t n;
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        memcmp(hdr.magic, FWXB_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.recsize < sizeof(rec) || (end = lseek(fd, 0, SEEK_END)) <= hdr.hdrsize ||
+        (n = (end - hdr.hdrsize) / hdr.recsize) == 0 ||
+        pread(fd, &rec, sizeof(rec), hdr.hdrsize + (n - 1) * hdr.recsize) !=
+        (ssize_t)sizeof(rec)) {
+        return 0;
+    }
+    return (time_t)rec.time;
+}
+
+/*
+ * the time of the last record of a packed archive, from its index
+ */
+static time_t
+wxlastpacked(int fd)
+{
+    fwxphdr_t hdr;
+    fwxpidx_t idx;
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        memcmp(hdr.magic, FWXP_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.idxsize < sizeof(idx) || hdr.nblocks == 0 ||
+        pread(fd, &idx, sizeof(idx), hdr.hdrsize + (off_t)(hdr.nblocks - 1) * hdr.idxsize) !=
+        (ssize_t)sizeof(idx)) {
+        return 0;
+    }
+    return (time_t)idx.last;
+}
+
+/*
+ * the last second of the last minute a minute rollup has samples in
+ */
+static time_t
+wxlastrollup(int fd)
+{
+    fwxrhdr_t hdr;
+    fwxrrec_t rec;
+    int i;
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        memcmp(hdr.magic, FWXR_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.period != FWXR_MINUTE || hdr.recsize < offsetof(fwxrrec_t, rain)) {
+        return 0;
+    }
+    for (i = hdr.nslots - 1; i >= 0; --i) {
+        if (pread(fd, &rec, offsetof(fwxrrec_t, rain),
+                  hdr.hdrsize + (off_t)i * hdr.recsize) != (ssize_t)offsetof(fwxrrec_t, rain)) {
+            return 0;
+        }
+        if (rec.n > 0) {
+            return (time_t)rec.start + 59;
+        }
+    }
+    return 0;
+}
+
+static const struct {
+    const char *suffix;
+    time_t (*last)(int fd);
+} wxlogkinds[] = {
+    { ".fwx", wxlastcsv },
+    { ".fwb", wxlastbin },
+    { ".fwp", wxlastpacked },
+    { ".fwm", wxlastrollup },
+};
+
+#define NLOGKINDS (sizeof(wxlogkinds) / sizeof(wxlogkinds[0]))
+
+/*
+ * the time of the newest sample in logdir, 0 if there isn't one.
+ * Each kind of daily file is looked at, the newest of each, since a
+ * day may only be left packed or in its binary log, and the minute
+ * rollup covers whatever was logged even if the logs were removed.
+ */
+time_t
+wxlastlogged(const char *logdir)
+{
+    char newest[NLOGKINDS][16];      /* %Y.%m.%d.fwx and so on */
+    char path[FILENAME_MAX];
+    struct dirent *dp;
+    size_t l;
+    size_t k;
+    time_t last;
+    time_t t;
+    DIR *dirp;
+    int fd;
+
+    if ((dirp = opendir(logdir)) == (DIR *)0) {
+        perror("wxlastlogged - opendir");
+        return 0;
+    }
+    /* the names sort in date order */
+    memset((void *)newest, 0, sizeof(newest));
+    while ((dp = readdir(dirp)) != (struct dirent *)0) {
+        if ((l = strlen(dp->d_name)) != 14) {
+            continue;
+        }
+        for (k = 0; k < NLOGKINDS; ++k) {
+            if (strcmp(&dp->d_name[10], wxlogkinds[k].suffix) == 0 &&
+                strcmp(dp->d_name, newest[k]) > 0) {
+                strcpy(newest[k], dp->d_name);
+            }
+        }
+    }
+    (void)closedir(dirp);
+
+    last = 0;
+    for (k = 0; k < NLOGKINDS; ++k) {
+        if (!newest[k][0]) {
+            continue;
+        }
+        (void)snprintf(path, sizeof(path), "%s/%s", logdir, newest[k]);
+        if ((fd = open(path, O_RDONLY)) == -1) {
+            perror(path);
+            continue;
+        }
+        if ((t = wxlogkinds[k].last(fd)) > last) {
+            last = t;
+        }
+        (void)close(fd);
+    }
+    return last;
+}
+
+/*
+ * what the record's date & time stamps say, in seconds
+ */
+time_t
+wxarchtime(const vparchive_t *ap)
+{
+    unsigned int date;
+    unsigned int hm;
+    struct tm tm;
+
+    date = get_d_16(ap->date);
+    hm = get_d_16(ap->time);
+    memset((void *)&tm, 0, sizeof(tm));
+    tm.tm_year = (date >> 9) + 100;
+    tm.tm_mon = ((date >> 5) & 0x0f) - 1;
+    tm.tm_mday = date & 0x1f;
+    tm.tm_hour = hm / 100;
+    tm.tm_min = hm % 100;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/*
+ * read one page, NAKing it 'til it comes in whole, and ACK it for the
+ * next one unless it's the last
+ */
+static int
+wxarchpage(int fd, vparchpage_t *pp, int last)
+{
+    static const unsigned char ack = ACK;
+    static const unsigned char nak = VPNAK;
+    static const unsigned char esc = VPESC;
+    int rc;
+    int i;
+
+    for (i = 0; i <= PAGERETRY; ++i) {
+        if ((rc = wxread(fd, (void *)pp, VPARCHPAGESIZE, PAGEWAIT)) == -1) {
+            return -1;
+        }
+        if (rc == (int)VPARCHPAGESIZE && wxcrc((unsigned char *)pp, rc)) {
+            return last ? 0 : wxsend(fd, &ack, 1);
+        }
+#ifdef DEBUG_ARCHIVE
+        fprintf(stderr, "wxarchpage - got %d bytes, crc %s\n",
+                rc, rc == (int)VPARCHPAGESIZE ? "bad" : "unchecked");
+#endif /*DEBUG_ARCHIVE*/
+        if (wxsend(fd, &nak, 1) != 0) {
+            return -1;
+        }
+    }
+    fprintf(stderr, "wxarchpage - giving up after %d tries\n", i);
+    (void)wxsend(fd, &esc, 1);
+    return -1;
+}
+
+/*
+ * hand fn() every archive record newer than after along with arg,
+ * returns how many
+ * or -1 if the console wouldn't cooperate
+ */
+int
+wxdmpaft(int fd, time_t after,
+         void (*fn)(const vparchive_t *ap, time_t t, void *arg), void *arg)
+{
+    static const unsigned char ack = ACK;
+    unsigned char req[6];
+    unsigned char hdr[6];
+    unsigned short crc;
+    unsigned int date;
+    unsigned int hm;
+    vparchpage_t page;
+    unsigned int pages;
+    unsigned int first;
+    unsigned int n;
+    unsigned int i;
+    time_t prev;
+    time_t t;
+    struct tm tm;
+    int count;
+
+    (void)localtime_r(&after, &tm);
+    if (after == 0 || tm.tm_year < 100) {
+        date = hm = 0;          /* the whole archive */
+    } else {
+        date = VPARCHDATE(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+        hm = VPARCHTIME(tm.tm_hour, tm.tm_min);
+    }
+    req[0] = date & 0xff;
+    req[1] = date >> 8;
+    req[2] = hm & 0xff;
+    req[3] = hm >> 8;
+    for (crc = 0, i = 0; i < 4; ++i) {
+        crc = wxcrcupdate(crc, req[i]);
+    }
+    req[4] = crc >> 8;
+    req[5] = crc & 0xff;
+
+    for (i = 0; i < 4 && wxwakeup(fd) != 0; ++i) {
+        ;
+    }
+    if (wxcmd(fd, VPDMPAFTCMD) != 0) {
+        fprintf(stderr, "wxdmpaft - DMPAFT not ACKed\n");
+        return -1;
+    }
+    if (wxsend(fd, req, sizeof(req)) != 0 ||
+        wxread(fd, hdr, 1, ACKWAIT) != 1 || hdr[0] != ACK) {
+        fprintf(stderr, "wxdmpaft - time stamp not ACKed\n");
+        return -1;
+    }
+    if (wxread(fd, hdr, sizeof(hdr), ACKWAIT) != (int)sizeof(hdr) ||
+        !wxcrc(hdr, sizeof(hdr))) {
+        fprintf(stderr, "wxdmpaft - bad page count\n");
+        return -1;
+    }
+    pages = hdr[0] | hdr[1] << 8;
+    first = hdr[2] | hdr[3] << 8;
+    if (first >= VPARCHPERPAGE) {
+        first = 0;
+    }
+#ifdef DEBUG_ARCHIVE
+    fprintf(stderr, "wxdmpaft - %u pages, first record %u\n", pages, first);
+#endif /*DEBUG_ARCHIVE*/
+    if (pages == 0) {
+        return 0;
+    }
+    if (wxsend(fd, &ack, 1) != 0) {
+        return -1;
+    }
+
+    count = 0;
+    prev = after;
+    for (n = 0; n < pages; ++n) {
+        if (wxarchpage(fd, &page, n == pages - 1) != 0) {
+            return count ? count : -1;
+        }
+        for (i = n == 0 ? first : 0; i < VPARCHPERPAGE; ++i) {
+            /* past the newest record the archive is empty or wrapped */
+            if (get_d_16(page.rec[i].date) == 0xffff ||
+                (t = wxarchtime(&page.rec[i])) <= prev) {
+                continue;
+            }
+            if (page.rec[i].recType != VPARCHREVB) {
+                continue;       /* Rev A firmware, not worth decoding */
+            }
+            fn(&page.rec[i], t, arg);
+            prev = t;
+            ++count;
+        }
+    }
+    return count;
+}
@@ -39,6 +39,16 @@ static unsigned short crc_table [] = {
     0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
 };
 
+/*
+ * fold one more byte into a running crc, feeding a whole packet
+ * (crc included) through this leaves 0 if the packet is good
+ */
+unsigned short
+wxcrcupdate(unsigned short crc, unsigned char c)
+{
+    return crc_table[(crc >> 8) ^ c] ^ (crc << 8);
+}
+
 int
 wxcrc(unsigned char *buf, int len)
 {
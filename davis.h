@@ -80,9 +80,131 @@ typedef struct vploopdata {
 
 #define VPLOOPSIZE sizeof(vploopdata_t)
 
+/*
+ * LOOP2, same size, signature and crc as LOOP but type 1 and a
+ * different body.  Pro2 firmware 1.90 and later (and the Vue) send
+ * these, LPS 3 n gets LOOP and LOOP2 alternately.
+ */
+#pragma pack(1)
+typedef struct vploop2data {
+    char sig[3];                        /* "LOO" */
+    int8_t barTrend;                    /* -60, -20, 0, 20, or 60 */
+    char type;                          /* 0x01 */
+    uint16_t unused0;                   /* 0x7fff */
+    uint16_t bar;                       /* barometric pressure */
+    int16_t tempIn;                     /* indoor temperature */
+    uint8_t humIn;                      /* indoor humidity */
+    int16_t tempOut;                    /* outdoor temperature */
+    uint8_t windSpeed;                  /* instantaneous wind speed */
+    uint8_t unused1;
+    uint16_t windDir;                   /* wind direction */
+    uint16_t windAvg10;                 /* 10 minute average, mph * 10 */
+    uint16_t windAvg2;                  /* 2 minute average, mph * 10 */
+    uint16_t windGust10;                /* 10 minute gust, mph */
+    uint16_t windGustDir10;             /* direction of that gust */
+    uint16_t unused2;
+    uint16_t unused3;
+    int16_t dewPoint;                   /* dew point, deg F */
+    uint8_t unused4;
+    uint8_t humOut;                     /* outdoor humidity */
+    uint8_t unused5;
+    int16_t heatIndex;                  /* heat index, deg F */
+    int16_t windChill;                  /* wind chill, deg F */
+    int16_t thswIndex;                  /* THSW index, deg F */
+    uint16_t rainRate;                  /* rain rate, clicks/hour */
+    uint8_t uv;                         /* UV intensity */
+    uint16_t solarRad;                  /* solar radiation level */
+    uint16_t rainStorm;                 /* clicks in current storm */
+    uint16_t rainStormDate;             /* start of current storm */
+    uint16_t rainDay;                   /* clicks today */
+    uint16_t rain15;                    /* clicks in the last 15 minutes */
+    uint16_t rainHour;                  /* clicks in the last hour */
+    uint16_t etDay;                     /* evapo-transpiration for the day */
+    uint16_t rain24;                    /* clicks in the last 24 hours */
+    uint8_t barReduction;               /* bar reduction method */
+    int16_t barOffset;                  /* user entered bar offset */
+    uint16_t barCal;                    /* bar calibration number */
+    uint16_t barRaw;                    /* bar sensor raw reading */
+    uint16_t barAbs;                    /* absolute barometric pressure */
+    uint16_t altimeter;                 /* altimeter setting */
+    uint8_t unused6[2];
+    uint8_t graphPtrs[10];              /* next graph slots */
+    uint8_t unused7[12];
+    uint8_t nl;                         /* \n */
+    uint8_t ret;                        /* \r */
+    uint16_t crc;                       /* two bytes of crc */
+} vploop2data_t;
+#pragma pack()
+
+#define VPLOOP1TYPE 0
+#define VPLOOP2TYPE 1
+
 #define VPLOOPCMD "LOOP 01\n"
+#define VPLOOPNCMD "LOOP %d\n"         /* streaming, n packets */
+#define VPLPSCMD "LPS 3 2\n"             /* one LOOP and one LOOP2 */
+#define VPLPSNCMD "LPS 3 %d\n"         /* streaming, n of them alternating */
+#define VPLOOPSTREAMCNT 200             /* packets per streaming LOOP */
+#define VPLOOPINTERVAL 2                /* secs between LOOP packets */
+#define VPLOOPSTALE 10                  /* don't log packets older than this */
 #define IDENT_VP 0x10
 
+/*
+ * One Rev B archive record as sent by DMP/DMPAFT, five to a page.
+ * Date and time are the console's local time at the end of the
+ * archive interval, dashed values are all ones (0x7fff for temps).
+ */
+#pragma pack(1)
+typedef struct vparchive {
+    uint16_t date;                      /* day + month*32 + (year-2000)*512 */
+    uint16_t time;                      /* hour*100 + minute */
+    int16_t tempOut;                    /* average outdoor temperature */
+    int16_t tempOutHi;                  /* high outdoor temperature */
+    int16_t tempOutLo;                  /* low outdoor temperature */
+    uint16_t rain;                      /* rain clicks this interval */
+    uint16_t rainRateHi;                /* high rain rate, clicks/hour */
+    uint16_t bar;                       /* barometric pressure */
+    uint16_t solarRad;                  /* average solar radiation */
+    uint16_t windSamples;               /* wind samples this interval */
+    int16_t tempIn;                     /* indoor temperature */
+    uint8_t humIn;                      /* indoor humidity */
+    uint8_t humOut;                     /* outdoor humidity */
+    uint8_t windSpeed;                  /* average wind speed */
+    uint8_t windSpeedHi;                /* high wind speed */
+    uint8_t windDirHi;                  /* direction of the high, 0-15 */
+    uint8_t windDir;                    /* prevailing direction, 0-15 */
+    uint8_t uv;                         /* average UV index */
+    uint8_t et;                         /* evapo-transpiration */
+    uint16_t solarRadHi;                /* high solar radiation */
+    uint8_t uvHi;                       /* high UV index */
+    uint8_t forecastRule;               /* forecast rule number */
+    uint8_t leafTemp[2];                /* leaf temperatures */
+    uint8_t leafWet[2];                 /* leaf wetness */
+    uint8_t soilTemp[4];                /* soil temperatures */
+    uint8_t recType;                    /* 0x00 Rev B, 0xff Rev A */
+    uint8_t humExt[2];                  /* extra humidities */
+    uint8_t tempExt[3];                 /* extra temperatures */
+    uint8_t soilMoist[4];               /* soil moisture */
+} vparchive_t;
+
+typedef struct vparchpage {
+    uint8_t seq;                        /* page sequence number */
+    vparchive_t rec[5];                 /* oldest first */
+    uint8_t unused[4];
+    uint16_t crc;                       /* two bytes of crc */
+} vparchpage_t;
+#pragma pack()
+
+#define VPARCHSIZE sizeof(vparchive_t)
+#define VPARCHPAGESIZE sizeof(vparchpage_t)
+#define VPARCHPERPAGE 5
+#define VPARCHREVB 0x00
+
+#define VPDMPAFTCMD "DMPAFT\n"
+#define VPNAK 0x21                      /* page was bad, send it again */
+#define VPESC 0x1b                      /* stop sending pages */
+#define VPARCHDATE(y, m, d) ((d) + (m) * 32 + ((y) - 2000) * 512)
+#define VPARCHTIME(h, m) ((h) * 100 + (m))
+
 /*
  * Offsets on non-vantage-pro models (wizard-III, monitor-II, etc...
  * Not currently supported but why throw the info away, someday I
@@ -0,0 +1,124 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Resynchronizing parser for the LOOP byte stream.  Rather than
+ * assume every read lines up with a packet we hunt for the "LOO"
+ * signature, run the crc over the candidate as bytes trickle in, and
+ * on a bad crc start hunting again one byte past the bogus signature.
+ * A dropped or doubled byte then costs one packet, not the stream.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+#include "davis.h"
+
+#define RING(fp, i)     ((fp)->ring[(i) & (WXFRAMERING - 1)])
+
+/* from crc.c */
+extern unsigned short wxcrcupdate(unsigned short crc, unsigned char c);
+
+void
+wxframeinit(wxframe_t *fp)
+{
+    memset((void *)fp, 0, sizeof(wxframe_t));
+}
+
+/*
+ * toss anything buffered, used when the stream is restarted
+ */
+void
+wxframereset(wxframe_t *fp)
+{
+    fp->tail = fp->head;
+    fp->pos = 0;
+    fp->insync = 0;
+}
+
+void
+wxframeput(wxframe_t *fp, const void *buf, size_t len)
+{
+    const unsigned char *p;
+    unsigned int room;
+
+    p = (const unsigned char *)buf;
+    room = WXFRAMERING - (fp->head - fp->tail);
+    if (len > room) {
+        /* make room by dropping the oldest bytes, sync is lost */
+        fp->overruns += len - room;
+        fp->tail += len - room;
+        fp->pos = 0;
+        fp->insync = 0;
+    }
+    while (len-- > 0) {
+        RING(fp, fp->head++) = *p++;
+    }
+}
+
+/*
+ * returns WXFRAMEGOOD with a frame copied to frame, WXFRAMEBAD when a
+ * candidate failed its crc (the caller may want to count those), or
+ * WXFRAMENEED when the ring doesn't yet hold a whole frame
+ */
+int
+wxframeget(wxframe_t *fp, void *frame)
+{
+    unsigned char *dst;
+    unsigned int avail;
+    unsigned int i;
+
+    avail = fp->head - fp->tail;
+    if (!fp->insync) {
+        while (avail >= 3 && (RING(fp, fp->tail) != 'L' ||
+                              RING(fp, fp->tail + 1) != 'O' ||
+                              RING(fp, fp->tail + 2) != 'O')) {
+            ++fp->tail;
+            ++fp->skipped;
+            --avail;
+        }
+        if (avail < 3) {
+            return WXFRAMENEED;
+        }
+        fp->insync = 1;
+        fp->crc = 0;
+        fp->pos = 0;
+    }
+
+    while (fp->pos < VPLOOPSIZE && fp->pos < avail) {
+        fp->crc = wxcrcupdate(fp->crc, RING(fp, fp->tail + fp->pos));
+        ++fp->pos;
+    }
+    if (fp->pos < VPLOOPSIZE) {
+        return WXFRAMENEED;
+    }
+
+    fp->insync = 0;
+    if (fp->crc != 0) {
+        /* resync on the next signature after this one */
+        ++fp->crcerrs;
+        ++fp->tail;
+        return WXFRAMEBAD;
+    }
+    dst = (unsigned char *)frame;
+    for (i = 0; i < VPLOOPSIZE; ++i) {
+        *dst++ = RING(fp, fp->tail + i);
+    }
+    fp->tail += VPLOOPSIZE;
+    ++fp->frames;
+    return WXFRAMEGOOD;
+}
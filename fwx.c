@@ -26,57 +26,292 @@
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
-#include <sys/rtprio.h>
 #include <errno.h>
+#include <poll.h>
 #include <math.h>
 #include <ctype.h>
 #include <sys/socket.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "fwx.h"
 #include "davis.h"
+#include "net.h"
+#include "fwxbin.h"
+#include "fwxshm.h"
+#include "fwxcap.h"
 
 #define VERSION_MAJ 0
 #define VERSION_MIN 5
 #define CONFIG "/usr/local/etc/fwx.conf"
 
-#define USAGE "usage:\n%s [-b] [-i <interval>] -l <logdir> -d <device>\n"
+#if VERSION_MAJ != FWXB_VERMAJ || VERSION_MIN != FWXB_VERMIN
+#error "fwxbin.h is out of step with the CSV version"
+#endif
+
+#define WUHOST "rtupdate.wunderground.com"
+#define AERISHOST "www.pwsweather.com"
+#define HTTPTIMEOUT 3000        /* ms allowed for each upload */
+#define SPOOLBATCH 10           /* spooled uploads sent per live one */
+#define UPBACKOFFMAX 600        /* most seconds to leave a failing service be */
+
+#define GUSTSPAN (10 * 60)      /* seconds looked back for gusts */
+#define RAINHOURSPAN (60 * 60)
+#define RAIN24SPAN (24 * 60 * 60)
+#define BARTRENDSPAN (3 * 60 * 60)
+#define BARTRENDSLOP (10 * 60)  /* how short of 3 hours still counts */
+#define RECONNECTMAX 300        /* most seconds between reconnect attempts */
+#define STATEFILE "fwx.state"   /* in the log directory */
+#define STATESECS 60            /* seconds between checkpoints */
+#define STATEWINS 4             /* gust, rain hour, rain 24 hours, bar trend */
+#define BUSYHOLD (10 * 60)      /* seconds to keep sampling fast after it's calmed down */
+
+/* which packets wxgetloopcmd() & wxstream() got */
+#define WXGOTLOOP 0x01
+#define WXGOTLOOP2 0x02
+
+#define USAGE "usage:\n%s [-b] [-s] [-i <interval>] -l <logdir> -d <device|host:port>\n" \
+    "%s [-t] [-p] [-i <interval>] -l <logdir> -R <capture>\n"
 
 /* from crc.c */
 extern int wxcrc(unsigned char *buf, int len);
 /* from support.c */
 extern void dumpbuf(FILE *stream, unsigned char *p, size_t len);
-extern int wxopen(char *wxdev);
+extern int wxopenstart(wxdns_t *dp, char *devname, int *pendingp);
+extern int wxopendone(wxdns_t *dp, int fd, int64_t since);
+extern int wxlinkdown(int fd);
+extern int64_t wxmsnow(void);
 extern int wxread(int wxfd, void *buf, size_t len, int timeout);
+extern int wxreadsome(int wxfd, void *buf, size_t len, int timeout);
 extern int wxwakeup(int wxfd);
 extern int wxcmd(int fd, char *cmd);
 extern int wxgetack(int fd);
+/* from frame.c */
+extern void wxframeinit(wxframe_t *fp);
+extern void wxframereset(wxframe_t *fp);
+extern void wxframeput(wxframe_t *fp, const void *buf, size_t len);
+extern int wxframeget(wxframe_t *fp, void *frame);
+/* from http.c */
+extern wxhttp_t *wxhttpnew(const char *host, const char *port, int tls);
+extern int wxhttpget(wxhttp_t *hp, const char *path, int timeout);
+extern char *wxurlcat(char *s, const char *src);
+/* from aprs.c */
+extern wxaprs_t *wxaprsnew(const char *host, const char *port, const char *login);
+extern int wxaprssend(wxaprs_t *ap, const char *pkt, int timeout);
+/* from fwxbin.c */
+extern void fwxbhdrinit(fwxbhdr_t *hp, time_t day);
+extern char *fwxbfmtfixed(char *s, long v, int places);
+/* from schema.c */
+extern char *wxschemacsv(char *s, const wxdat_t *wxdp);
+extern void wxschemabin(const wxdat_t *wxdp, fwxbrec_t *rp);
+extern char *wxschemaquery(char *s, const wxdat_t *wxdp);
+extern char *wxschemaaprs(char *s, const wxdat_t *wxdp);
+extern char *wxschemajson(char *s, const char *name, const wxdat_t *wxdp);
+/* from writer.c */
+extern void wxwinit(wxwriter_t *wp, int syncrecs, int syncsecs);
+extern int wxwopen(wxwriter_t *wp, const char *path);
+extern int wxwrite(wxwriter_t *wp, const void *rec, size_t len, time_t now);
+extern int wxwtick(wxwriter_t *wp, time_t now);
+extern int wxwclose(wxwriter_t *wp);
+/* from window.c */
+extern int wxwininit(wxwin_t *w, time_t span, int maxsamples);
+extern void wxwinpush(wxwin_t *w, time_t t, int v, int aux);
+extern int wxwinmax(const wxwin_t *w, int *auxp);
+extern long wxwinsum(const wxwin_t *w);
+extern const wxwinsamp_t *wxwinoldest(const wxwin_t *w);
+extern int wxwincount(const wxwin_t *w);
+extern long wxwinvar(const wxwin_t *w);
+/* from history.c */
+extern int wxhistinit(wxhist_t *hp, unsigned int cap);
+extern void wxhistadd(wxhist_t *hp, const wxdat_t *wxdp);
+/* from shm.c */
+extern fwxshm_t *wxshmcreate(const char *name);
+extern void wxshmput(fwxshm_t *sp, const fwxbrec_t *rp);
+/* from archive.c */
+extern time_t wxlastlogged(const char *logdir);
+extern int wxdmpaft(int fd, time_t after,
+                    void (*fn)(const vparchive_t *ap, time_t t, void *arg), void *arg);
+extern time_t wxarchtime(const vparchive_t *ap);
+/* from stats.c */
+extern int64_t wxusnow(void);
+extern void wxstatinc(int c);
+extern void wxstatset(int c, unsigned long v);
+extern void wxstattime(int h, int64_t us);
+extern int wxstatdump(const char *path);
+/* from queue.c */
+extern int wxqinit(wxq_t *qp, unsigned int len);
+extern void wxqput(wxq_t *qp, const wxdat_t *wxdp);
+extern void wxqget(wxq_t *qp, wxdat_t *wxdp);
+extern int wxqpending(wxq_t *qp);
+/* from spool.c */
+extern void wxspoolinit(wxspool_t *qp);
+extern int wxspoolopen(wxspool_t *qp, const char *path);
+extern int wxspoolput(wxspool_t *qp, const wxdat_t *wxdp);
+extern int wxspoolpeek(wxspool_t *qp, wxdat_t *wxdp);
+extern int wxspoolpop(wxspool_t *qp);
+/* from sched.c */
+extern int64_t wxschednow(void);
+extern void wxschedinit(wxsched_t *sp, int interval);
+extern void wxschedset(wxsched_t *sp, int interval);
+extern int wxschedwait(const wxsched_t *sp);
+extern void wxschedtick(wxsched_t *sp, int64_t us);
+/* from state.c */
+extern void wxstateinit(wxstate_t *stp);
+extern int wxstateopen(wxstate_t *stp, const char *path);
+extern int wxstateident(const wxstate_t *stp, const char *dev);
+extern int wxstateload(wxstate_t *stp, time_t now, wxwin_t **wins, int nwin,
+                       wxhist_t *histp, int *rainlastp);
+extern int wxstatesave(wxstate_t *stp, time_t now, const char *dev, int ident,
+                       int rainlast, wxwin_t **wins, int nwin, const wxhist_t *histp,
+                       int sync);
+/* from rollup.c */
+extern void wxrollinit(wxroll_t *rp);
+extern int wxrolladd(wxroll_t *rp, const char *logdir, const fwxbrec_t *recp);
+extern void wxrollclose(wxroll_t *rp);
+/* from httpd.c */
+extern int wxhttpdopen(const char *addr);
+extern int wxhttpdsite(const char *name);
+extern void wxhttpdput(int site, const char *json, size_t len, const wxdat_t *wxdp,
+                       const wxhist_t *hp, const wxroll_t *rp);
+extern void *wxhttpd(void *arg);
+/* from platform.c */
+extern int wxrealtime(int cpu, int lock);
+/* from pub.c */
+extern int wxpubmqtt(const char *broker, const char *topic, const char *id);
+extern int wxpubmcast(const char *group, int ttl);
+extern int wxpubstart(void);
+extern void wxpubput(const char *station, const char *json, size_t len);
 /* forward declarations from this file */
+typedef struct wxstation wxstation_t;
 static int wxident(int fd);
-static void wxlog(char *wxlogdir, wxdat_t *wxdat);
-static void wxgetloop(int fd, wxdat_t *wxdat);
+static int wxwinsize(time_t span);
+static int wxadapt(wxstation_t *sp, const wxdat_t *wxdp, int interval);
+static void wxlog(wxstation_t *sp, wxdat_t *wxdat);
+static int wxgetloop(wxstation_t *sp, wxdat_t *wxdat);
+static void cvtvploop2fwx(wxstation_t *sp, vploopdata_t *ld, const vploop2data_t *l2,
+                          wxdat_t *wxdatp);
+static void cvtvparch2fwx(const vparchive_t *ap, wxdat_t *wxdatp);
+static void wxbackfill(const vparchive_t *ap, time_t t, void *arg);
+static void wxcapture(wxstation_t *sp, int type, const void *buf, size_t len, int64_t us);
+static void wxstream(void);
+static int wxreplaycheck(const char *path, const char *logdir);
+static int wxreplay(const char *path, int realtime);
+static void wxsample(wxstation_t *sp, wxdat_t *wxdp);
+static int wxreconnect(wxstation_t *sp);
 static void wxsendwu(wxdat_t *wxdp);
 static void wxsendcwop(wxdat_t *wxdp);
 static void wxsendaeris(wxdat_t *wxdp);
+static void wxupload(wxdat_t *wxdp);
+static void wxpublish(wxstation_t *sp, wxdat_t *wxdp);
+static void wxstatpoll(time_t now);
+static void *wxuploader(void *arg);
+
+/*
+ * everything that's kept per console.  fwx.conf can have any number
+ * of STATION blocks, settings before the first one are the first
+ * station's, as are -d and -l.
+ */
+struct wxstation {
+    char name[32];
+    char dev[64];
+    char logdir[64];
+    char wustation[64];
+    char wupassword[64];
+    char aerisstation[64];
+    char aerispassword[64];
+    char cwopuser[64];
+    char cwoploc[64];
+    char shmname[64];
+    int loop2;                  /* ask for LOOP2 too, cleared if it's refused */
+    int fd;                     /* the serial port or network connection */
+    int cfd;                    /* a network connection on its way ... */
+    int64_t csince;             /* ... since then (wxmsnow() ms) */
+    wxdns_t dns;                /* a network console's address */
+    int ident;                  /* what wxident() says it is */
+    time_t retry;               /* don't reconnect before this ... */
+    int backoff;                /* ... and wait this long after the next failure */
+    wxframe_t frame;            /* LOOP stream parser */
+    int loopleft;               /* packets before the LOOP command runs dry */
+    time_t looprx;              /* when we last heard from the station */
+    int64_t loopgood;           /* us, when the last good packet came in */
+    time_t rearm;               /* don't restart LOOP before this */
+    time_t busy;                /* when the weather was last busy, see wxadapt() */
+    vploopdata_t ld;            /* newest LOOP ... */
+    vploop2data_t l2;           /* ... and LOOP2 */
+    time_t ldtime;
+    time_t l2time;
+    int64_t ldrx;               /* wall clock us the newest LOOP came in */
+    wxsched_t sched;            /* when the next sample is due */
+    wxwriter_t logw;            /* today's log file */
+    wxwriter_t binw;            /* today's binary log file */
+    time_t logstart;            /* first second the open files cover */
+    time_t logend;              /* first second they don't */
+    wxwriter_t capw;            /* today's raw capture, see fwxcap.h */
+    time_t capstart;            /* ... and what it covers */
+    time_t capend;
+    wxroll_t roll;              /* minute, hour & day summaries */
+    wxwin_t gustwin;            /* see wxcalcwindgust() ... */
+    wind_t gust;
+    wxwin_t rainhourwin;        /* ... wxcalcrain() ... */
+    wxwin_t rain24win;
+    int rainlast;
+    wxwin_t barwin;             /* ... and wxcalcbartrend() */
+    wxhist_t hist;              /* recent samples */
+    wxstate_t state;            /* the windows and history, saved */
+    fwxshm_t *shm;              /* latest samples for local readers */
+    wxaprs_t *cwop;             /* APRS-IS connection */
+    time_t cwoplast;            /* when we last reported */
+    wxspool_t wuspool;          /* uploads waiting for each service */
+    wxspool_t aerisspool;
+    wxspool_t cwopspool;
+};
+
+#define WXMAXSTATIONS 32
+
+static wxstation_t wxstations[WXMAXSTATIONS];
+static int wxnstations;
 
-static char fwxdev[64];
-static char fwxlogdir[64];
-static char wustation[64];
-static char wupassword[64];
-static char aerisstation[64];
-static char aerispassword[64];
 static char cwopsvr[64];
-static char cwopuser[64];
-static char cwoploc[64];
 static int fwxinterval = 30;     /* default to sampling every 30 sec */
+static int fwxintervalmin;       /* ... down to this when it's busy, 0 not to */
+static int fwxbusywind = 5;      /* std dev of the wind over GUSTSPAN, mph */
+static int fwxbusyrain = 10;     /* rain rate, hundredths of an inch/hr */
+static int fwxbusybar = 60;      /* bar trend, thousandths of an inch in 3 hours */
+static int fwxstream;            /* stream LOOP packets, default to polling */
+static wxq_t wxupq;              /* samples waiting to be uploaded */
+static int wxupthreaded;         /* uploads run in their own thread */
+
+static int fwxsyncrecs;           /* log commit policy, see writer.c */
+static int fwxsyncsecs;
+static int fwxbinary;            /* also write a binary log */
+static int fwxrollup = 1;       /* keep minute, hour & day rollups */
+static int fwxhistdays = WXHISTDAYS;    /* how much history to hold */
+static char fwxstatsfile[64];    /* counters & histograms go here */
+static int fwxstatssecs = 60;    /* ... this often */
+static int fwxbackfill = 1;      /* fill gaps from the console's archive */
+static char fwxhttp[64];         /* serve JSON on [host:]port, see httpd.c */
+static int fwxhttpd;             /* ... and we are */
+static char fwxmqtt[128];        /* publish to this broker ... */
+static char fwxmqtttopic[64] = "fwx";   /* ... under this/<station> ... */
+static char fwxmqttid[64];       /* ... as this client */
+static char fwxmcast[128];       /* publish to this group:port ... */
+static int fwxmcastttl = 1;      /* ... this many hops out */
+static int fwxpub;               /* sinks are running, see pub.c */
+static int fwxrealtime = 1;      /* sample at real-time priority ... */
+static int fwxcpu = -1;          /* ... on this CPU, -1 for any ... */
+static int fwxmlock;             /* ... with our memory locked in */
+static int fwxcapture;           /* keep what the consoles send as sent */
+static const char *fwxreplay;    /* -R, play this capture back instead */
+static volatile sig_atomic_t fwxdone;   /* asked to shut down */
 
 static void
-alarmcatcher(int sig)
+termcatcher(int sig)
 {
     (void)sig;
-    return;
+    fwxdone = 1;
 }
 
 /*
@@ -114,60 +349,404 @@ chkvar(const char *s, const char *name, char *dst, size_t len)
     return 1;
 }
 
+/*
+ * fresh station, the defaults that aren't 0
+ */
+static wxstation_t *
+wxstationnew(void)
+{
+    wxstation_t *sp;
+
+    if (wxnstations == WXMAXSTATIONS) {
+        return (wxstation_t *)0;
+    }
+    sp = &wxstations[wxnstations++];
+    memset((void *)sp, 0, sizeof(wxstation_t));
+    sp->loop2 = 1;
+    sp->fd = -1;
+    sp->cfd = -1;
+    sp->rainlast = -1;
+    wxspoolinit(&sp->wuspool);
+    wxspoolinit(&sp->aerisspool);
+    wxspoolinit(&sp->cwopspool);
+    wxstateinit(&sp->state);
+    wxrollinit(&sp->roll);
+    return sp;
+}
+
+/*
+ * open the console, again after it's gone away, and check it's one we
+ * know, 0 if it is.  A network console's connect isn't waited for,
+ * this returns 1 while it's on its way and is called again to see how
+ * it got on.  Backs off while that keeps failing.
+ */
+static int
+wxstationconnect(wxstation_t *sp, time_t now)
+{
+    int pending;
+    int fd;
+
+    if (sp->cfd == -1) {
+        if ((fd = wxopenstart(&sp->dns, sp->dev, &pending)) != -1 && pending) {
+            sp->cfd = fd;
+            sp->csince = wxmsnow();
+            return 1;
+        }
+    } else if ((pending = wxopendone(&sp->dns, sp->cfd, sp->csince)) == 1) {
+        return 1;
+    } else {
+        fd = pending == 0 ? sp->cfd : -1;
+        sp->cfd = -1;
+    }
+    if ((sp->fd = fd) != -1) {
+        if (sp->ident == -1) {
+            sp->ident = wxident(sp->fd);
+        }
+        switch (sp->ident) {
+        case IDENT_VP:      /* vantage pro or vantage pro2 */
+            sp->backoff = 0;
+            sp->retry = 0;
+            return 0;
+        case -1:            /* didn't answer */
+            break;
+        default:
+            fprintf(stderr, "%s: Only Vantage Pro and Pro2 are supported\n", sp->name);
+            sp->ident = -1;
+            break;
+        }
+        (void)close(sp->fd);
+        sp->fd = -1;
+    }
+    sp->backoff = sp->backoff ? sp->backoff * 2 : 1;
+    if (sp->backoff > RECONNECTMAX) {
+        sp->backoff = RECONNECTMAX;
+    }
+    sp->retry = now + sp->backoff;
+    fprintf(stderr, "%s: can't talk to %s, next try in %ds\n", sp->name, sp->dev,
+            sp->backoff);
+    return -1;
+}
+
+/*
+ * let the network consoles' connects from startup finish, all of them
+ * at once, before anything wants to talk to them
+ */
+static void
+wxstationsettle(void)
+{
+    struct pollfd pfd[WXMAXSTATIONS];
+    wxstation_t *sp;
+    int n;
+
+    for (;;) {
+        for (n = 0, sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+            if (sp->cfd != -1 && wxstationconnect(sp, time((time_t *)0)) == 1) {
+                pfd[n].fd = sp->cfd;
+                pfd[n].events = POLLOUT;
+                pfd[n].revents = 0;
+                ++n;
+            }
+        }
+        if (n == 0) {
+            return;
+        }
+        if (poll(pfd, (nfds_t)n, 100) == -1 && errno != EINTR) {
+            perror("wxstationsettle - poll");
+            return;
+        }
+    }
+}
+
+/*
+ * check there's somewhere to log to and open the station's console.
+ * Only the first is fatal, a console that's unplugged or down is
+ * logged as no data and retried from the sampling loop so the other
+ * stations carry on.
+ */
+static int
+wxstationopen(wxstation_t *sp)
+{
+    char path[FILENAME_MAX];
+    struct stat st;
+
+    /*
+     * check that the log directory exists & is a directory, all other
+     * checks will wait 'til we try to log into it
+     */
+    if ((stat(sp->logdir, &st)) == -1) {
+        fprintf(stderr, "cannot access log director %s\n", sp->logdir);
+        return -1;
+    }
+    if ((st.st_mode & S_IFDIR) == 0) {
+        fprintf(stderr, "%s is not a directory\n", sp->logdir);
+        return -1;
+    }
+
+    /* a console we've talked to before doesn't need asking what it is */
+    (void)snprintf(path, sizeof(path), "%s/%s", sp->logdir, STATEFILE);
+    if (wxstateopen(&sp->state, path) != 0) {
+        fprintf(stderr, "%s: gusts, rain & trends will start over after a restart\n",
+                sp->name);
+    }
+    sp->ident = wxstateident(&sp->state, sp->dev);
+    (void)wxstationconnect(sp, time((time_t *)0));
+    return 0;
+}
+
+/*
+ * the windows in the order they're saved
+ */
+static int
+wxstationwins(wxstation_t *sp, wxwin_t **wins)
+{
+    wins[0] = &sp->gustwin;
+    wins[1] = &sp->rainhourwin;
+    wins[2] = &sp->rain24win;
+    wins[3] = &sp->barwin;
+    return STATEWINS;
+}
+
+/*
+ * pick the windows and history up where the last run left them, rain
+ * since the last reading is only counted if we weren't gone long
+ */
+static void
+wxstationwarm(wxstation_t *sp, time_t now)
+{
+    wxwin_t *wins[STATEWINS];
+    int rainlast;
+    int nwin;
+
+    if (!sp->gustwin.cap) {
+        (void)wxwininit(&sp->gustwin, GUSTSPAN, wxwinsize(GUSTSPAN));
+    }
+    if (!sp->rainhourwin.cap) {
+        (void)wxwininit(&sp->rainhourwin, RAINHOURSPAN, wxwinsize(RAINHOURSPAN));
+    }
+    if (!sp->rain24win.cap) {
+        (void)wxwininit(&sp->rain24win, RAIN24SPAN, wxwinsize(RAIN24SPAN));
+    }
+    if (!sp->barwin.cap) {
+        (void)wxwininit(&sp->barwin, BARTRENDSPAN, wxwinsize(BARTRENDSPAN));
+    }
+    nwin = wxstationwins(sp, wins);
+    if (wxstateload(&sp->state, now, wins, nwin, &sp->hist, &rainlast) != 0) {
+        return;
+    }
+    if (now - sp->state.saved <= RAINHOURSPAN) {
+        sp->rainlast = rainlast;
+    }
+    fprintf(stderr, "%s: picked up state saved %ld seconds ago\n", sp->name,
+            (long)(now - sp->state.saved));
+}
+
+/*
+ * checkpoint the windows and history, with sync set wait for the disk
+ */
+static void
+wxstationsave(wxstation_t *sp, time_t now, int sync)
+{
+    wxwin_t *wins[STATEWINS];
+    int nwin;
+
+    nwin = wxstationwins(sp, wins);
+    (void)wxstatesave(&sp->state, now, sp->dev, sp->ident, sp->rainlast, wins, nwin,
+                      &sp->hist, sync);
+}
+
+/*
+ * commit whatever the logs have waiting if FWXSYNCSECS says it's
+ * time, called on every pass so a console that's gone quiet can't
+ * hold records back
+ */
+static void
+wxstationtick(wxstation_t *sp, time_t now)
+{
+    (void)wxwtick(&sp->logw, now);
+    (void)wxwtick(&sp->binw, now);
+    (void)wxwtick(&sp->capw, now);
+}
+
+static void
+wxstationspool(wxstation_t *sp, wxspool_t *qp, const char *name)
+{
+    char path[FILENAME_MAX];
+
+    (void)snprintf(path, sizeof(path), "%s/%s", sp->logdir, name);
+    if (wxspoolopen(qp, path) != 0) {
+        fprintf(stderr, "%s: uploads to %s won't be kept while it's down\n",
+                sp->name, name);
+    }
+}
+
 int
 main(int argc, char **argv)
 {
     wxdat_t wxdat;
-    struct itimerval itv;
-    struct rtprio rtp;
-    int wxfd;
+    wxsched_t sched;
+    pthread_t uptid;
+    pthread_t httptid;
+    sigset_t sigs;
+    wxstation_t *sp;
+    int nrec;
+    int ivl;
     int c;
-    struct stat st;
+    int i;
     int background;           /* foreground by default */
+    int paced;                /* replay in real time, not flat out */
+    int logdirarg;            /* -l was given */
+    int live;                 /* replay to the HTTP server & publishers too */
+    int rc;
     char str[128];
     char tmpstr[8];
+    char name[32];
     char *s;
     FILE *fp;
 
+    sp = wxstationnew();
+
     /*
      * read the optional config file first so command line
      * arguments can override it
      */
     if ((fp = fopen(CONFIG, "r")) != (FILE *)0) {
+        memset((void *)name, 0, sizeof(name));
         while(fgets(str, sizeof(str), fp) != (char *)0) {
             s = str;
             while (isspace(*s)) {
                 ++s;            /* clean up leading cruft */
             }
-            if (chkvar(s, "FWXLOGDIR", fwxlogdir, sizeof(fwxlogdir)-1)) {
+            /* everything up to the next STATION line is this station's */
+            if (chkvar(s, "STATION", name, sizeof(name)-1)) {
+                if ((*sp->name || *sp->dev) && !(sp = wxstationnew())) {
+                    fprintf(stderr, "more than %d stations\n", WXMAXSTATIONS);
+                    return 1;
+                }
+                strcpy(sp->name, name);
+                continue;
+            }
+            if (chkvar(s, "FWXLOGDIR", sp->logdir, sizeof(sp->logdir)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXDEV", sp->dev, sizeof(sp->dev)-1)) {
                 continue;
             }
-            if (chkvar(s, "FWXDEV", fwxdev, sizeof(fwxdev)-1)) {
+            if (chkvar(s, "FWXINTERVALMIN", tmpstr, sizeof(tmpstr)-1)) {
+                fwxintervalmin = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXBUSYWIND", tmpstr, sizeof(tmpstr)-1)) {
+                fwxbusywind = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXBUSYRAIN", tmpstr, sizeof(tmpstr)-1)) {
+                fwxbusyrain = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXBUSYBAR", tmpstr, sizeof(tmpstr)-1)) {
+                fwxbusybar = (int)strtol(tmpstr, (char **)0, 0);
                 continue;
             }
             if (chkvar(s, "FWXINTERVAL", tmpstr, sizeof(tmpstr)-1)) {
                 fwxinterval = (int)strtol(tmpstr, (char **)0, 0);
                 continue;
             }
-            if (chkvar(s, "WUSTATION", wustation, sizeof(wustation)-1)) {
+            if (chkvar(s, "FWXSYNCRECS", tmpstr, sizeof(tmpstr)-1)) {
+                fwxsyncrecs = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXSYNCSECS", tmpstr, sizeof(tmpstr)-1)) {
+                fwxsyncsecs = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXBINARY", tmpstr, sizeof(tmpstr)-1)) {
+                fwxbinary = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXROLLUP", tmpstr, sizeof(tmpstr)-1)) {
+                fwxrollup = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXHISTDAYS", tmpstr, sizeof(tmpstr)-1)) {
+                fwxhistdays = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXSHM", sp->shmname, sizeof(sp->shmname)-1)) {
                 continue;
             }
-            if (chkvar(s, "WUPASSWORD", wupassword, sizeof(wupassword)-1)) {
+            if (chkvar(s, "FWXLOOP2", tmpstr, sizeof(tmpstr)-1)) {
+                sp->loop2 = (int)strtol(tmpstr, (char **)0, 0);
                 continue;
             }
-            if (chkvar(s, "AERISSTATION", aerisstation, sizeof(aerisstation)-1)) {
+            if (chkvar(s, "FWXCAPTURE", tmpstr, sizeof(tmpstr)-1)) {
+                fwxcapture = (int)strtol(tmpstr, (char **)0, 0);
                 continue;
             }
-            if (chkvar(s, "AERISPASSWORD", aerispassword, sizeof(aerispassword)-1)) {
+            if (chkvar(s, "FWXBACKFILL", tmpstr, sizeof(tmpstr)-1)) {
+                fwxbackfill = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXSTATSSECS", tmpstr, sizeof(tmpstr)-1)) {
+                fwxstatssecs = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXSTATS", fwxstatsfile, sizeof(fwxstatsfile)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXREALTIME", tmpstr, sizeof(tmpstr)-1)) {
+                fwxrealtime = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXCPU", tmpstr, sizeof(tmpstr)-1)) {
+                fwxcpu = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXMLOCK", tmpstr, sizeof(tmpstr)-1)) {
+                fwxmlock = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXHTTP", fwxhttp, sizeof(fwxhttp)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXMQTTTOPIC", fwxmqtttopic, sizeof(fwxmqtttopic)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXMQTTID", fwxmqttid, sizeof(fwxmqttid)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXMQTT", fwxmqtt, sizeof(fwxmqtt)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXMCASTTTL", tmpstr, sizeof(tmpstr)-1)) {
+                fwxmcastttl = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "FWXMCAST", fwxmcast, sizeof(fwxmcast)-1)) {
+                continue;
+            }
+            if (chkvar(s, "FWXSTREAM", tmpstr, sizeof(tmpstr)-1)) {
+                fwxstream = (int)strtol(tmpstr, (char **)0, 0);
+                continue;
+            }
+            if (chkvar(s, "WUSTATION", sp->wustation, sizeof(sp->wustation)-1)) {
+                continue;
+            }
+            if (chkvar(s, "WUPASSWORD", sp->wupassword, sizeof(sp->wupassword)-1)) {
+                continue;
+            }
+            if (chkvar(s, "AERISSTATION", sp->aerisstation, sizeof(sp->aerisstation)-1)) {
+                continue;
+            }
+            if (chkvar(s, "AERISPASSWORD", sp->aerispassword, sizeof(sp->aerispassword)-1)) {
                 continue;
             }
             if (chkvar(s, "CWOPSVR", cwopsvr, sizeof(cwopsvr)-1)) {
                 continue;
             }
-            if (chkvar(s, "CWOPUSER", cwopuser, sizeof(cwopuser)-1)) {
+            if (chkvar(s, "CWOPUSER", sp->cwopuser, sizeof(sp->cwopuser)-1)) {
                 continue;
             }
-            if (chkvar(s, "CWOPLOC", cwoploc, sizeof(cwoploc)-1)) {
+            if (chkvar(s, "CWOPLOC", sp->cwoploc, sizeof(sp->cwoploc)-1)) {
                 continue;
             }
             /* ignore any line that doesn't match */
@@ -175,65 +754,115 @@ main(int argc, char **argv)
         fclose(fp);
     }
 
+    /* the command line only knows about the first station */
+    sp = &wxstations[0];
     background = 0;
-    while ((c = getopt(argc, argv, "d:i:l:b")) != -1) {
+    paced = 0;
+    logdirarg = 0;
+    live = 0;
+    while ((c = getopt(argc, argv, "d:i:l:R:bpst")) != -1) {
         switch (c) {
         case 'd':
-            strncpy(fwxdev, optarg, sizeof(fwxdev)-1);
+            strncpy(sp->dev, optarg, sizeof(sp->dev)-1);
             break;
         case 'i':
             fwxinterval = (int)strtol(optarg, (char **)0, 0);
             break;
         case 'l':
-            strncpy(fwxlogdir, optarg, sizeof(fwxlogdir)-1);
+            strncpy(sp->logdir, optarg, sizeof(sp->logdir)-1);
+            ++logdirarg;
             break;
         case 'b':
            ++background;
            break;
+        case 's':
+            ++fwxstream;
+            break;
+        case 'R':
+            fwxreplay = optarg;
+            break;
+        case 't':
+            ++paced;
+            break;
+        case 'p':
+            ++live;
+            break;
         default:
-            fprintf(stderr, USAGE, argv[0]);
+            fprintf(stderr, USAGE, argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if (fwxreplay) {
+        /*
+         * a capture is one station's, it goes to the first one with
+         * nothing reaching a console or an upload service and nothing
+         * captured again
+         */
+        wxnstations = 1;
+        *sp->wustation = *sp->aerisstation = *cwopsvr = '\0';
+        fwxcapture = 0;
+        fwxbackfill = 0;
+        fwxrealtime = 0;
+        if (!*sp->dev) {
+            strncpy(sp->dev, fwxreplay, sizeof(sp->dev)-1);
+        }
+        /* the configured log directory & sinks are most likely a live fwx's */
+        if (!logdirarg) {
+            fprintf(stderr, "-R needs a log directory of its own, given with -l\n");
+            return 1;
+        }
+        if (!live) {
+            *fwxhttp = *fwxmqtt = *fwxmcast = *sp->shmname = '\0';
+        }
+        if (wxreplaycheck(fwxreplay, sp->logdir) != 0) {
             return 1;
         }
     }
+    for (sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+        if (!*sp->name) {
+            strncpy(sp->name, sp->dev, sizeof(sp->name)-1);
+        }
 #ifdef DEBUG_CONFIG
-    fprintf(stdout, "station %s password %s logdir %s dev %s interval %d\n",
-            wustation, wupassword, fwxlogdir, fwxdev, fwxinterval);
+        fprintf(stdout, "%s: station %s password %s logdir %s dev %s interval %d\n",
+                sp->name, sp->wustation, sp->wupassword, sp->logdir, sp->dev,
+                fwxinterval);
 #endif /*DEBUG_CONFIG*/
-
-    /*
-     * these two have no default and neither one is optional
-     */
-    if (!*fwxdev || !*fwxlogdir) {
-        fprintf(stderr, USAGE, argv[0]);
-        return 1;
+        /*
+         * these two have no default and neither one is optional
+         */
+        if (!*sp->dev || !*sp->logdir) {
+            fprintf(stderr, USAGE, argv[0], argv[0]);
+            return 1;
+        }
+        (void)wxhttpdsite(sp->name);
     }
-    /*
-     * open and configure the serial device to a state the station can
-     * talk to.
-     */
-    if ((wxfd = wxopen(fwxdev)) == -1) {
-        fprintf(stderr, "wxopen failed for device %s\n", fwxdev);
+    if (fwxinterval < 1) {
+        fprintf(stderr, "interval must be at least 1 second\n");
         return 1;
     }
+    /* a console or server hanging up is an error from write(), not fatal */
+    signal(SIGPIPE, SIG_IGN);
+    for (sp = wxstations; !fwxreplay && sp < &wxstations[wxnstations]; ++sp) {
+        if (wxstationopen(sp) != 0) {
+            return 1;
+        }
+    }
 
-    /*
-     * check that wxlogdir exists & is a directory, all other checks
-     * will wait 'til we try to log into it
-     */
-    if ((stat(fwxlogdir, &st)) == -1) {
-        fprintf(stderr, "cannot access log director %s\n", fwxlogdir);
+    if (*fwxhttp && wxhttpdopen(fwxhttp) != 0) {
         return 1;
     }
-    if ((st.st_mode & S_IFDIR) == 0) {
-        fprintf(stderr, "%s is not a directory\n", fwxlogdir);
-        return 1;
+    if (*fwxmqtt) {
+        /* the broker keeps our session under this name */
+        if (!*fwxmqttid) {
+            (void)strcpy(fwxmqttid, "fwx-");
+            (void)gethostname(fwxmqttid + 4, sizeof(fwxmqttid) - 5);
+        }
+        if (wxpubmqtt(fwxmqtt, fwxmqtttopic, fwxmqttid) != 0) {
+            return 1;
+        }
     }
-
-    switch (wxident(wxfd)) {
-    case IDENT_VP:      /* vantage pro or vantage pro2 */
-        break;
-    default:
-        fprintf(stderr, "Only Vantage Pro and Pro2 are supported\n");
+    if (*fwxmcast && wxpubmcast(fwxmcast, fwxmcastttl) != 0) {
         return 1;
     }
 
@@ -242,138 +871,380 @@ main(int argc, char **argv)
         return 1;
     }
 
-    rtp.type = RTP_PRIO_REALTIME;
-    rtp.prio = 16;
-    if ((rtprio(RTP_SET, 0, &rtp)) != 0) {
-        perror("rtprio");
+    /*
+     * uploads can stall for seconds on a slow server, keep them off
+     * the sampling loop.  If we can't get a thread do them inline.
+     */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGINT);
+    /* signals are for the sampling loop, the uploader inherits a mask */
+    (void)pthread_sigmask(SIG_BLOCK, &sigs, (sigset_t *)0);
+    if (wxqinit(&wxupq, (unsigned int)wxnstations * WXQLEN) != 0) {
+        fprintf(stderr, "uploading inline\n");
+    } else if ((errno = pthread_create(&uptid, (pthread_attr_t *)0,
+                                       wxuploader, (void *)0)) != 0) {
+        perror("pthread_create");
+    } else {
+        ++wxupthreaded;
+    }
+    /* local displays polling us don't get anywhere near the serial port */
+    if (*fwxhttp) {
+        if ((errno = pthread_create(&httptid, (pthread_attr_t *)0,
+                                    wxhttpd, (void *)0)) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+        ++fwxhttpd;
     }
+    fwxpub = wxpubstart() > 0;
+    (void)pthread_sigmask(SIG_UNBLOCK, &sigs, (sigset_t *)0);
 
-    signal(SIGALRM, alarmcatcher);
-    itv.it_interval.tv_sec = itv.it_value.tv_sec = fwxinterval;
-    itv.it_interval.tv_usec = itv.it_value.tv_usec = 0;
-    (void)setitimer(ITIMER_REAL, &itv, (struct itimerval *)0);
-    while (1) {
-        memset((void *)&wxdat, 0, sizeof(wxdat_t));
-        wxdat.time = time((time_t *)0);
-        wxgetloop(wxfd, &wxdat);
-        wxlog(fwxlogdir, &wxdat);
-        wxsendwu(&wxdat);
-        wxsendcwop(&wxdat);
-        wxsendaeris(&wxdat);
-        /* wait for my itimer to expire */
-        (void)select(0, (fd_set *)0, (fd_set *)0, (fd_set *)0, (struct timeval *)0);
+    for (sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+        wxwinit(&sp->logw, fwxsyncrecs, fwxsyncsecs);
+        wxwinit(&sp->binw, fwxsyncrecs, fwxsyncsecs);
+        wxwinit(&sp->capw, fwxsyncrecs, fwxsyncsecs);
+        if (fwxhistdays > 0 &&
+            wxhistinit(&sp->hist,
+                (unsigned int)wxwinsize((time_t)fwxhistdays * 24 * 60 * 60)) != 0) {
+            fprintf(stderr, "%s: running without history\n", sp->name);
+        }
+        wxstationwarm(sp, time((time_t *)0));
+        if (*sp->shmname && !(sp->shm = wxshmcreate(sp->shmname))) {
+            fprintf(stderr, "not publishing to %s\n", sp->shmname);
+        }
+        /* uploads a service misses wait next to the log */
+        if (*sp->wustation) {
+            wxstationspool(sp, &sp->wuspool, "wu.spool");
+        }
+        if (*sp->aerisstation) {
+            wxstationspool(sp, &sp->aerisspool, "aeris.spool");
+        }
+        if (*cwopsvr && *sp->cwopuser) {
+            wxstationspool(sp, &sp->cwopspool, "cwop.spool");
+        }
+    }
+    signal(SIGTERM, termcatcher);
+    signal(SIGINT, termcatcher);
+
+    /*
+     * log whatever the consoles archived while we weren't looking
+     * before we start adding to it
+     */
+    if (fwxbackfill) {
+        wxstationsettle();
+    }
+    for (sp = wxstations; fwxbackfill && sp < &wxstations[wxnstations]; ++sp) {
+        if (sp->fd != -1 &&
+            (nrec = wxdmpaft(sp->fd, wxlastlogged(sp->logdir), wxbackfill,
+                             (void *)sp)) > 0) {
+            fprintf(stderr, "%s: backfilled %d archive records\n", sp->name, nrec);
+        }
+    }
+
+    /* the sampling loop's reads want steady timing, see platform.c */
+    if (fwxrealtime) {
+        (void)wxrealtime(fwxcpu, fwxmlock);
+    }
+
+    rc = 0;
+    if (fwxreplay) {
+        rc = wxreplay(fwxreplay, paced) != 0;
+    } else if (fwxstream) {
+        wxstream();
+    } else {
+        /*
+         * ask each station in turn on every fwxinterval boundary
+         */
+        wxschedinit(&sched, fwxinterval);
+        while (!fwxdone) {
+            for (sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+                wxstationtick(sp, time((time_t *)0));
+            }
+            if (wxschedwait(&sched) != 0) {
+                continue;
+            }
+            wxschedtick(&sched, wxschednow());
+            /* the busiest station sets the pace for all of them */
+            ivl = fwxinterval;
+            for (sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+                memset((void *)&wxdat, 0, sizeof(wxdat_t));
+                wxdat.time = time((time_t *)0);
+                if (sp->fd == -1 || wxgetloop(sp, &wxdat) != 0) {
+                    wxstatinc(WXC_NODATA);
+                    /* a bad crc or a slow answer isn't worth a new session */
+                    if (sp->fd == -1 || wxlinkdown(sp->fd)) {
+                        (void)wxreconnect(sp);
+                    }
+                }
+                wxsample(sp, &wxdat);
+                if ((c = wxadapt(sp, &wxdat, sched.interval)) < ivl) {
+                    ivl = c;
+                }
+            }
+            wxschedset(&sched, ivl);
+            wxstatpoll(time((time_t *)0));
+        }
     }
-    return 0;   /*NOTREACHED*/
+    for (i = 0; i < wxnstations; ++i) {
+        wxstationsave(&wxstations[i], time((time_t *)0), 1);
+        (void)wxwclose(&wxstations[i].logw);
+        (void)wxwclose(&wxstations[i].binw);
+        (void)wxwclose(&wxstations[i].capw);
+        wxrollclose(&wxstations[i].roll);
+    }
+    return rc;
 }
 
-static void
-wxlog(char *wxlogdir, wxdat_t *wxdp)
+/*
+ * today's log file stays open 'til the first sample after local
+ * midnight
+ */
+static int
+wxlogrotate(wxstation_t *sp, time_t t)
 {
     char str[FILENAME_MAX];
+    fwxbhdr_t hdr;
+    struct stat st;
+    struct tm tm;
     char *s;
-    FILE *file;
 
-    (void)strcpy(str, wxlogdir);
+    (void)localtime_r(&t, &tm);
+    (void)strcpy(str, sp->logdir);
     s = &str[strlen(str)];
-    if (*s == '/') {
-        strftime(s, 15, "%Y.%m.%d.fwx", localtime(&wxdp->time));
+    if (s[-1] == '/') {
+        strftime(s, 15, "%Y.%m.%d.fwx", &tm);
     } else {
-        strftime(s, 16,"/%Y.%m.%d.fwx", localtime(&wxdp->time));
+        strftime(s, 16,"/%Y.%m.%d.fwx", &tm);
+    }
+    /* let mktime() sort out month ends & DST */
+    tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+    tm.tm_isdst = -1;
+    sp->logstart = mktime(&tm);
+    ++tm.tm_mday;
+    tm.tm_isdst = -1;
+    sp->logend = mktime(&tm);
+    if (wxwopen(&sp->logw, str) != 0) {
+        sp->logend = 0;         /* try again next time */
+        return -1;
     }
-    if ((file = fopen(str, "a+")) == (FILE *)0) {
-        perror("wxlog - fopen");
-        return;
+    if (fwxbinary) {
+        /* same name, different suffix */
+        strcpy(&str[strlen(str) - 3], "fwb");
+        if (wxwopen(&sp->binw, str) == 0 && fstat(sp->binw.fd, &st) == 0 &&
+            st.st_size == 0) {
+            fwxbhdrinit(&hdr, sp->logstart);
+            (void)wxwrite(&sp->binw, &hdr, sizeof(hdr), t);
+        }
     }
+    return 0;
+}
 
-    s = str;            /* reuse the same buffer */
-
-    s += sprintf(s, "%d,%d,%ld,", VERSION_MAJ, VERSION_MIN, (long int)wxdp->time);
+/*
+ * the capture file rotates with the log, but on when the bytes came
+ * in rather than the sample's time
+ */
+static int
+wxcaprotate(wxstation_t *sp, time_t t)
+{
+    char str[FILENAME_MAX];
+    char name[16];
+    fwxchdr_t hdr;
+    struct stat st;
+    struct tm tm;
 
-    if (WXD_ISVALID(wxdp->barometer)) {
-        s += sprintf(s, "%.3f,", WXD_GETDAT(wxdp->barometer, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    (void)localtime_r(&t, &tm);
+    (void)strftime(name, sizeof(name), "%Y.%m.%d.fwc", &tm);
+    (void)snprintf(str, sizeof(str), "%s/%s", sp->logdir, name);
+    tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+    tm.tm_isdst = -1;
+    sp->capstart = mktime(&tm);
+    ++tm.tm_mday;
+    tm.tm_isdst = -1;
+    sp->capend = mktime(&tm);
+    if (wxwopen(&sp->capw, str) != 0) {
+        sp->capend = 0;         /* try again next time */
+        return -1;
     }
-    if (WXD_ISVALID(wxdp->windspeed)) {
-        s += sprintf(s, "%.0f,", WXD_GETDAT(wxdp->windspeed, floatd));
-        if (WXD_ISVALID(wxdp->winddir)) {
-            s += sprintf(s, "%.0f,", WXD_GETDAT(wxdp->winddir, floatd));
-        } else {
-            *s++ = ','; *s++ = '\0';
-        }
-    } else {
-        *s++ = ','; *s++ = ','; *s++ = '\0';
+    if (fstat(sp->capw.fd, &st) == 0 && st.st_size == 0) {
+        memset((void *)&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, FWXC_MAGIC, sizeof(hdr.magic));
+        hdr.bom = FWXB_BOM;
+        hdr.vermaj = FWXC_VERMAJ;
+        hdr.vermin = FWXC_VERMIN;
+        hdr.hdrsize = sizeof(fwxchdr_t);
+        hdr.recsize = sizeof(fwxcrec_t);
+        (void)wxwrite(&sp->capw, &hdr, sizeof(hdr), t);
+    }
+    return 0;
+}
+
+/*
+ * keep the len bytes of a type read that came in at us (wxschednow())
+ * just as they were, one wxwrite() so a record commits whole
+ */
+static void
+wxcapture(wxstation_t *sp, int type, const void *buf, size_t len, int64_t us)
+{
+    struct {
+        fwxcrec_t hdr;
+        unsigned char data[FWXC_MAXLEN];
+    } rec;
+    time_t t;
+
+    if (!fwxcapture || len > sizeof(rec.data)) {
+        return;
     }
-    if (WXD_ISVALID(wxdp->avgwindspeed)) {
-        s += sprintf(s, "%.0f,", WXD_GETDAT(wxdp->avgwindspeed, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    t = (time_t)(us / 1000000);
+    if ((t < sp->capstart || t >= sp->capend) && wxcaprotate(sp, t) != 0) {
+        wxstatinc(WXC_LOGFAIL);
+        return;
     }
-    if (WXD_ISVALID(wxdp->indoortemp)) {
-        s += sprintf(s, "%.1f,", WXD_GETDAT(wxdp->indoortemp, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    memset((void *)&rec.hdr, 0, sizeof(rec.hdr));
+    rec.hdr.len = (uint32_t)len;
+    rec.hdr.type = (uint16_t)type;
+    rec.hdr.us = us;
+    memcpy(rec.data, buf, len);
+    if (wxwrite(&sp->capw, &rec, sizeof(rec.hdr) + len, t) != 0) {
+        fprintf(stderr, "wxcapture - write to %s failed\n", sp->capw.path);
+        wxstatinc(WXC_LOGFAIL);
     }
-    if (WXD_ISVALID(wxdp->outdoortemp)) {
-        s += sprintf(s, "%.1f,", WXD_GETDAT(wxdp->outdoortemp, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
-    }
-    if (WXD_ISVALID(wxdp->outdoordewpoint)) {
-        s += sprintf(s, "%.1f,", WXD_GETDAT(wxdp->outdoordewpoint, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+}
+
+static void
+wxlog(wxstation_t *sp, wxdat_t *wxdp)
+{
+    char str[FILENAME_MAX];
+    fwxbrec_t rec;
+    int64_t start;
+    char *s;
+
+    wxstatinc(WXC_SAMPLES);
+    start = wxusnow();
+    if ((wxdp->time < sp->logstart || wxdp->time >= sp->logend) &&
+        wxlogrotate(sp, wxdp->time) != 0) {
+        wxstatinc(WXC_LOGFAIL);
+        return;
     }
-    if (WXD_ISVALID(wxdp->indoorhum)) {
-        s += sprintf(s, "%.0f,", WXD_GETDAT(wxdp->indoorhum, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+
+    s = str;
+
+    s = fwxbfmtfixed(s, VERSION_MAJ, 0);
+    *s++ = ',';
+    s = fwxbfmtfixed(s, VERSION_MIN, 0);
+    *s++ = ',';
+    s = fwxbfmtfixed(s, (long)wxdp->time, 0);
+    *s++ = ',';
+    s = wxschemacsv(s, wxdp);
+    *s++ = '\n';
+    if (wxwrite(&sp->logw, str, s - str, wxdp->time) != 0) {
+        fprintf(stderr, "wxlog - write to %s failed\n", sp->logw.path);
+        wxstatinc(WXC_LOGFAIL);
+    }
+    wxschemabin(wxdp, &rec);
+    if (fwxbinary && wxwrite(&sp->binw, &rec, sizeof(rec), wxdp->time) != 0) {
+        fprintf(stderr, "wxlog - write to %s failed\n", sp->binw.path);
+        wxstatinc(WXC_LOGFAIL);
+    }
+    if (fwxrollup && wxrolladd(&sp->roll, sp->logdir, &rec) != 0) {
+        wxstatinc(WXC_LOGFAIL);
+    }
+    wxstattime(WXH_LOG, wxusnow() - start);
+
+    return;
+}
+
+/*
+ * hand the sample to anyone watching the shared memory segment, then
+ * make it JSON once for the HTTP server and the publishers
+ */
+static void
+wxpublish(wxstation_t *sp, wxdat_t *wxdp)
+{
+    fwxbrec_t rec;
+    char str[2048];
+    size_t len;
+
+    if (sp->shm) {
+        wxschemabin(wxdp, &rec);
+        wxshmput(sp->shm, &rec);
     }
-    if (WXD_ISVALID(wxdp->outdoorhum)) {
-        s += sprintf(s, "%.0f,", WXD_GETDAT(wxdp->outdoorhum, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    if (!fwxhttpd && !fwxpub) {
+        return;
     }
-    if (WXD_ISVALID(wxdp->rainrate)) {
-        s += sprintf(s, "%.2f,", WXD_GETDAT(wxdp->rainrate, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    len = (size_t)(wxschemajson(str, sp->name, wxdp) - str);
+    if (fwxhttpd) {
+        wxhttpdput((int)(sp - wxstations), str, len, wxdp, &sp->hist,
+                   fwxrollup ? &sp->roll : (const wxroll_t *)0);
     }
-#ifdef NOTYET
-    if (WXD_ISVALID(wxdp->rainhour)) {
-        s += sprintf(s, "%.2f,", WXD_GETDAT(wxdp->rainhour, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    if (fwxpub) {
+        wxpubput(sp->name, str, len);
     }
-#endif /*NOTYET*/
-    if (WXD_ISVALID(wxdp->rainday)) {
-        s += sprintf(s, "%.2f,", WXD_GETDAT(wxdp->rainday, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+}
+
+/*
+ * a console whose link has gone, or never came up, is closed and
+ * opened again once its backoff is up, or its connect moved along if
+ * one's under way
+ */
+static int
+wxreconnect(wxstation_t *sp)
+{
+    time_t now;
+
+    if (sp->fd != -1) {
+        (void)close(sp->fd);
+        sp->fd = -1;
     }
-    if (WXD_ISVALID(wxdp->rainmonth)) {
-        s += sprintf(s, "%.2f,", WXD_GETDAT(wxdp->rainmonth, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    if ((now = time((time_t *)0)) < sp->retry && sp->cfd == -1) {
+        return -1;
     }
-    if (WXD_ISVALID(wxdp->rainyear)) {
-        s += sprintf(s, "%.2f,", WXD_GETDAT(wxdp->rainyear, floatd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    if (wxstationconnect(sp, now) != 0) {
+        return -1;
     }
-    if (WXD_ISVALID(wxdp->solar)) {
-        s += sprintf(s, "%d,", WXD_GETDAT(wxdp->solar, intd));
-    } else {
-        *s++ = ','; *s++ = '\0';
+    fprintf(stderr, "%s: connected to %s\n", sp->name, sp->dev);
+    return 0;
+}
+
+/*
+ * everything a sample goes to, in order of importance
+ */
+static void
+wxsample(wxstation_t *sp, wxdat_t *wxdp)
+{
+    wxdp->station = (int)(sp - wxstations);
+    wxlog(sp, wxdp);
+    wxhistadd(&sp->hist, wxdp);
+    wxpublish(sp, wxdp);
+    wxupload(wxdp);
+    if (wxdp->time - sp->state.saved >= STATESECS) {
+        wxstationsave(sp, wxdp->time, 0);
     }
+}
+
+/*
+ * write out the stats file if it's due
+ */
+static void
+wxstatpoll(time_t now)
+{
+    static time_t due;
+    unsigned long skipped;
+    int i;
 
-    (void)fprintf(file, "%s\n", str);
-    if (fclose(file) == EOF) {
-        perror("wxlog - fclose");
+    if (!*fwxstatsfile || now < due) {
         return;
     }
-
-    return;
+    due = now + (fwxstatssecs > 0 ? fwxstatssecs : 1);
+    /* these are counted where they happen, copy them in */
+    for (skipped = 0, i = 0; i < wxnstations; ++i) {
+        skipped += wxstations[i].frame.skipped;
+    }
+    wxstatset(WXC_SKIPPED, skipped);
+    pthread_mutex_lock(&wxupq.lock);
+    wxstatset(WXC_UPDROPPED, wxupq.dropped);
+    pthread_mutex_unlock(&wxupq.lock);
+    (void)wxstatdump(fwxstatsfile);
 }
 
 static void
@@ -391,7 +1262,7 @@ wxcalcdewpoint(wxdat_t *wxdp)
     temp = WXD_GETDAT(wxdp->outdoortemp, floatd);
     hum = WXD_GETDAT(wxdp->outdoorhum, floatd);
 
-    if (WXD_GETFLAGS(wxdp->outdoorhum) & WXD_ENGLISH) {
+    if (WXD_GETFLAGS(wxdp->outdoortemp) & WXD_ENGLISH) {
         units = 'F';
         /* convert to celcius */
         temp = (temp - 32.0) * 5.0 / 9.0;
@@ -418,101 +1289,234 @@ wxcalcdewpoint(wxdat_t *wxdp)
         /* convert back to farenheight */
         dewpoint = (dewpoint * 9.0) / 5.0 + 32.0;
         WXD_SETDAT(wxdp->outdoordewpoint, dewpoint, floatd);
+        WXD_SETRAW(wxdp->outdoordewpoint, (int)lrintf(dewpoint * 10));
         WXD_SETUNITS(wxdp->outdoordewpoint, "deg F");
         WXD_SETFLAGS(wxdp->outdoordewpoint, WXD_VALID|WXD_ENGLISH|1);
     } else {
         WXD_SETDAT(wxdp->outdoordewpoint, dewpoint, floatd);
+        WXD_SETRAW(wxdp->outdoordewpoint, (int)lrintf(dewpoint * 10));
         WXD_SETUNITS(wxdp->outdoordewpoint, "deg C");
         WXD_SETFLAGS(wxdp->outdoordewpoint, WXD_VALID|WXD_METRIC|1);
     }
 }
 
-static const wind_t *
-wxcalcwindgust(wind_t *wp)
-{
-    static wind_t *warr;
-    static int walen;
-    static int waidx;
-    static int tenmin;
-    int found;
-    int gust;
-    int idx;
-    int i;
-    int f;
-
-    /* first time around allocate storage and initialize "stuff" */
-    if (!walen) {
-        i = tenmin = 10 * 60 / fwxinterval + 1;
-        walen = 1;
-        do {
-            walen <<= 1;
-        } while (i >>= 1);
-        if (!(warr = malloc(walen * sizeof(wind_t)))) {
-            walen = 0;
-            return (wind_t *)0;
-        }
-        memset((void *)warr, 0, walen * sizeof(wind_t));
-    }
-    /* save new wind point */
-    memcpy(&warr[waidx], wp, sizeof(wind_t));
-    waidx = (waidx + 1) & (walen - 1);
-    /* find highest value in the last 10 minutes */
-    f = (waidx + (walen - tenmin)) & (walen - 1);
-    gust = 0;
-    for (i = 0; i < tenmin; ++i) {
-        idx = (f + i) & (walen - 1);
-        if (warr[idx].speed > gust) {
-            gust = warr[idx].speed;
-            found = idx;
-        }
-    }
-    return &warr[found];
-}
-
-#ifdef NOTYET
-static void
-wxcalcrainhour(wxdat_t *wxdatp)
+/*
+ * all the windows, and the history, are sized for the shortest
+ * interval we'll sample at, two extra slots cover a sample landing
+ * right on the edge.  They age samples out by time so they stay
+ * right as wxadapt() changes the interval.
+ */
+static int
+wxwinsize(time_t span)
 {
-    struct tm *tmp;
-    int i;
-    float in;
+    int ivl;
 
-    static struct {
-        time_t time;    /* time of sample described */
-        float inches;   /* rain inches in last 60 1-minute intervals */
-    } rainhour[60];
-    static int inited;
+    ivl = fwxintervalmin > 0 && fwxintervalmin < fwxinterval ? fwxintervalmin : fwxinterval;
+    return (int)(span / (ivl > 0 ? ivl : 1)) + 2;
+}
 
+/*
+ * the weather's busy when the wind's all over the place, it's
+ * raining hard or the pressure's moving quickly
+ */
+static int
+wxbusy(const wxstation_t *sp, const wxdat_t *wxdp)
+{
+    if (wxwincount(&sp->gustwin) > 1 &&
+        wxwinvar(&sp->gustwin) >= (long)fwxbusywind * fwxbusywind) {
+        return 1;
+    }
+    if (WXD_ISVALID(wxdp->rainrate) && WXD_GETRAW(wxdp->rainrate) >= fwxbusyrain) {
+        return 1;
+    }
+    if (WXD_ISVALID(wxdp->bartrend) && abs(WXD_GETRAW(wxdp->bartrend)) >= fwxbusybar) {
+        return 1;
+    }
+    return 0;
+}
 
-    /* initialize array first time through */
-    if (!inited) {
-        for (i = 0; i < 60; ++i) {
-            rainhour[i].time = wxdatp->time;
-            rainhour[i].inches = WXD_GETDAT(wxdatp->rainyear, floatd);
-        }
-        inited = 1;
+/*
+ * the interval to sample sp at after wxdp, sampling at interval so
+ * far.  Busy weather drops us straight to fwxintervalmin, once it's
+ * been calm for BUSYHOLD we double back up to fwxinterval a sample at
+ * a time.
+ */
+static int
+wxadapt(wxstation_t *sp, const wxdat_t *wxdp, int interval)
+{
+    if (fwxintervalmin <= 0 || fwxintervalmin >= fwxinterval) {
+        return fwxinterval;
+    }
+    if (wxbusy(sp, wxdp)) {
+        sp->busy = wxdp->time;
+        return fwxintervalmin;
     }
+    if (wxdp->time - sp->busy < BUSYHOLD) {
+        return interval;
+    }
+    return interval < fwxinterval / 2 ? interval * 2 : fwxinterval;
+}
+
+/*
+ * highest wind speed (and its direction) in the last 10 minutes
+ */
+static const wind_t *
+wxcalcwindgust(wxstation_t *sp, wind_t *wp, time_t now)
+{
+    int dir;
+
+    if (!sp->gustwin.cap &&
+        wxwininit(&sp->gustwin, GUSTSPAN, wxwinsize(GUSTSPAN))) {
+        return (wind_t *)0;
+    }
+    wxwinpush(&sp->gustwin, now, wp->speed, wp->direction);
+    sp->gust.speed = wxwinmax(&sp->gustwin, &dir);
+    sp->gust.direction = dir;
+    return &sp->gust;
+}
+
+/*
+ * rain in the last hour and last 24 hours, from the increments of the
+ * yearly total so the daily, monthly and yearly resets don't matter
+ */
+static void
+wxcalcrain(wxstation_t *sp, wxdat_t *wxdatp)
+{
+    int delta;
 
+    WXD_SETUNITS(wxdatp->rainhour, "in");
+    WXD_SETFLAGS(wxdatp->rainhour, WXD_INVALID);
+    WXD_SETUNITS(wxdatp->rain24, "in");
+    WXD_SETFLAGS(wxdatp->rain24, WXD_INVALID);
+    if (!sp->rainhourwin.cap &&
+        wxwininit(&sp->rainhourwin, RAINHOURSPAN, wxwinsize(RAINHOURSPAN))) {
+        return;
+    }
+    if (!sp->rain24win.cap &&
+        wxwininit(&sp->rain24win, RAIN24SPAN, wxwinsize(RAIN24SPAN))) {
+        return;
+    }
     /* if we don't have a valid rain reading just return */
     if (!WXD_ISVALID(wxdatp->rainyear)) {
-            WXD_SETUNITS(wxdatp->rainhour, "in");
-            WXD_SETFLAGS(wxdatp->rainhour, WXD_INVALID);
+        return;
     }
+    delta = sp->rainlast < 0 ? 0 : WXD_GETRAW(wxdatp->rainyear) - sp->rainlast;
+    if (delta < 0) {
+        delta = 0;              /* new year */
+    }
+    sp->rainlast = WXD_GETRAW(wxdatp->rainyear);
+    wxwinpush(&sp->rainhourwin, wxdatp->time, delta, 0);
+    wxwinpush(&sp->rain24win, wxdatp->time, delta, 0);
 
-    tmp = localtime(wxdatp->time);
-    i = tmp->tm_min;            /* use minutes as index */
-    in = rainhour[i];
-    rainhour[i] = WXD_GETDAT(wxdatp->rainyear, floatd);
-    WXD_SETDAT(wxdatp->rainhour, rainhour[i] - in, floatd);
-    WXD_SETFLAGS(wxdatp->rainhour, WXD_VALID|WXD_ENGLISH|1);
+    WXD_SETDAT(wxdatp->rainhour, (float)wxwinsum(&sp->rainhourwin) / 100, floatd);
+    WXD_SETRAW(wxdatp->rainhour, (int)wxwinsum(&sp->rainhourwin));
+    WXD_SETFLAGS(wxdatp->rainhour, WXD_VALID|WXD_ENGLISH|2);
+    WXD_SETDAT(wxdatp->rain24, (float)wxwinsum(&sp->rain24win) / 100, floatd);
+    WXD_SETRAW(wxdatp->rain24, (int)wxwinsum(&sp->rain24win));
+    WXD_SETFLAGS(wxdatp->rain24, WXD_VALID|WXD_ENGLISH|2);
+}
+
+/*
+ * barometric tendency, change over the last 3 hours, only valid once
+ * we've been watching for (close to) that long
+ */
+static void
+wxcalcbartrend(wxstation_t *sp, wxdat_t *wxdatp)
+{
+    const wxwinsamp_t *op;
+    int trend;
+
+    WXD_SETUNITS(wxdatp->bartrend, "in");
+    WXD_SETFLAGS(wxdatp->bartrend, WXD_INVALID);
+    if (!sp->barwin.cap &&
+        wxwininit(&sp->barwin, BARTRENDSPAN, wxwinsize(BARTRENDSPAN))) {
+        return;
+    }
+    if (!WXD_ISVALID(wxdatp->barometer)) {
+        return;
+    }
+    wxwinpush(&sp->barwin, wxdatp->time, WXD_GETRAW(wxdatp->barometer), 0);
+    op = wxwinoldest(&sp->barwin);
+    if (wxdatp->time - op->t < BARTRENDSPAN - BARTRENDSLOP) {
+        return;
+    }
+    trend = WXD_GETRAW(wxdatp->barometer) - op->v;
+    WXD_SETDAT(wxdatp->bartrend, (float)trend / 1000, floatd);
+    WXD_SETRAW(wxdatp->bartrend, trend);
+    WXD_SETFLAGS(wxdatp->bartrend, WXD_VALID|WXD_ENGLISH|3);
 }
-#endif /*NOTYET*/
 
 #define EIGHT_ONES 0xff
 #define SIXTEEN_ONES 0xffff
 
+/*
+ * what the station works out for itself in LOOP2, each field it has
+ * replaces our own gust, dewpoint or rain figure
+ */
 static void
-cvtvploop2fwx(vploopdata_t *ld, wxdat_t *wxdatp)
+cvtvploop22fwx(const vploop2data_t *l2, wxdat_t *wxdatp)
+{
+    unsigned int tmp;
+    int stmp;
+
+    if ((tmp = get_d_16(l2->windGust10)) < EIGHT_ONES) {
+        wxdatp->windgust.speed = tmp;
+        if ((tmp = get_d_16(l2->windGustDir10)) <= 360) {
+            wxdatp->windgust.direction = tmp;
+        }
+    }
+    WXD_SETUNITS(wxdatp->avgwind2, "mph");
+    tmp = get_d_16(l2->windAvg2);
+    if (tmp < 0x7fff) {
+        WXD_SETDAT(wxdatp->avgwind2, (float)tmp / 10, floatd);
+        WXD_SETRAW(wxdatp->avgwind2, tmp);
+        WXD_SETFLAGS(wxdatp->avgwind2, WXD_VALID|WXD_ENGLISH|1);
+    }
+    /*
+     * dewpoint and heat index are whole degrees, 255 when dashed, the
+     * log has always had dewpoint in tenths so it stays that way
+     */
+    WXD_SETUNITS(wxdatp->outdoordewpoint, "deg F");
+    stmp = (int16_t)get_d_16(l2->dewPoint);
+    if (stmp != EIGHT_ONES && stmp > -150 && stmp < 150) {
+        WXD_SETDAT(wxdatp->outdoordewpoint, (float)stmp, floatd);
+        WXD_SETRAW(wxdatp->outdoordewpoint, stmp * 10);
+        WXD_SETFLAGS(wxdatp->outdoordewpoint, WXD_VALID|WXD_ENGLISH|1);
+    }
+    WXD_SETUNITS(wxdatp->heatindex, "deg F");
+    stmp = (int16_t)get_d_16(l2->heatIndex);
+    if (stmp != EIGHT_ONES && stmp > -150 && stmp < 200) {
+        WXD_SETDAT(wxdatp->heatindex, (float)stmp, floatd);
+        WXD_SETRAW(wxdatp->heatindex, stmp);
+        WXD_SETFLAGS(wxdatp->heatindex, WXD_VALID|WXD_ENGLISH|0);
+    }
+    /* clicks of a 0.01" bucket */
+    WXD_SETUNITS(wxdatp->rain15, "in");
+    if ((tmp = get_d_16(l2->rain15)) != SIXTEEN_ONES) {
+        WXD_SETDAT(wxdatp->rain15, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rain15, tmp);
+        WXD_SETFLAGS(wxdatp->rain15, WXD_VALID|WXD_ENGLISH|2);
+    }
+    WXD_SETUNITS(wxdatp->rainhour, "in");
+    if ((tmp = get_d_16(l2->rainHour)) != SIXTEEN_ONES) {
+        WXD_SETDAT(wxdatp->rainhour, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rainhour, tmp);
+        WXD_SETFLAGS(wxdatp->rainhour, WXD_VALID|WXD_ENGLISH|2);
+    }
+    WXD_SETUNITS(wxdatp->rain24, "in");
+    if ((tmp = get_d_16(l2->rain24)) != SIXTEEN_ONES) {
+        WXD_SETDAT(wxdatp->rain24, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rain24, tmp);
+        WXD_SETFLAGS(wxdatp->rain24, WXD_VALID|WXD_ENGLISH|2);
+    }
+}
+
+/*
+ * l2 is the matching LOOP2 packet if we have one
+ */
+static void
+cvtvploop2fwx(wxstation_t *sp, vploopdata_t *ld, const vploop2data_t *l2,
+              wxdat_t *wxdatp)
 {
     const wind_t *wg;
     unsigned int tmp;
@@ -522,6 +1526,7 @@ cvtvploop2fwx(vploopdata_t *ld, wxdat_t *wxdatp)
     tmp = get_d_16(ld->bar);
     if (tmp != SIXTEEN_ONES) {
         WXD_SETDAT(wxdatp->barometer, (float)tmp / 1000, floatd);
+        WXD_SETRAW(wxdatp->barometer, tmp);
         WXD_SETFLAGS(wxdatp->barometer, WXD_VALID|WXD_ENGLISH|3);
     }
     if ((tmp = get_d_8(ld->windSpeed)) != EIGHT_ONES) {
@@ -533,19 +1538,22 @@ cvtvploop2fwx(vploopdata_t *ld, wxdat_t *wxdatp)
     if ((tmp = get_d_8(ld->windSpeed10)) != EIGHT_ONES) {
         wxdatp->windavg.speed = tmp;
     }
-    if ((wg = wxcalcwindgust(&wxdatp->windcur))) {
+    /* the window's kept even when LOOP2 has the gust, see wxbusy() */
+    if ((wg = wxcalcwindgust(sp, &wxdatp->windcur, wxdatp->time)) && !l2) {
         memcpy(&wxdatp->windgust, wg, sizeof(wind_t));
     }
     WXD_SETUNITS(wxdatp->windspeed, "mph");
     tmp = get_d_8(ld->windSpeed);
     if (tmp != EIGHT_ONES) {
         WXD_SETDAT(wxdatp->windspeed, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->windspeed, tmp);
         WXD_SETFLAGS(wxdatp->windspeed, WXD_VALID|WXD_ENGLISH|0);
     }
     WXD_SETUNITS(wxdatp->winddir, "deg");
     tmp = get_d_16(ld->windDir);
     if (tmp <= 360) {
         WXD_SETDAT(wxdatp->winddir, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->winddir, tmp);
         WXD_SETFLAGS(wxdatp->winddir, WXD_VALID|0);
     }
     WXD_SETUNITS(wxdatp->avgwindspeed, "mph");
@@ -553,380 +1561,1000 @@ cvtvploop2fwx(vploopdata_t *ld, wxdat_t *wxdatp)
     tmp = get_d_8(ld->windSpeed10);
     if (tmp != EIGHT_ONES) {
         WXD_SETDAT(wxdatp->avgwindspeed, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->avgwindspeed, tmp);
         WXD_SETFLAGS(wxdatp->avgwindspeed, WXD_VALID|WXD_ENGLISH|0);
         WXD_SETDAT(wxdatp->avgwindspeedinterval, (float)10, floatd);
+        WXD_SETRAW(wxdatp->avgwindspeedinterval, 10);
         WXD_SETFLAGS(wxdatp->avgwindspeedinterval, WXD_VALID|0);
     }
     WXD_SETUNITS(wxdatp->indoortemp, "deg F");
     stmp = get_d_16(ld->tempIn);
     if (stmp != 0x1000 && stmp > -1500 && stmp < 1500) {
         WXD_SETDAT(wxdatp->indoortemp, (float)stmp / 10, floatd);
+        WXD_SETRAW(wxdatp->indoortemp, stmp);
         WXD_SETFLAGS(wxdatp->indoortemp, WXD_VALID|WXD_ENGLISH|1);
     }
     WXD_SETUNITS(wxdatp->outdoortemp, "deg F");
     stmp = get_d_16(ld->tempOut);
     if (stmp != 0x1000 && stmp > -1500 && stmp < 1500) {
         WXD_SETDAT(wxdatp->outdoortemp, (float)stmp / 10, floatd);
+        WXD_SETRAW(wxdatp->outdoortemp, stmp);
         WXD_SETFLAGS(wxdatp->outdoortemp, WXD_VALID|WXD_ENGLISH|1);
     }
     WXD_SETUNITS(wxdatp->indoorhum, "%");
     tmp = get_d_8(ld->humIn);
     if (tmp != EIGHT_ONES && tmp <= 100) {
         WXD_SETDAT(wxdatp->indoorhum, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->indoorhum, tmp);
         WXD_SETFLAGS(wxdatp->indoorhum, WXD_VALID|0);
     }
     WXD_SETUNITS(wxdatp->outdoorhum, "%");
     tmp = get_d_8(ld->humOut);
     if (tmp != EIGHT_ONES && tmp <= 100) {
         WXD_SETDAT(wxdatp->outdoorhum, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->outdoorhum, tmp);
         WXD_SETFLAGS(wxdatp->outdoorhum, WXD_VALID|0);
     }
     WXD_SETUNITS(wxdatp->rainrate, "in/hr");
     tmp = get_d_16(ld->rainRate);
     if (tmp != SIXTEEN_ONES) {
         WXD_SETDAT(wxdatp->rainrate, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rainrate, tmp);
         WXD_SETFLAGS(wxdatp->rainrate, WXD_VALID|WXD_ENGLISH|2);
     }
     WXD_SETUNITS(wxdatp->solar, "w/m2");
     tmp = get_d_16(ld->solarRad);
     if (tmp != SIXTEEN_ONES) {
         WXD_SETDAT(wxdatp->solar, tmp, intd);
+        WXD_SETRAW(wxdatp->solar, tmp);
         /* w/m2 sounds metric... */
-        WXD_SETFLAGS(wxdatp->solar, WXD_VALID|WXD_METRIC|2);
+        WXD_SETFLAGS(wxdatp->solar, WXD_VALID|WXD_METRIC|0);
     }
     WXD_SETUNITS(wxdatp->rainday, "in");
     tmp =  get_d_16(ld->rainDay);
     if (tmp != SIXTEEN_ONES) {
         WXD_SETDAT(wxdatp->rainday, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rainday, tmp);
         WXD_SETFLAGS(wxdatp->rainday, WXD_VALID|WXD_ENGLISH|2);
     }
     WXD_SETUNITS(wxdatp->rainmonth, "in");
     tmp = get_d_16(ld->rainMonth);
     if (tmp != SIXTEEN_ONES) {
         WXD_SETDAT(wxdatp->rainmonth, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rainmonth, tmp);
         WXD_SETFLAGS(wxdatp->rainmonth, WXD_VALID|WXD_ENGLISH|2);
     }
     WXD_SETUNITS(wxdatp->rainyear, "in");
     tmp = get_d_16(ld->rainYear);
     if (tmp != SIXTEEN_ONES) {
         WXD_SETDAT(wxdatp->rainyear, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rainyear, tmp);
         WXD_SETFLAGS(wxdatp->rainyear, WXD_VALID|WXD_ENGLISH|2);
     }
+    /*
+     * our own figures always, so the rain windows and rainlast stay
+     * current for when LOOP2 goes missing, then whatever LOOP2 has
+     */
     wxcalcdewpoint(wxdatp);     /* figure out dewpoint */
-#ifdef NOTYET
-    wxcalcrainhour(wxdatp);     /* figure out rain in last 60 minutes */
-#endif /*NOTYET*/
+    wxcalcrain(sp, wxdatp);     /* figure out rain in last hour and day */
+    if (l2) {
+        cvtvploop22fwx(l2, wxdatp);
+    }
+    wxcalcbartrend(sp, wxdatp); /* and where the pressure's headed */
 
     return;
 }
 
+/*
+ * an archive record covers the whole archive interval, the averages
+ * stand in for the instantaneous values and the highs for the rates,
+ * running totals aren't in there at all
+ */
 static void
-wxgetloop(int fd, wxdat_t *wxdatp)
+cvtvparch2fwx(const vparchive_t *ap, wxdat_t *wxdatp)
 {
-    vploopdata_t ld;
-    int i;
-    int rc;
+    unsigned int tmp;
+    int stmp;
 
-    for (i = 0; i < 4; ++i) {
+    WXD_SETUNITS(wxdatp->barometer, "in");
+    tmp = get_d_16(ap->bar);
+    if (tmp != 0 && tmp != SIXTEEN_ONES) {
+        WXD_SETDAT(wxdatp->barometer, (float)tmp / 1000, floatd);
+        WXD_SETRAW(wxdatp->barometer, tmp);
+        WXD_SETFLAGS(wxdatp->barometer, WXD_VALID|WXD_ENGLISH|3);
+    }
+    WXD_SETUNITS(wxdatp->windspeed, "mph");
+    WXD_SETUNITS(wxdatp->avgwindspeed, "mph");
+    tmp = get_d_8(ap->windSpeed);
+    if (tmp != EIGHT_ONES) {
+        wxdatp->windcur.speed = wxdatp->windavg.speed = tmp;
+        WXD_SETDAT(wxdatp->windspeed, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->windspeed, tmp);
+        WXD_SETFLAGS(wxdatp->windspeed, WXD_VALID|WXD_ENGLISH|0);
+        WXD_SETDAT(wxdatp->avgwindspeed, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->avgwindspeed, tmp);
+        WXD_SETFLAGS(wxdatp->avgwindspeed, WXD_VALID|WXD_ENGLISH|0);
+    }
+    if ((tmp = get_d_8(ap->windSpeedHi)) != EIGHT_ONES) {
+        wxdatp->windgust.speed = tmp;
+    }
+    /* 16 points of the compass, north is 360 like the LOOP packet */
+    WXD_SETUNITS(wxdatp->winddir, "deg");
+    tmp = get_d_8(ap->windDir);
+    if (tmp < 16) {
+        tmp = tmp ? (tmp * 45 + 1) / 2 : 360;
+        wxdatp->windcur.direction = tmp;
+        WXD_SETDAT(wxdatp->winddir, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->winddir, tmp);
+        WXD_SETFLAGS(wxdatp->winddir, WXD_VALID|0);
+    }
+    WXD_SETUNITS(wxdatp->indoortemp, "deg F");
+    stmp = (int16_t)get_d_16(ap->tempIn);
+    if (stmp > -1500 && stmp < 1500) {
+        WXD_SETDAT(wxdatp->indoortemp, (float)stmp / 10, floatd);
+        WXD_SETRAW(wxdatp->indoortemp, stmp);
+        WXD_SETFLAGS(wxdatp->indoortemp, WXD_VALID|WXD_ENGLISH|1);
+    }
+    WXD_SETUNITS(wxdatp->outdoortemp, "deg F");
+    stmp = (int16_t)get_d_16(ap->tempOut);
+    if (stmp > -1500 && stmp < 1500) {
+        WXD_SETDAT(wxdatp->outdoortemp, (float)stmp / 10, floatd);
+        WXD_SETRAW(wxdatp->outdoortemp, stmp);
+        WXD_SETFLAGS(wxdatp->outdoortemp, WXD_VALID|WXD_ENGLISH|1);
+    }
+    WXD_SETUNITS(wxdatp->indoorhum, "%");
+    tmp = get_d_8(ap->humIn);
+    if (tmp <= 100) {
+        WXD_SETDAT(wxdatp->indoorhum, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->indoorhum, tmp);
+        WXD_SETFLAGS(wxdatp->indoorhum, WXD_VALID|0);
+    }
+    WXD_SETUNITS(wxdatp->outdoorhum, "%");
+    tmp = get_d_8(ap->humOut);
+    if (tmp <= 100) {
+        WXD_SETDAT(wxdatp->outdoorhum, (float)tmp, floatd);
+        WXD_SETRAW(wxdatp->outdoorhum, tmp);
+        WXD_SETFLAGS(wxdatp->outdoorhum, WXD_VALID|0);
+    }
+    /* clicks of a 0.01" bucket */
+    WXD_SETUNITS(wxdatp->rainrate, "in/hr");
+    tmp = get_d_16(ap->rainRateHi);
+    if (tmp != SIXTEEN_ONES) {
+        WXD_SETDAT(wxdatp->rainrate, (float)tmp / 100, floatd);
+        WXD_SETRAW(wxdatp->rainrate, tmp);
+        WXD_SETFLAGS(wxdatp->rainrate, WXD_VALID|WXD_ENGLISH|2);
+    }
+    WXD_SETUNITS(wxdatp->solar, "w/m2");
+    tmp = get_d_16(ap->solarRad);
+    if (tmp != SIXTEEN_ONES && tmp != 0x7fff) {
+        WXD_SETDAT(wxdatp->solar, tmp, intd);
+        WXD_SETRAW(wxdatp->solar, tmp);
+        WXD_SETFLAGS(wxdatp->solar, WXD_VALID|WXD_METRIC|0);
+    }
+    wxcalcdewpoint(wxdatp);
+}
+
+/*
+ * wxdmpaft() calls this for each archive record we hadn't logged,
+ * they go in the log & history but are too stale to upload
+ */
+static void
+wxbackfill(const vparchive_t *ap, time_t t, void *arg)
+{
+    wxstation_t *sp;
+    wxdat_t wxdat;
+
+    sp = (wxstation_t *)arg;
+    wxcapture(sp, FWXC_ARCHIVE, ap, sizeof(vparchive_t), wxschednow());
+    memset((void *)&wxdat, 0, sizeof(wxdat_t));
+    wxdat.time = t;
+    wxdat.station = (int)(sp - wxstations);
+    cvtvparch2fwx(ap, &wxdat);
+    wxlog(sp, &wxdat);
+    wxhistadd(&sp->hist, &wxdat);
+}
+
+/*
+ * the LOOP, or LOOP and LOOP2, packets in len bytes of buf into *ldp
+ * & *l2p, returns which were good as WXGOT bits
+ */
+static int
+wxloopsplit(unsigned char *buf, size_t len, vploopdata_t *ldp, vploop2data_t *l2p)
+{
+    unsigned char *p;
+    int got;
+
+    got = 0;
+    for (p = buf; p < &buf[len]; p += VPLOOPSIZE) {
+        if (!wxcrc(p, VPLOOPSIZE)) {
+            fprintf(stderr, "wxgetloop - got bogus crc\n");
+            wxstatinc(WXC_CRCERR);
 #ifdef DEBUG_WXLOOP
-        fprintf(stdout, "wxgetloop - wakeup attempt %d\n", i);
+            dumpbuf(stdout, p, VPLOOPSIZE);
 #endif /*DEBUG_WXLOOP*/
-        if (wxwakeup(fd) == 0) {
-            break;
+            continue;
+        }
+        if (((vploopdata_t *)p)->type == VPLOOP2TYPE) {
+            memcpy((void *)l2p, p, VPLOOPSIZE);
+            got |= WXGOTLOOP2;
+        } else {
+            memcpy((void *)ldp, p, VPLOOPSIZE);
+            got |= WXGOTLOOP;
         }
     }
+    return got;
+}
 
-    if (wxcmd(fd, VPLOOPCMD) != 0) {
-        return;
+/*
+ * one LOOP packet, or with LPS a LOOP and a LOOP2, into *ldp & *l2p,
+ * returns what arrived as WXGOT bits and when in sp->ldrx
+ */
+static int
+wxgetloopcmd(wxstation_t *sp, int lps, vploopdata_t *ldp, vploop2data_t *l2p)
+{
+    unsigned char buf[2 * VPLOOPSIZE];
+    int64_t start;
+    size_t want;
+    int rc;
+
+    if (wxcmd(sp->fd, lps ? VPLPSCMD : VPLOOPCMD) != 0) {
+        return 0;
     }
 
-    if ((rc = wxread(fd, (void *)&ld, sizeof(vploopdata_t), 10)) == -1) {
+    want = lps ? 2 * VPLOOPSIZE : VPLOOPSIZE;
+    start = wxusnow();
+    if ((rc = wxread(sp->fd, (void *)buf, want, 10 * 1000)) == -1) {
         fprintf(stderr, "wxgetloop() wxread failed\n");
-        return;
+        return 0;
+    }
+    sp->ldrx = wxschednow();
+    if (rc > 0) {
+        wxcapture(sp, FWXC_LOOP, buf, (size_t)rc, sp->ldrx);
     }
 
-    if (rc != sizeof(vploopdata_t)) {
-        fprintf(stderr, "wxgetloop - got %d bytes, expected %zu\n",
-                rc, sizeof(vploopdata_t));
+    if (rc != (int)want) {
+        fprintf(stderr, "wxgetloop - got %d bytes, expected %zu\n", rc, want);
 #ifdef DEBUG_WXLOOP
-        dumpbuf(stdout, (unsigned char *)&ld, rc);
+        dumpbuf(stdout, buf, rc);
 #endif /*DEBUG_WXLOOP*/
-        return;
+        return 0;
     }
+    wxstattime(WXH_LOOP, wxusnow() - start);
+
+    return wxloopsplit(buf, want, ldp, l2p);
+}
+
+static int
+wxgetloop(wxstation_t *sp, wxdat_t *wxdatp)
+{
+    vploop2data_t l2;
+    vploopdata_t ld;
+    int got;
+    int i;
 
-    if (wxcrc((unsigned char *)&ld + 1, rc) != 0) {
-        fprintf(stderr, "wxgetloop - got bogus crc\n");
+    for (i = 0; i < 4; ++i) {
 #ifdef DEBUG_WXLOOP
-        dumpbuf(stdout, (unsigned char *)&ld, rc);
+        fprintf(stdout, "wxgetloop - wakeup attempt %d\n", i);
 #endif /*DEBUG_WXLOOP*/
-        return;
+        if (wxwakeup(sp->fd) == 0) {
+            break;
+        }
+    }
+
+    got = wxgetloopcmd(sp, sp->loop2, &ld, &l2);
+    if (sp->loop2 && !got && (got = wxgetloopcmd(sp, 0, &ld, &l2))) {
+        /* LOOP works when LPS doesn't, it's older firmware */
+        fprintf(stderr, "wxgetloop - %s doesn't do LPS, using LOOP\n", sp->name);
+        sp->loop2 = 0;
+    }
+    if (!(got & WXGOTLOOP)) {
+        return -1;
+    }
+    wxdatp->time = (time_t)(sp->ldrx / 1000000);  /* when it came in, not when we asked */
+
+    cvtvploop2fwx(sp, &ld, got & WXGOTLOOP2 ? &l2 : (vploop2data_t *)0, wxdatp);
+    return 0;
+}
+
+static int
+wxstreamarm(wxstation_t *sp)
+{
+    char cmd[16];
+    int i;
+
+    sp->loopleft = 0;
+    if (sp->fd == -1) {
+        return -1;              /* waiting to reconnect */
+    }
+    for (i = 0; i < 4; ++i) {
+#ifdef DEBUG_WXLOOP
+        fprintf(stdout, "wxstreamarm - wakeup attempt %d\n", i);
+#endif /*DEBUG_WXLOOP*/
+        if (wxwakeup(sp->fd) == 0) {
+            break;
+        }
     }
 
-    cvtvploop2fwx(&ld, wxdatp);
+    (void)snprintf(cmd, sizeof(cmd), sp->loop2 ? VPLPSNCMD : VPLOOPNCMD,
+                   VPLOOPSTREAMCNT);
+    wxframereset(&sp->frame);
+    if (wxcmd(sp->fd, cmd) != 0) {
+        if (!sp->loop2) {
+            return -1;
+        }
+        (void)snprintf(cmd, sizeof(cmd), VPLOOPNCMD, VPLOOPSTREAMCNT);
+        if (wxcmd(sp->fd, cmd) != 0) {
+            return -1;
+        }
+        /* LOOP works when LPS doesn't, it's older firmware */
+        fprintf(stderr, "wxstreamarm - %s doesn't do LPS, using LOOP\n", sp->name);
+        sp->loop2 = 0;
+    }
+    sp->loopleft = VPLOOPSTREAMCNT;
+    sp->looprx = time((time_t *)0);
+    sp->loopgood = wxusnow();
+    return 0;
 }
 
 /*
- * https://feedback.weather.com/customer/en/portal/articles/2924682-pws-upload-protocol?b_id=17298
+ * bytes are fed through the frame parser so a dropped or duplicated
+ * byte costs one packet rather than sync.  LOOP2 packets look the
+ * same to the parser and are told apart by their type.  rx is when
+ * the bytes came in (wxschednow()).
  */
 static void
-wxsendwu(wxdat_t *wxdp)
+wxstreamframes(wxstation_t *sp, const void *buf, size_t len, int64_t rx)
 {
-    struct tm *tm;
-    char str[2048];
-    char *s;
+    vploopdata_t frame;
+    int rc;
 
-    if (!*wustation || !*wupassword) {
-        /* if we have no station or password we just log to our CSV file */
-        return;
+    sp->looprx = (time_t)(rx / 1000000);
+    wxframeput(&sp->frame, buf, len);
+    while ((rc = wxframeget(&sp->frame, (void *)&frame)) != WXFRAMENEED) {
+        --sp->loopleft;
+        if (rc == WXFRAMEGOOD) {
+            if (frame.type == VPLOOP2TYPE) {
+                memcpy((void *)&sp->l2, &frame, VPLOOPSIZE);
+                sp->l2time = sp->looprx;
+            } else {
+                memcpy((void *)&sp->ld, &frame, VPLOOPSIZE);
+                sp->ldtime = sp->looprx;
+                sp->ldrx = rx;
+            }
+            wxstattime(WXH_LOOP, wxusnow() - sp->loopgood);
+            sp->loopgood = wxusnow();
+        } else {
+            fprintf(stderr, "wxstream - got bogus crc from %s, resyncing\n",
+                    sp->name);
+            wxstatinc(WXC_CRCERR);
+        }
     }
-    s = stpcpy(str, "/usr/bin/fetch -q -a -T 3 -o /dev/null 'http://rtupdate.wunderground.com/weatherstation/updateweatherstation.php?action=updateraw&realtime=1");
-    s += sprintf(s, "&rtfreq=%d", fwxinterval);
-    s += sprintf(s, "&ID=%s&PASSWORD=%s", wustation, wupassword);
-    s = stpcpy(s, "&dateutc=");
-    tm = gmtime(&wxdp->time);
-    s += strftime(s, 32, "%Y-%m-%d%%20%H%%3A%M%%3A%S", tm);
-    s += sprintf(s, "&softwaretype=fwx%%20v%d.%d", VERSION_MAJ, VERSION_MIN);
-    s += sprintf(s, "&windspeedmph=%d", wxdp->windcur.speed);
-    if (wxdp->windcur.speed != 0) {
-        s += sprintf(s, "&winddir=%d", wxdp->windcur.direction);
+}
+
+/*
+ * take only what's there so we never wait on a partial frame
+ */
+static void
+wxstreamread(wxstation_t *sp)
+{
+    unsigned char buf[VPLOOPSIZE * 2];
+    int64_t rx;
+    int rc;
+
+    if ((rc = wxreadsome(sp->fd, (void *)buf, sizeof(buf), 0)) == -1) {
+        fprintf(stderr, "wxstream - wxreadsome failed on %s\n", sp->name);
+        sp->loopleft = 0;
+        (void)wxreconnect(sp);
+        return;
     }
-    s += sprintf(s, "&windgustmph=%d", wxdp->windgust.speed);
-    if (wxdp->windgust.speed != 0) {
-        s += sprintf(s, "&windgustdir=%d", wxdp->windgust.direction);
+    if (rc == 0) {
+        return;
     }
-    if (WXD_ISVALID(wxdp->outdoortemp)) {
-        s += sprintf(s, "&tempf=%.1f", WXD_GETDAT(wxdp->outdoortemp, floatd));
+    rx = wxschednow();
+    wxcapture(sp, FWXC_STREAM, buf, (size_t)rc, rx);
+    wxstreamframes(sp, buf, (size_t)rc, rx);
+}
+
+/*
+ * one LOOP command per station feeds us packets as fast as they make
+ * them, serial or network alike, a single poll() waits on all of them.
+ * Each station's sample is the first LOOP to come in on or after an
+ * fwxinterval boundary, stamped with when it arrived.  One that hasn't
+ * shown up VPLOOPSTALE seconds past the boundary is logged as no data.
+ * The LOOP command is re-armed when it runs out or the station goes
+ * quiet, a station that won't start isn't retried 'til its next sample
+ * is due.
+ */
+static void
+wxstream(void)
+{
+    struct pollfd pfd[WXMAXSTATIONS];
+    wxstation_t *sp;
+    wxdat_t wxdat;
+    int64_t due;
+    int64_t now;
+    int64_t at;
+    int i;
+
+    for (sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+        wxframeinit(&sp->frame);
+        wxschedinit(&sp->sched, fwxinterval);
+    }
+    while (!fwxdone) {
+        now = wxschednow();
+        due = now + VPLOOPSTALE * 1000000;      /* we'll rearm if this times out */
+        for (i = 0; i < wxnstations; ++i) {
+            sp = &wxstations[i];
+            if ((sp->loopleft <= 0 || now / 1000000 - sp->looprx > VPLOOPSTALE) &&
+                now / 1000000 >= sp->rearm && wxstreamarm(sp) != 0) {
+                if (sp->fd != -1) {
+                    fprintf(stderr, "wxstream - failed to start LOOP on %s\n", sp->name);
+                }
+                sp->rearm = sp->sched.next;
+                if ((sp->fd == -1 || wxlinkdown(sp->fd)) && wxreconnect(sp) == 0) {
+                    sp->rearm = now / 1000000;
+                }
+            }
+            /* past the boundary we're waiting on a packet or for it to go stale */
+            at = (int64_t)sp->sched.next * 1000000;
+            if (now >= at) {
+                at += VPLOOPSTALE * 1000000;
+            }
+            if (at < due) {
+                due = at;
+            }
+            /* a connect under way says it's done by being writable */
+            pfd[i].fd = sp->cfd != -1 ? sp->cfd : sp->loopleft > 0 ? sp->fd : -1;
+            pfd[i].events = sp->cfd != -1 ? POLLOUT : POLLIN;
+            pfd[i].revents = 0;
+        }
+
+        /* sleep 'til a station talks or a sample is due */
+        due = (due - wxschednow() + 999) / 1000;
+        if (poll(pfd, (nfds_t)wxnstations, due > 0 ? (int)due : 0) == -1 &&
+            errno != EINTR) {
+            perror("wxstream - poll");
+            (void)poll((struct pollfd *)0, 0, 1000);
+        }
+        for (i = 0; i < wxnstations; ++i) {
+            sp = &wxstations[i];
+            if (pfd[i].revents && sp->cfd != -1) {
+                if (wxreconnect(sp) == 0) {
+                    sp->rearm = 0;
+                }
+            } else if (pfd[i].revents) {
+                wxstreamread(sp);
+            }
+            wxstationtick(&wxstations[i], time((time_t *)0));
+        }
+
+        for (sp = wxstations; sp < &wxstations[wxnstations]; ++sp) {
+            now = wxschednow();
+            at = (int64_t)sp->sched.next * 1000000;
+            if (now < at) {
+                continue;
+            }
+            memset((void *)&wxdat, 0, sizeof(wxdat_t));
+            if (sp->ldrx >= at) {
+                wxdat.time = (time_t)(sp->ldrx / 1000000);
+                cvtvploop2fwx(sp, &sp->ld, wxdat.time - sp->l2time <= VPLOOPSTALE ?
+                              &sp->l2 : (vploop2data_t *)0, &wxdat);
+                wxschedtick(&sp->sched, sp->ldrx);
+            } else if (now >= at + VPLOOPSTALE * 1000000) {
+                wxdat.time = sp->sched.next;
+                wxstatinc(WXC_NODATA);
+                wxschedtick(&sp->sched, now);
+            } else {
+                continue;       /* the packet should be on its way */
+            }
+            wxsample(sp, &wxdat);
+            wxschedset(&sp->sched, wxadapt(sp, &wxdat, sp->sched.interval));
+        }
+        wxstatpoll(time((time_t *)0));
     }
-    if (WXD_ISVALID(wxdp->rainrate)) {
-        s += sprintf(s, "&rainin=%.2f", WXD_GETDAT(wxdp->rainrate, floatd));
+}
+
+/*
+ * open a capture and check it's one we can read, see fwxcap.h
+ */
+static FILE *
+wxcapopen(const char *path)
+{
+    fwxchdr_t hdr;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == (FILE *)0) {
+        perror(path);
+        return (FILE *)0;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, FWXC_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.bom != FWXB_BOM || hdr.vermaj != FWXC_VERMAJ ||
+        hdr.hdrsize < sizeof(fwxchdr_t) || hdr.recsize != sizeof(fwxcrec_t) ||
+        fseek(fp, (long)hdr.hdrsize, SEEK_SET) != 0) {
+        fprintf(stderr, "wxcapopen - %s isn't a capture this fwx can read\n", path);
+        fclose(fp);
+        return (FILE *)0;
     }
-    if (WXD_ISVALID(wxdp->rainday)) {
-        s += sprintf(s, "&dailyrainin=%.2f", WXD_GETDAT(wxdp->rainday, floatd));
+    return fp;
+}
+
+/*
+ * the next record of a capture into *rp and its bytes into buf, which
+ * has room for FWXC_MAXLEN.  Returns 1, 0 at the end, or -1 if the
+ * record's cut short.  A partial header is where fwx stopped writing
+ * and counts as the end.
+ */
+static int
+wxcapread(FILE *fp, fwxcrec_t *rp, void *buf)
+{
+    if (fread(rp, sizeof(fwxcrec_t), 1, fp) != 1) {
+        return 0;
     }
-    if (WXD_ISVALID(wxdp->barometer)) {
-        s += sprintf(s, "&baromin=%.3f", WXD_GETDAT(wxdp->barometer, floatd));
+    if (rp->len > FWXC_MAXLEN || fread(buf, 1, rp->len, fp) != rp->len) {
+        fprintf(stderr, "wxcapread - capture cut short\n");
+        return -1;
     }
-    if (WXD_ISVALID(wxdp->outdoorhum)) {
-        s += sprintf(s, "&humidity=%.0f", WXD_GETDAT(wxdp->outdoorhum, floatd));
+    return 1;
+}
+
+/*
+ * a replay's log directory must not already have logs or rollups for
+ * any day the capture covers, they'd be added to rather than remade
+ */
+static int
+wxreplaycheck(const char *path, const char *logdir)
+{
+    static const char *suffixes[] = { "fwx", "fwb", "fwp", "fwm" };
+    unsigned char buf[FWXC_MAXLEN];
+    char file[FILENAME_MAX];
+    char day[16];
+    char last[16];
+    fwxcrec_t rec;
+    struct stat st;
+    struct tm tm;
+    FILE *fp;
+    time_t t;
+    size_t i;
+    int rc;
+
+    if (stat(logdir, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "%s is not a directory\n", logdir);
+        return -1;
     }
-    if (WXD_ISVALID(wxdp->outdoordewpoint)) {
-        s += sprintf(s, "&dewptf=%.1f", WXD_GETDAT(wxdp->outdoordewpoint, floatd));
+    if ((fp = wxcapopen(path)) == (FILE *)0) {
+        return -1;
     }
-    if (WXD_ISVALID(wxdp->solar)) {
-        s += sprintf(s, "&solarradiation=%d", WXD_GETDAT(wxdp->solar, intd));
+    last[0] = '\0';
+    while ((rc = wxcapread(fp, &rec, buf)) == 1) {
+        if (rec.type == FWXC_ARCHIVE && rec.len == sizeof(vparchive_t)) {
+            t = wxarchtime((const vparchive_t *)buf);
+        } else {
+            t = (time_t)(rec.us / 1000000);
+        }
+        (void)localtime_r(&t, &tm);
+        (void)strftime(day, sizeof(day), "%Y.%m.%d", &tm);
+        if (strcmp(day, last) == 0) {
+            continue;
+        }
+        strcpy(last, day);
+        for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+            (void)snprintf(file, sizeof(file), "%s/%s.%s", logdir, day, suffixes[i]);
+            if (stat(file, &st) == 0) {
+                fprintf(stderr, "wxreplay - %s is already there, replay into a directory of its own\n",
+                        file);
+                fclose(fp);
+                return -1;
+            }
+        }
     }
-    *s++ = '\''; *s = '\0';
-    (void)system(str);
+    fclose(fp);
+    return rc == -1 ? -1 : 0;
 }
 
-static void
-waitforsrv(int s)
+/*
+ * -R, play a capture back into the first station through the same
+ * frame parser, decoding and sinks the live bytes went through, flat
+ * out or paced as they came in.  Samples are taken the way wxstream()
+ * and the polling loop take them but on the capture's clock, so what's
+ * logged is what was logged while capturing.  A stream that went
+ * quiet is logged as no data again, a poll that got nothing wasn't
+ * captured and isn't.
+ */
+static int
+wxreplay(const char *path, int paced)
 {
-    fd_set rfds;
+    unsigned char buf[FWXC_MAXLEN];
+    vploop2data_t l2;
+    vploopdata_t ld;
+    fwxcrec_t rec;
+    wxstation_t *sp;
+    wxdat_t wxdat;
+    int64_t base;
+    int64_t wait;
+    time_t next;
+    long nrec;
+    long nsamp;
+    FILE *fp;
+    int ivl;
+    int got;
     int rc;
-    char str[512];
-
-    FD_ZERO(&rfds);
-    FD_SET(s, &rfds);
-    switch (rc = select(s + 1, &rfds, (fd_set *)0, (fd_set *)0, (struct timeval *)0)) {
-    case 0:
-	printf("select returned %d???\n", rc);
-	break;
-    case -1:
-	perror("select");
-	break;
-    case 1:
-	rc = read(s, str, sizeof(str));
-#ifdef DEBUG_CWOP
-        str[rc] = '\0';
-	printf("got \"%s\"\n", str);
-#endif /*DEBUG_CWOP*/
-	break;
-    default:
-	printf("select returned %d???\n", rc);
-	break;
+
+    if ((fp = wxcapopen(path)) == (FILE *)0) {
+        return -1;
     }
+    sp = &wxstations[0];
+    wxframeinit(&sp->frame);
+    ivl = fwxinterval;
+    next = 0;
+    base = 0;
+    nrec = nsamp = 0;
+    rc = 0;
+    while (!fwxdone && (rc = wxcapread(fp, &rec, buf)) == 1) {
+        if (paced) {
+            if (nrec == 0) {
+                base = wxschednow() - rec.us;
+            }
+            if ((wait = (rec.us + base - wxschednow()) / 1000) > 0) {
+                (void)poll((struct pollfd *)0, 0, (int)wait);
+            }
+        }
+        ++nrec;
+        switch (rec.type) {
+        case FWXC_STREAM:
+            if (!next) {
+                next = (time_t)(rec.us / 1000000 / ivl + 1) * ivl;
+            }
+            /* wxstream() gave up waiting for these */
+            while (rec.us >= ((int64_t)next + VPLOOPSTALE) * 1000000) {
+                memset((void *)&wxdat, 0, sizeof(wxdat_t));
+                wxdat.time = next;
+                wxstatinc(WXC_NODATA);
+                wxsample(sp, &wxdat);
+                ivl = wxadapt(sp, &wxdat, ivl);
+                next = ((next + VPLOOPSTALE) / ivl + 1) * ivl;
+                ++nsamp;
+            }
+            wxstreamframes(sp, buf, rec.len, rec.us);
+            if (sp->ldrx < (int64_t)next * 1000000) {
+                break;
+            }
+            memset((void *)&wxdat, 0, sizeof(wxdat_t));
+            wxdat.time = (time_t)(sp->ldrx / 1000000);
+            cvtvploop2fwx(sp, &sp->ld, wxdat.time - sp->l2time <= VPLOOPSTALE ?
+                          &sp->l2 : (vploop2data_t *)0, &wxdat);
+            wxsample(sp, &wxdat);
+            ivl = wxadapt(sp, &wxdat, ivl);
+            next = (wxdat.time / ivl + 1) * ivl;
+            ++nsamp;
+            break;
+        case FWXC_LOOP:
+            /* a short read was thrown away as it came in */
+            if (rec.len % VPLOOPSIZE != 0 ||
+                !((got = wxloopsplit(buf, rec.len, &ld, &l2)) & WXGOTLOOP)) {
+                break;
+            }
+            memset((void *)&wxdat, 0, sizeof(wxdat_t));
+            wxdat.time = (time_t)(rec.us / 1000000);
+            cvtvploop2fwx(sp, &ld, got & WXGOTLOOP2 ? &l2 : (vploop2data_t *)0, &wxdat);
+            wxsample(sp, &wxdat);
+            ++nsamp;
+            break;
+        case FWXC_ARCHIVE:
+            if (rec.len == sizeof(vparchive_t)) {
+                wxbackfill((const vparchive_t *)buf, wxarchtime((const vparchive_t *)buf),
+                           (void *)sp);
+                ++nsamp;
+            }
+            break;
+        default:
+            break;              /* from a newer fwx */
+        }
+        wxstatpoll(time((time_t *)0));
+    }
+    fclose(fp);
+    fprintf(stderr, "%s: replayed %ld records, %ld samples\n", path, nrec, nsamp);
+    return rc == -1 ? -1 : 0;
 }
 
 /*
- * http://www.wxqa.com/faq.html
+ * live samples go out first.  A service that's failing is left alone
+ * for a while, backing off each time, and what it misses meanwhile is
+ * spooled without waiting on the network.  Once it answers again the
+ * backlog follows the live sample, a batch at a time and only while
+ * no newer sample is waiting.
  */
 static void
-wxsendcwop(wxdat_t *wxdp)
+wxsendspool(wxspool_t *qp, int (*post)(wxdat_t *), wxdat_t *wxdp)
 {
-    static time_t lasthere;
+    wxdat_t old;
     time_t now;
-    struct sockaddr_in sin;
-    struct hostent *hep;
-    struct tm *tm;
-    int tmp;
-    int s;
-    int len;
-    char str[256];
-    char *sp;
+    int n;
 
-    if (!*cwopsvr || !*cwopuser || !*cwoploc) {
-        /* don't bother if we don't have the server, login, and location */ 
-#ifdef DEBUG_CWOP
-        printf("not logging to CWOP svr: %s user: %s location: %s\n",
-               cwopsvr, cwopuser, cwoploc);
-#endif
-        return;
-    }
     now = time((time_t *)0);
-    if (now - lasthere < 5 * 60) {
-        /* don't do this more than every 5 minutes */
-        return;
+    if (now >= qp->retry && post(wxdp) == 0) {
+        qp->backoff = 0;
+        for (n = 0; n < SPOOLBATCH && !wxqpending(&wxupq); ++n) {
+            if (wxspoolpeek(qp, &old) != 1) {
+                return;
+            }
+            old.station = wxdp->station;
+            if (post(&old) != 0) {
+                break;
+            }
+            (void)wxspoolpop(qp);
+            wxstatinc(WXC_UNSPOOLED);
+        }
+        if (n == SPOOLBATCH || wxqpending(&wxupq)) {
+            return;
+        }
+    } else if (wxspoolput(qp, wxdp) == 0) {
+        wxstatinc(WXC_SPOOLED);
     }
-    /* open connection to port 14580 on the server */
-    memset((void *)&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_port = htons(14580);
-    if ((hep = gethostbyname(cwopsvr)) != (struct hostent *)0) {
-        in_addr_t *in = (in_addr_t *)hep->h_addr_list[0];
-        sin.sin_addr.s_addr = *in;
-    } else {
-        sin.sin_addr.s_addr = inet_addr(cwopsvr);
+    if (now >= qp->retry) {
+        qp->backoff = qp->backoff ? qp->backoff * 2 : fwxinterval;
+        if (qp->backoff > UPBACKOFFMAX) {
+            qp->backoff = UPBACKOFFMAX;
+        }
+        qp->retry = now + qp->backoff;
     }
-    if (sin.sin_addr.s_addr == INADDR_NONE) {
-#ifdef DEBUG_CWOP
-        printf("can't figure out the server address\n");
-#endif /*DEBUG_CWOP*/
+}
+
+/*
+ * hand a sample to the uploaders, never blocks when they're threaded
+ */
+static void
+wxupload(wxdat_t *wxdp)
+{
+    if (wxupthreaded) {
+        wxqput(&wxupq, wxdp);
         return;
     }
-#ifdef DEBUG_CWOP
-        printf("CWOP server address 0x%08x\n", sin.sin_addr.s_addr);
-#endif /*DEBUG_CWOP*/
-    if ((s = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
-#ifdef DEBUG_CWOP
-        perror("socket");
-#endif /*DEBUG_CWOP*/
-        return;
+    wxsendwu(wxdp);
+    wxsendcwop(wxdp);
+    wxsendaeris(wxdp);
+}
+
+static void *
+wxuploader(void *arg)
+{
+    wxdat_t wxdat;
+
+    (void)arg;
+    while (1) {
+        wxqget(&wxupq, &wxdat);
+        wxsendwu(&wxdat);
+        wxsendcwop(&wxdat);
+        wxsendaeris(&wxdat);
     }
-    if (connect(s, (const struct sockaddr *)&sin, sizeof(sin)) == -1) {
-        perror("connect");
-        (void)close(s);
-        return;
+    return (void *)0;   /*NOTREACHED*/
+}
+
+/*
+ * one connection per service, the uploader takes turns with it for
+ * all the stations
+ *
+ * https://feedback.weather.com/customer/en/portal/articles/2924682-pws-upload-protocol?b_id=17298
+ */
+static char *
+wxfmtwu(char *s, wxdat_t *wxdp)
+{
+    wxstation_t *sp;
+    struct tm tm;
+
+    sp = &wxstations[wxdp->station];
+    s = stpcpy(s, "/weatherstation/updateweatherstation.php?action=updateraw&realtime=1");
+    s += sprintf(s, "&rtfreq=%d", fwxinterval);
+    s = stpcpy(s, "&ID=");
+    s = wxurlcat(s, sp->wustation);
+    s = stpcpy(s, "&PASSWORD=");
+    s = wxurlcat(s, sp->wupassword);
+    s = stpcpy(s, "&dateutc=");
+    (void)gmtime_r(&wxdp->time, &tm);
+    s += strftime(s, 32, "%Y-%m-%d%%20%H%%3A%M%%3A%S", &tm);
+    s += sprintf(s, "&softwaretype=fwx%%20v%d.%d", VERSION_MAJ, VERSION_MIN);
+    s = stpcpy(s, "&windspeedmph=");
+    s = fwxbfmtfixed(s, wxdp->windcur.speed, 0);
+    if (wxdp->windcur.speed != 0) {
+        s = stpcpy(s, "&winddir=");
+        s = fwxbfmtfixed(s, wxdp->windcur.direction, 0);
     }
-    /* think about blocking vs non-blocking so we can read what we're
-     * getting back for debug purposes
-     */
-    waitforsrv(s);
-    /* "login" by sending user, passcode, and software id */
-    if ((len = snprintf(str, sizeof(str), "user %s pass -1 vers fwx %d.%d\r\n",
-                        cwopuser, VERSION_MAJ, VERSION_MIN)) < 0) {
-        return;
+    s = stpcpy(s, "&windgustmph=");
+    s = fwxbfmtfixed(s, wxdp->windgust.speed, 0);
+    if (wxdp->windgust.speed != 0) {
+        s = stpcpy(s, "&windgustdir=");
+        s = fwxbfmtfixed(s, wxdp->windgust.direction, 0);
     }
-    if (write(s, str, len) == -1) {
-	perror("write login");
-        (void)close(s);
+    s = wxschemaquery(s, wxdp);
+    return s;
+}
+
+static int
+wxpostwu(wxdat_t *wxdp)
+{
+    static wxhttp_t *hp;
+    static char path[2048];
+    int64_t start;
+    int rc;
+
+    if (!hp && !(hp = wxhttpnew(WUHOST, "80", 0))) {
+        wxstatinc(WXC_WUFAIL);
+        return -1;
+    }
+    (void)wxfmtwu(path, wxdp);
+    start = wxusnow();
+    if ((rc = wxhttpget(hp, path, HTTPTIMEOUT)) != 200) {
+        fprintf(stderr, "wxsendwu - got status %d\n", rc);
+        wxstatinc(WXC_WUFAIL);
+    }
+    wxstattime(WXH_WU, wxusnow() - start);
+    return rc == 200 ? 0 : -1;
+}
+
+static void
+wxsendwu(wxdat_t *wxdp)
+{
+    wxstation_t *sp;
+
+    sp = &wxstations[wxdp->station];
+    if (!*sp->wustation || !*sp->wupassword) {
+        /* if we have no station or password we just log to our CSV file */
         return;
     }
-    /* build up packet */
-    sp = stpcpy(str, cwopuser);
-    tm = gmtime(&wxdp->time);
-    sp += strftime(sp, 32, ">APRS,TCPIP*:@%d%H%M", tm);
-    sp += sprintf(sp, "z%s", cwoploc);
+    wxsendspool(&sp->wuspool, wxpostwu, wxdp);
+}
+
+#define CWOPPORT "14580"
+#define CWOPTIMEOUT 10000       /* ms allowed for each CWOP packet */
+
+/*
+ * http://www.wxqa.com/faq.html
+ */
+static char *
+wxfmtcwop(char *sp, wxdat_t *wxdp)
+{
+    wxstation_t *stp;
+    struct tm tm;
+
+    stp = &wxstations[wxdp->station];
+    sp = stpcpy(sp, stp->cwopuser);
+    (void)gmtime_r(&wxdp->time, &tm);
+    sp += strftime(sp, 32, ">APRS,TCPIP*:@%d%H%M", &tm);
+    sp += sprintf(sp, "z%s", stp->cwoploc);
     sp += sprintf(sp, "_%03d/%03dg%03d", wxdp->windcur.direction,
 		  wxdp->windcur.speed, wxdp->windgust.speed);
-    tmp = (int)nearbyintf(WXD_GETDAT(wxdp->outdoortemp, floatd));
-    if (tmp < 0) {
-        sp += sprintf(sp, "t-%02d", -tmp);
-    } else {
-        sp += sprintf(sp, "t%03d", tmp);
-    }
-#ifdef NOTYET
-    sp += sprintf(sp, "r%03d", wxdp->rainhour);
-#endif /*NOTYET*/
-    /* until I get these figured out */
-    sp += sprintf(sp, "r...p...");
-    /* rain today in one hundredths of an inch */
-    tmp = (int)nearbyintf(WXD_GETDAT(wxdp->rainday, floatd)*100);
-    sp += sprintf(sp, "P%03d", tmp);
-    /* humidity in percent, 2 digits, 100 is special cased as 00 */
-    tmp = (int)nearbyintf(WXD_GETDAT(wxdp->outdoorhum, floatd));
-    sp += sprintf(sp, "h%02d", tmp > 99 ? 0 : tmp);
-    /* pressure is in millibar * 10 rather than in of Hg */
-    tmp = (int)nearbyintf(WXD_GETDAT(wxdp->barometer, floatd) * 33.86389 * 10);
-    sp += sprintf(sp, "b%05d", tmp);
-    /* solar radiation in w/m^2 */
-    if ((tmp = WXD_GETDAT(wxdp->solar, intd)) > 999) {
-        sp += sprintf(sp, "l%03d", tmp - 1000);
-    } else {
-        sp += sprintf(sp, "L%03d", tmp);
-    }
+    sp = wxschemaaprs(sp, wxdp);
     /* fwx software */
     sp += sprintf(sp, "wfwx\r\n");
-    /* when server's ready */
-    waitforsrv(s);
-    /* send packet */
+    return sp;
+}
+
+/*
+ * each station logs in as itself so each has its own connection
+ */
+static int
+wxpostcwop(wxdat_t *wxdp)
+{
+    wxstation_t *sp;
+    int64_t start;
+    char str[256];
+    int rc;
+
+    sp = &wxstations[wxdp->station];
+    if (!sp->cwop) {
+        /* "login" by sending user, passcode, and software id */
+        (void)snprintf(str, sizeof(str), "user %s pass -1 vers fwx %d.%d",
+                       sp->cwopuser, VERSION_MAJ, VERSION_MIN);
+        if (!(sp->cwop = wxaprsnew(cwopsvr, CWOPPORT, str))) {
+            wxstatinc(WXC_CWOPFAIL);
+            return -1;
+        }
+    }
+    (void)wxfmtcwop(str, wxdp);
 #ifdef DEBUG_CWOP
     printf("\"%s\"\n", str);
 #endif /*DEBUG_CWOP*/
-    if (write(s, str, strlen(str)) == -1) {
-        perror("write packet");
-        (void)close(s);
-        return;
+    start = wxusnow();
+    rc = wxaprssend(sp->cwop, str, CWOPTIMEOUT);
+    wxstattime(WXH_CWOP, wxusnow() - start);
+    if (rc != 0) {
+        wxstatinc(WXC_CWOPFAIL);
+        return -1;
     }
-    /* close connection */
-    (void)close(s);
-    lasthere = now;
-    return;
+    return 0;
 }
 
 static void
-wxsendaeris(wxdat_t *wxdp)
+wxsendcwop(wxdat_t *wxdp)
 {
-    struct tm *tm;
-    char str[2048];
-    char *s;
+    wxstation_t *sp;
 
-    if (!*aerisstation || !*aerispassword) {
-        /* if we have no station or password we just log to our CSV file */
+    sp = &wxstations[wxdp->station];
+    if (!*cwopsvr || !*sp->cwopuser || !*sp->cwoploc) {
+        /* don't bother if we don't have the server, login, and location */ 
+#ifdef DEBUG_CWOP
+        printf("not logging to CWOP svr: %s user: %s location: %s\n",
+               cwopsvr, sp->cwopuser, sp->cwoploc);
+#endif
         return;
     }
-    s = stpcpy(str, "/usr/bin/fetch -q -a -T 3 -o /dev/null 'https://www.pwsweather.com/pwsupdate/pwsupdate.php?");
-    s += sprintf(s, "ID=%s&PASSWORD=%s", aerisstation, aerispassword);
+    if (wxdp->time - sp->cwoplast < 5 * 60) {
+        /* don't do this more than every 5 minutes, sent or spooled */
+        return;
+    }
+    sp->cwoplast = wxdp->time;
+    wxsendspool(&sp->cwopspool, wxpostcwop, wxdp);
+}
+
+static char *
+wxfmtaeris(char *s, wxdat_t *wxdp)
+{
+    wxstation_t *sp;
+    struct tm tm;
+
+    sp = &wxstations[wxdp->station];
+    s = stpcpy(s, "/pwsupdate/pwsupdate.php?ID=");
+    s = wxurlcat(s, sp->aerisstation);
+    s = stpcpy(s, "&PASSWORD=");
+    s = wxurlcat(s, sp->aerispassword);
     s = stpcpy(s, "&dateutc=");
-    tm = gmtime(&wxdp->time);
-    s += strftime(s, 32, "%Y-%m-%d+%H%%3A%M%%3A%S", tm);
-    s += sprintf(s, "&windspeedmph=%d", wxdp->windcur.speed);
+    (void)gmtime_r(&wxdp->time, &tm);
+    s += strftime(s, 32, "%Y-%m-%d+%H%%3A%M%%3A%S", &tm);
+    s = stpcpy(s, "&windspeedmph=");
+    s = fwxbfmtfixed(s, wxdp->windcur.speed, 0);
     if (wxdp->windcur.speed != 0) {
-        s += sprintf(s, "&winddir=%d", wxdp->windcur.direction);
+        s = stpcpy(s, "&winddir=");
+        s = fwxbfmtfixed(s, wxdp->windcur.direction, 0);
     }
-    s += sprintf(s, "&windgustmph=%d", wxdp->windgust.speed);
+    s = stpcpy(s, "&windgustmph=");
+    s = fwxbfmtfixed(s, wxdp->windgust.speed, 0);
 #if 0
     if (wxdp->windgust.speed != 0) {
-        s += sprintf(s, "&windgustdir=%d", wxdp->windgust.direction);
+        s = stpcpy(s, "&windgustdir=");
+        s = fwxbfmtfixed(s, wxdp->windgust.direction, 0);
     }
 #endif
-    if (WXD_ISVALID(wxdp->outdoortemp)) {
-        s += sprintf(s, "&tempf=%.1f", WXD_GETDAT(wxdp->outdoortemp, floatd));
-    }
-    if (WXD_ISVALID(wxdp->rainrate)) {
-        s += sprintf(s, "&rainin=%.2f", WXD_GETDAT(wxdp->rainrate, floatd));
-    }
-    if (WXD_ISVALID(wxdp->rainday)) {
-        s += sprintf(s, "&dailyrainin=%.2f", WXD_GETDAT(wxdp->rainday, floatd));
-    }
-    if (WXD_ISVALID(wxdp->barometer)) {
-        s += sprintf(s, "&baromin=%.3f", WXD_GETDAT(wxdp->barometer, floatd));
-    }
-    if (WXD_ISVALID(wxdp->outdoorhum)) {
-        s += sprintf(s, "&humidity=%.0f", WXD_GETDAT(wxdp->outdoorhum, floatd));
-    }
-    if (WXD_ISVALID(wxdp->outdoordewpoint)) {
-        s += sprintf(s, "&dewptf=%.1f", WXD_GETDAT(wxdp->outdoordewpoint, floatd));
-    }
-    if (WXD_ISVALID(wxdp->solar)) {
-        s += sprintf(s, "&solarradiation=%d", WXD_GETDAT(wxdp->solar, intd));
+    s = wxschemaquery(s, wxdp);
+    s += sprintf(s, "&softwaretype=fwx%%20v%d.%d&action=updateraw", VERSION_MAJ, VERSION_MIN);
+    return s;
+}
+
+static int
+wxpostaeris(wxdat_t *wxdp)
+{
+    static wxhttp_t *hp;
+    static char path[2048];
+    int64_t start;
+    int rc;
+
+    if (!hp && !(hp = wxhttpnew(AERISHOST, "443", 1))) {
+        wxstatinc(WXC_AERISFAIL);
+        return -1;
     }
-    s += sprintf(s, "&softwaretype=fwx%%20v%d.%d&action=updateraw'", VERSION_MAJ, VERSION_MIN);
-/*    sprintf(s, "&action=updateraw'"); */
+    (void)wxfmtaeris(path, wxdp);
 #ifdef DEBUG_AERIS
-    printf("\"%s\"\n", str);
+    printf("\"%s\"\n", path);
 #endif /*DEBUG_AERIS*/
-    (void)system(str);
+    start = wxusnow();
+    if ((rc = wxhttpget(hp, path, HTTPTIMEOUT)) != 200) {
+        fprintf(stderr, "wxsendaeris - got status %d\n", rc);
+        wxstatinc(WXC_AERISFAIL);
+    }
+    wxstattime(WXH_AERIS, wxusnow() - start);
+    return rc == 200 ? 0 : -1;
+}
+
+static void
+wxsendaeris(wxdat_t *wxdp)
+{
+    wxstation_t *sp;
+
+    sp = &wxstations[wxdp->station];
+    if (!*sp->aerisstation || !*sp->aerispassword) {
+        /* if we have no station or password we just log to our CSV file */
+        return;
+    }
+    wxsendspool(&sp->aerisspool, wxpostaeris, wxdp);
 }
 
 static int
@@ -953,7 +2581,7 @@ wxident(int fd)
                 return -1;
     }
 
-    if ((rc = wxread(fd, &ident, 1, 5)) != 1) {
+    if ((rc = wxread(fd, &ident, 1, 5 * 1000)) != 1) {
         fprintf(stderr, "wxident - wxread failed, rc = %d\n", rc);
         return -1;
     }
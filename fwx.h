@@ -25,6 +25,7 @@ typedef struct wxd {
         void *voidp;
     } dat;
     unsigned int flags;
+    int raw;                    /* as the station sent it, see WXD_GVPLACES */
     char *units;
 } wxd_t;
 
@@ -35,6 +36,7 @@ typedef struct wind {
 
 typedef struct wxdat {
     time_t time;                /* time this sample was taken at */
+    int station;                /* which of fwx.c's stations it's from */
     wind_t windcur;             /* current wind speed/direction */
     wind_t windavg;             /* average wind speed/direction */
     wind_t windgust;            /* 10 minute wind gust speed/direction */
@@ -43,15 +45,18 @@ typedef struct wxdat {
     wxd_t winddir;              /* current windspeed's direction */
     wxd_t avgwindspeed;         /* average wind speed */
     wxd_t avgwindspeedinterval; /* how long the average is taken over (min) */
+    wxd_t avgwind2;             /* 2 minute average wind speed (LOOP2) */
     wxd_t indoortemp;           /* indoors temperature */
     wxd_t outdoortemp;          /* outdoors temperature */
     wxd_t indoorhum;            /* indoors humidity */
     wxd_t outdoorhum;           /* outdoors humidity */
     wxd_t outdoordewpoint;      /* outdoors dewpoint */
+    wxd_t heatindex;            /* heat index (LOOP2) */
     wxd_t rainrate;             /* current rain-rate */
-#ifdef NOTYET
+    wxd_t rain15;               /* rain in past 15 minutes (LOOP2) */
     wxd_t rainhour;             /* rain in past hour */
-#endif /*NOTYET*/
+    wxd_t rain24;               /* rain in past 24 hours */
+    wxd_t bartrend;             /* pressure change over 3 hours */
     wxd_t rainday;              /* rain today */
     wxd_t rainmonth;            /* rain this month */
     wxd_t rainyear;             /* rain this year */
@@ -62,6 +67,8 @@ typedef struct wxdat {
 #define WXD_SETFLAGS(x, n)      ((x).flags = (n))
 #define WXD_GETDAT(x, fmt)      ((x).dat.fmt)
 #define WXD_SETDAT(x, v, fmt)   ((x).dat.fmt = (v))
+#define WXD_GETRAW(x)           ((x).raw)
+#define WXD_SETRAW(x, v)        ((x).raw = (v))
 #define WXD_GETUNITS(x)         ((x).units)
 #define WXD_SETUNITS(x, s)      ((x).units = (s))
 
@@ -87,6 +94,232 @@ typedef struct wxdat {
 #define WXD_GVPLACES(x)         (WXD_GETFLAGS(x) & 0x0f)
 #define WXD_SVPLACES(x, n)      {(x)->flags &= ~0x0f;(x)->flags |= (n) & 0x0f;}
 
+/*
+ * where each wxdat_t field goes on the way out, see schema.c
+ */
+typedef struct wxfield {
+    const char *name;           /* for humans */
+    size_t off;                 /* offsetof() the wxd_t in wxdat_t */
+    const char *units;          /* what the consumers below expect */
+    int issigned;               /* raw value can be negative */
+    int csv;                    /* log column and fwxbin.h field, -1 for none */
+    int needs;                  /* only log if this column is valid too, or -1 */
+    const char *query;          /* WU & PWSweather parameter, NULL for none */
+    char aprs;                  /* APRS weather code, 0 for none */
+    int aprspos;                /* order within the APRS report */
+    int aprswidth;              /* digits APRS wants */
+    int aprsconv;               /* WXF_APRS* */
+} wxfield_t;
+
+#define WXF_APRSPLAIN   0       /* whole units */
+#define WXF_APRSHUND    1       /* hundredths */
+#define WXF_APRSHUM     2       /* whole units, 100 is sent as 00 */
+#define WXF_APRSMBAR    3       /* in Hg sent as tenths of a millibar */
+#define WXF_APRSSOLAR   4       /* L under 1000, l and less 1000 over */
+
+/*
+ * the last few days of samples, a column of raw values per wxfields[]
+ * row plus a validity bitmap, see history.c
+ */
+#define WXHISTDAYS 7            /* default depth */
+
+typedef struct wxhist {
+    unsigned int cap;           /* samples kept */
+    unsigned int n;             /* samples ever added */
+    int ncol;                   /* columns, one per wxfields[] row */
+    time_t base;                /* time[] is seconds past this */
+    uint32_t *time;             /* when each sample was taken */
+    uint32_t *valid;            /* bit per column */
+    uint16_t *col;              /* ncol columns of cap raw values */
+    void *mem;                  /* all of the above */
+    size_t memlen;
+} wxhist_t;
+
+#define WXHISTCOL(hp, c)        (&(hp)->col[(size_t)(c) * (hp)->cap])
+
+/*
+ * counters and latency histograms, see stats.c
+ */
+#define WXC_WAKEUP      0       /* wakeup attempts */
+#define WXC_WAKEUPFAIL  1       /* ... that got no answer */
+#define WXC_ACKFAIL     2       /* commands the station didn't ACK */
+#define WXC_SHORTREAD   3       /* reads that timed out part way */
+#define WXC_CRCERR      4       /* LOOP packets with a bad crc */
+#define WXC_SAMPLES     5       /* samples logged */
+#define WXC_NODATA      6       /* ... without fresh station data */
+#define WXC_LOGFAIL     7       /* log writes that failed */
+#define WXC_WUFAIL      8       /* uploads that failed */
+#define WXC_AERISFAIL   9
+#define WXC_CWOPFAIL    10
+#define WXC_OVERRUN     11      /* intervals the sampling loop missed */
+#define WXC_SKIPPED     12      /* bytes the stream parser threw away */
+#define WXC_UPDROPPED   13      /* samples the upload queue threw away */
+#define WXC_SPOOLED     14      /* uploads put off 'til the service is back */
+#define WXC_UNSPOOLED   15      /* ... and sent once it was */
+#define WXC_HTTPREQS    16      /* requests the HTTP server answered */
+#define WXC_PUBFAIL     17      /* samples a publisher couldn't send */
+#define WXC_PUBDROPPED  18      /* ... or threw away, having fallen behind */
+#define WXC_N           19
+
+#define WXH_WAKEUP      0       /* us for the station to wake */
+#define WXH_ACK         1       /* us from command to ACK */
+#define WXH_LOOP        2       /* us from LOOP to packet, or between packets */
+#define WXH_LOG         3       /* us spent in wxlog() */
+#define WXH_WU          4       /* us per upload */
+#define WXH_AERIS       5
+#define WXH_CWOP        6
+#define WXH_JITTER      7       /* us the sampling loop woke late */
+#define WXH_N           8
+
+#define WXSTATBUCKETS   28      /* powers of 2 us, 2^27us is over 2 min */
+
+/*
+ * rolling window over timed samples, see window.c
+ */
+typedef struct wxwinsamp {
+    time_t t;                   /* when the sample was taken */
+    int v;                      /* what's tracked */
+    int aux;                    /* along for the ride, eg wind direction */
+} wxwinsamp_t;
+
+typedef struct wxwin {
+    time_t span;                /* samples older than this age out */
+    unsigned int cap;           /* ring size, a power of two */
+    wxwinsamp_t *s;             /* the samples */
+    unsigned int head;          /* next sample goes here */
+    unsigned int tail;          /* oldest sample */
+    unsigned int *maxq;         /* positions in s, values decreasing */
+    unsigned int maxh;
+    unsigned int maxt;
+    unsigned int *minq;         /* positions in s, values increasing */
+    unsigned int minh;
+    unsigned int mint;
+    long sum;                   /* of v over the window */
+    long long sumsq;            /* of v * v over the window */
+} wxwin_t;
+
+/*
+ * append-only file with group commit, see writer.c
+ */
+#define WXWBUFSIZE 8192
+
+typedef struct wxwriter {
+    int fd;                     /* -1 when closed */
+    char path[FILENAME_MAX];
+    char buf[WXWBUFSIZE];       /* records not yet written */
+    size_t len;
+    off_t size;                 /* file size as of the last whole record */
+    int pending;                /* records since the last commit */
+    time_t lastcommit;
+    int syncrecs;               /* commit every this many records */
+    int syncsecs;               /* and at least every this many secs */
+} wxwriter_t;
+
+/*
+ * uploads a service didn't take, one append-only file of fixed size
+ * records per station and service, see spool.c.  A record has what
+ * the upload encoders look at, raw[] and flags[] follow wxfields[]
+ * and only hold values that were in the table's units.
+ */
+#define WXSPOOLFIELDS 32        /* room for wxfields[] to grow */
+
+typedef struct wxspoolrec {
+    int64_t time;
+    int32_t wind[4];            /* windcur speed & direction, then windgust's */
+    int32_t raw[WXSPOOLFIELDS];
+    uint32_t flags[WXSPOOLFIELDS];
+} wxspoolrec_t;
+
+typedef struct wxspool {
+    int fd;                     /* -1 when there's no spool */
+    char path[FILENAME_MAX];
+    uint64_t head;              /* records already sent */
+    uint64_t tail;              /* records in the file */
+    time_t retry;               /* leave the service alone 'til then ... */
+    int backoff;                /* ... and this long after the next failure */
+} wxspool_t;
+
+#define WXSPOOLDEPTH(qp)        ((qp)->tail - (qp)->head)
+
+/*
+ * when the next sample is due, always a multiple of interval seconds
+ * past the epoch, see sched.c
+ */
+typedef struct wxsched {
+    int interval;
+    time_t next;
+} wxsched_t;
+
+/*
+ * windows and history saved across restarts, see state.c
+ */
+typedef struct wxstate {
+    int fd;                     /* -1 when there's no state file */
+    char path[FILENAME_MAX];
+    void *map;                  /* all len bytes of it */
+    size_t len;
+    time_t saved;               /* last checkpoint */
+    int current;                /* the file matches memory up to its header's marks */
+} wxstate_t;
+
+/*
+ * minute, hour & day rollups of the log, see rollup.c & fwxroll.h
+ */
+typedef struct wxrollf {
+    int fd;                     /* -1 when closed */
+    char path[FILENAME_MAX];
+    void *map;                  /* all len bytes of it */
+    size_t len;
+    time_t start;               /* first second the file covers */
+    time_t end;                 /* first second it doesn't */
+} wxrollf_t;
+
+typedef struct wxroll {
+    wxrollf_t f[3];             /* one per FWXR_ period */
+    int rainlast;               /* yearly rain total last seen, or -1 */
+} wxroll_t;
+
+/*
+ * samples waiting for the upload thread, WXQLEN deep for each station
+ * so one tick of every station fits while a post is in flight, when
+ * full the oldest is tossed.  Needs <pthread.h>.
+ */
+#define WXQLEN 4
+
+typedef struct wxq {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    wxdat_t *q;
+    unsigned int len;           /* slots in q */
+    unsigned int head;          /* next slot to fill */
+    unsigned int tail;          /* oldest queued sample */
+    unsigned long dropped;      /* samples replaced before upload */
+} wxq_t;
+
+/*
+ * incremental frame parser state, bytes from the station are put in
+ * the ring as they arrive and whole frames are pulled out as soon as
+ * their crc checks out.  WXFRAMERING must be a power of two.
+ */
+#define WXFRAMERING 1024
+
+typedef struct wxframe {
+    unsigned char ring[WXFRAMERING];
+    unsigned int head;          /* next byte in goes here */
+    unsigned int tail;          /* oldest byte not yet consumed */
+    unsigned int pos;           /* bytes past tail already crc'ed */
+    unsigned short crc;         /* running crc of the candidate frame */
+    int insync;                 /* tail points at a frame signature */
+    unsigned long frames;       /* good frames returned */
+    unsigned long crcerrs;      /* candidate frames with bad crc */
+    unsigned long skipped;      /* bytes tossed hunting for a signature */
+    unsigned long overruns;     /* bytes lost to a full ring */
+} wxframe_t;
+
+#define WXFRAMEGOOD     1       /* got a frame */
+#define WXFRAMENEED     0       /* need more bytes */
+#define WXFRAMEBAD      -1      /* tossed a frame with bad crc */
+
 /*
  * returns from read loop routine
  */
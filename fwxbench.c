@@ -0,0 +1,329 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * fwxbench - push synthetic LOOP packets through the same code fwx
+ * runs and report what each stage costs.  fwx.c is pulled in whole
+ * so the static functions are the real ones, not copies.
+ *
+ * Stages are timed separately: frame (the stream parser, fed in
+ * serial sized chunks), decode (cvtvploop2fwx() and the windows
+ * behind it), log (wxlog() and the rollups, into a scratch
+ * directory), the three upload encoders and csv (fwxbscancsv() over
+ * the decoded samples as wxlog() writes them).  Nothing goes on the
+ * network.  With -c the parser gets the bytes of a capture (see
+ * fwxcap.h) and decode the LOOP packets it finds in them, rather than
+ * made up ones.
+ */
+
+#define main fwxmain
+#include "fwx.c"
+#undef main
+
+#define BENCHUSAGE "usage:\n%s [-b] [-n <samples>] [-i <interval>] [-l <logdir>] [-c <capture>]\n"
+
+#define BENCHN 1000000          /* default samples per stage */
+#define BENCHRING 1024          /* decoded samples kept for later stages */
+#define BENCHCHUNK 64           /* bytes handed to the parser at a time */
+#define BENCHCSVMAX 256         /* room for one csv line */
+
+/* from synth.c */
+extern void wxsynthloop(vploopdata_t *ld, unsigned int n);
+/* from fwxbin.c */
+extern char *fwxbfmtcsv(char *s, const fwxbrec_t *rp);
+extern const char *fwxbscancsv(const char *s, const char *end, fwxbrec_t *rp, int *rcp);
+
+static volatile size_t benchsink;       /* keep the compiler honest */
+
+static int64_t
+benchns(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * everything a console sent in a capture's stream reads and polls,
+ * back to back
+ */
+static int
+benchcapture(const char *path, unsigned char **streamp, size_t *slenp)
+{
+    unsigned char buf[FWXC_MAXLEN];
+    unsigned char *stream;
+    unsigned char *p;
+    fwxcrec_t rec;
+    size_t len;
+    size_t cap;
+    FILE *fp;
+    int rc;
+
+    if ((fp = wxcapopen(path)) == (FILE *)0) {
+        return -1;
+    }
+    stream = (unsigned char *)0;
+    len = cap = 0;
+    while ((rc = wxcapread(fp, &rec, buf)) == 1) {
+        if (rec.type != FWXC_STREAM && rec.type != FWXC_LOOP) {
+            continue;
+        }
+        if (len + rec.len > cap) {
+            cap = cap ? cap * 2 : 64 * 1024;
+            if (!(p = realloc(stream, cap))) {
+                perror("realloc");
+                free(stream);
+                fclose(fp);
+                return -1;
+            }
+            stream = p;
+        }
+        memcpy(&stream[len], buf, rec.len);
+        len += rec.len;
+    }
+    fclose(fp);
+    if (rc == -1 || len < VPLOOPSIZE) {
+        fprintf(stderr, "fwxbench - no packets in %s\n", path);
+        free(stream);
+        return -1;
+    }
+    *streamp = stream;
+    *slenp = len;
+    return 0;
+}
+
+static void
+benchreport(const char *stage, int64_t ns, long n)
+{
+    printf("%-8s %10.1f ns/sample %12.0f samples/s\n", stage,
+           (double)ns / n, ns ? (double)n * 1e9 / ns : 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+    static wxdat_t ring[BENCHRING];
+    static char buf[4096];
+    vploopdata_t *lds;
+    wxdat_t *wxdp;
+    vploopdata_t ld;
+    wxstation_t *sp;
+    char tmpdir[] = "/tmp/fwxbench.XXXXXX";
+    char *logdir;
+    char *capture;
+    unsigned char *stream;
+    fwxbrec_t rec;
+    const char *p;
+    char *csv;
+    char *q;
+    size_t slen;
+    size_t off;
+    size_t len;
+    time_t t0;
+    int64_t ns;
+    long nlds;
+    long n;
+    long i;
+    int c;
+
+    n = BENCHN;
+    logdir = (char *)0;
+    capture = (char *)0;
+    fwxinterval = VPLOOPINTERVAL;
+    while ((c = getopt(argc, argv, "bc:i:l:n:")) != -1) {
+        switch (c) {
+        case 'b':
+            ++fwxbinary;
+            break;
+        case 'c':
+            capture = optarg;
+            break;
+        case 'i':
+            fwxinterval = (int)strtol(optarg, (char **)0, 0);
+            break;
+        case 'l':
+            logdir = optarg;
+            break;
+        case 'n':
+            n = strtol(optarg, (char **)0, 0);
+            break;
+        default:
+            fprintf(stderr, BENCHUSAGE, argv[0]);
+            return 1;
+        }
+    }
+    if (n <= 0 || fwxinterval <= 0) {
+        fprintf(stderr, BENCHUSAGE, argv[0]);
+        return 1;
+    }
+    if (!logdir && !(logdir = mkdtemp(tmpdir))) {
+        perror("mkdtemp");
+        return 1;
+    }
+    sp = wxstationnew();
+    strncpy(sp->logdir, logdir, sizeof(sp->logdir)-1);
+    strcpy(sp->wustation, "KXXBENCH1");
+    strcpy(sp->wupassword, "bench");
+    strcpy(sp->aerisstation, "BENCH");
+    strcpy(sp->aerispassword, "bench");
+    strcpy(sp->cwopuser, "BENCH");
+    strcpy(sp->cwoploc, "3746.00N/12225.00W");
+
+    nlds = 0;
+    if (capture) {
+        /* the capture's bytes for the parser, its first LOOPs to decode */
+        if (benchcapture(capture, &stream, &slen) != 0) {
+            return 1;
+        }
+        if (!(lds = malloc(BENCHRING * sizeof(vploopdata_t)))) {
+            perror("malloc");
+            return 1;
+        }
+        wxframeinit(&sp->frame);
+        for (off = 0; nlds < BENCHRING && off < slen; off += len) {
+            len = slen - off < BENCHCHUNK ? slen - off : BENCHCHUNK;
+            wxframeput(&sp->frame, &stream[off], len);
+            while (nlds < BENCHRING &&
+                   (c = wxframeget(&sp->frame, &lds[nlds])) != WXFRAMENEED) {
+                if (c == WXFRAMEGOOD && lds[nlds].type != VPLOOP2TYPE) {
+                    ++nlds;
+                }
+            }
+        }
+        if (nlds == 0) {
+            fprintf(stderr, "fwxbench - no good LOOP packets in %s\n", capture);
+            return 1;
+        }
+        printf("%s: %lu bytes, %ld packets to decode\n", capture, (unsigned long)slen, nlds);
+    } else {
+        /* a stream of BENCHRING different packets, replayed for the parser */
+        slen = BENCHRING * VPLOOPSIZE;
+        if (!(stream = malloc(slen))) {
+            perror("malloc");
+            return 1;
+        }
+        lds = (vploopdata_t *)stream;
+        for (i = 0; i < BENCHRING; ++i) {
+            wxsynthloop(&lds[i], (unsigned int)i);
+        }
+    }
+
+    printf("%ld samples, interval %d\n", n, fwxinterval);
+
+    wxframeinit(&sp->frame);
+    off = 0;
+    i = 0;
+    ns = benchns();
+    while (i < n) {
+        len = slen - off < BENCHCHUNK ? slen - off : BENCHCHUNK;
+        wxframeput(&sp->frame, &stream[off], len);
+        off = (off + len) % slen;
+        while (i < n && wxframeget(&sp->frame, &ld) == WXFRAMEGOOD) {
+            ++i;
+        }
+    }
+    benchreport("frame", benchns() - ns, n);
+    if (sp->frame.crcerrs || sp->frame.skipped) {
+        fprintf(stderr, "fwxbench - parser lost sync, %lu crc errors %lu bytes skipped\n",
+                sp->frame.crcerrs, sp->frame.skipped);
+    }
+
+    t0 = time((time_t *)0);
+    ns = benchns();
+    for (i = 0; i < n; ++i) {
+        wxdp = &ring[i % BENCHRING];
+        if (nlds) {
+            ld = lds[i % nlds];
+        } else {
+            wxsynthloop(&ld, (unsigned int)i);
+        }
+        memset((void *)wxdp, 0, sizeof(wxdat_t));
+        wxdp->time = t0 + i * fwxinterval;
+        cvtvploop2fwx(sp, &ld, (vploop2data_t *)0, wxdp);
+    }
+    benchreport("decode", benchns() - ns, n);
+
+    /* keep the log stage to one day so there's one file to clean up */
+    wxwinit(&sp->logw, fwxsyncrecs, fwxsyncsecs);
+    wxwinit(&sp->binw, fwxsyncrecs, fwxsyncsecs);
+    (void)wxlogrotate(sp, t0);
+    ns = benchns();
+    for (i = 0; i < n; ++i) {
+        ring[i % BENCHRING].time = sp->logstart + i % (sp->logend - sp->logstart);
+        wxlog(sp, &ring[i % BENCHRING]);
+    }
+    (void)wxwclose(&sp->logw);
+    (void)wxwclose(&sp->binw);
+    wxrollclose(&sp->roll);
+    benchreport("log", benchns() - ns, n);
+    (void)unlink(sp->logw.path);
+    if (fwxbinary) {
+        (void)unlink(sp->binw.path);
+    }
+    for (c = 0; fwxrollup && c < 3; ++c) {
+        (void)unlink(sp->roll.f[c].path);
+    }
+    if (logdir == tmpdir) {
+        (void)rmdir(tmpdir);
+    }
+
+    ns = benchns();
+    for (i = 0; i < n; ++i) {
+        benchsink += wxfmtwu(buf, &ring[i % BENCHRING]) - buf;
+    }
+    benchreport("wu", benchns() - ns, n);
+
+    ns = benchns();
+    for (i = 0; i < n; ++i) {
+        benchsink += wxfmtaeris(buf, &ring[i % BENCHRING]) - buf;
+    }
+    benchreport("aeris", benchns() - ns, n);
+
+    ns = benchns();
+    for (i = 0; i < n; ++i) {
+        benchsink += wxfmtcwop(buf, &ring[i % BENCHRING]) - buf;
+    }
+    benchreport("cwop", benchns() - ns, n);
+
+    /* the same lines over and over, as they'd come out of an mmap()ed log */
+    if (!(csv = malloc(BENCHRING * BENCHCSVMAX))) {
+        perror("malloc");
+        return 1;
+    }
+    for (q = csv, i = 0; i < BENCHRING; ++i) {
+        wxschemabin(&ring[i], &rec);
+        q = fwxbfmtcsv(q, &rec);
+    }
+    len = (size_t)(q - csv);
+    off = 0;
+    ns = benchns();
+    for (p = csv, i = 0; i < n; ++i) {
+        if (p == q) {
+            off += len;
+            p = csv;
+        }
+        p = fwxbscancsv(p, q, &rec, &c);
+        benchsink += (size_t)c + rec.valid;
+    }
+    ns = benchns() - ns;
+    off += (size_t)(p - csv);
+    benchreport("csv", ns, n);
+    printf("csv      %10.0f MB/s\n", ns ? (double)off * 1e3 / ns : 0.0);
+    free(csv);
+
+    if (capture) {
+        free(lds);
+    }
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,803 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Binary log records and their CSV equivalent, shared by fwx and the
+ * fwxconv converter.  Conversions go straight between the scaled
+ * integers and decimal text, no floating point is involved so a
+ * round trip is exact.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "fwxbin.h"
+#include "fwxroll.h"
+#include "fwxpack.h"
+
+const fwxbcol_t fwxbcols[FWXB_NFIELDS] = {
+    { "barometer",      3, 0 },
+    { "windspeed",      0, 0 },
+    { "winddir",        0, 0 },
+    { "avgwindspeed",   0, 0 },
+    { "indoortemp",     1, 1 },
+    { "outdoortemp",    1, 1 },
+    { "dewpoint",       1, 1 },
+    { "indoorhum",      0, 0 },
+    { "outdoorhum",     0, 0 },
+    { "rainrate",       2, 0 },
+    { "rainday",        2, 0 },
+    { "rainmonth",      2, 0 },
+    { "rainyear",       2, 0 },
+    { "solar",          0, 0 },
+};
+
+void
+fwxbhdrinit(fwxbhdr_t *hp, time_t day)
+{
+    memset((void *)hp, 0, sizeof(fwxbhdr_t));
+    memcpy(hp->magic, FWXB_MAGIC, sizeof(hp->magic));
+    hp->bom = FWXB_BOM;
+    hp->vermaj = FWXB_VERMAJ;
+    hp->vermin = FWXB_VERMIN;
+    hp->hdrsize = sizeof(fwxbhdr_t);
+    hp->recsize = sizeof(fwxbrec_t);
+    hp->nfields = FWXB_NFIELDS;
+    hp->day = day;
+}
+
+/*
+ * returns 0 if we know how to read records described by this header
+ */
+int
+fwxbhdrcheck(const fwxbhdr_t *hp)
+{
+    if (memcmp(hp->magic, FWXB_MAGIC, sizeof(hp->magic)) != 0) {
+        return -1;
+    }
+    if (hp->bom != FWXB_BOM) {
+        fprintf(stderr, "fwxbhdrcheck - wrong byte order\n");
+        return -1;
+    }
+    if (hp->vermaj != FWXB_VERMAJ) {
+        fprintf(stderr, "fwxbhdrcheck - version %d.%d not supported\n",
+                hp->vermaj, hp->vermin);
+        return -1;
+    }
+    /* newer minor versions may only add to the end of things */
+    if (hp->hdrsize < sizeof(fwxbhdr_t) || hp->recsize < sizeof(fwxbrec_t) ||
+        hp->nfields < FWXB_NFIELDS) {
+        fprintf(stderr, "fwxbhdrcheck - bogus sizes\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * write v, which has places implied decimal places, as decimal text
+ * (eg. 29921, 3 -> "29.921", -5, 1 -> "-0.5"), returns the new end
+ */
+char *
+fwxbfmtfixed(char *s, long v, int places)
+{
+    char tmp[24];
+    char *p;
+    int n;
+
+    if (v < 0) {
+        *s++ = '-';
+        v = -v;
+    }
+    p = &tmp[sizeof(tmp)];
+    n = 0;
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+        if (++n == places) {
+            *--p = '.';
+        }
+    } while (v > 0 || n <= places);
+    n = &tmp[sizeof(tmp)] - p;
+    memcpy(s, p, n);
+    s += n;
+    *s = '\0';
+    return s;
+}
+
+/*
+ * parse decimal text with up to places decimal places into a scaled
+ * integer, stops at the first character that can't be part of the
+ * number, returns a pointer to it or NULL if there was no number
+ */
+const char *
+fwxbparsefixed(const char *s, int places, long *vp)
+{
+    long v;
+    int neg;
+    int got;
+    int n;
+
+    neg = 0;
+    if (*s == '-') {
+        neg = 1;
+        ++s;
+    } else if (*s == '+') {
+        ++s;
+    }
+    v = 0;
+    got = 0;
+    while (isdigit((unsigned char)*s)) {
+        v = v * 10 + (*s++ - '0');
+        got = 1;
+    }
+    n = 0;
+    if (*s == '.') {
+        ++s;
+        while (isdigit((unsigned char)*s)) {
+            if (n < places) {
+                v = v * 10 + (*s - '0');
+                ++n;
+            } else if (n == places) {
+                if (*s >= '5') {
+                    ++v;                /* round what we can't keep */
+                }
+                ++n;
+            }
+            ++s;
+            got = 1;
+        }
+    }
+    if (!got) {
+        return (const char *)0;
+    }
+    for (; n < places; ++n) {
+        v *= 10;
+    }
+    *vp = neg ? -v : v;
+    return s;
+}
+
+/*
+ * format a record as a README.datafile line, newline included
+ */
+char *
+fwxbfmtcsv(char *s, const fwxbrec_t *rp)
+{
+    int i;
+
+    s += sprintf(s, "%d,%d,%lld,", FWXB_VERMAJ, FWXB_VERMIN,
+                 (long long)rp->time);
+    for (i = 0; i < FWXB_NFIELDS; ++i) {
+        /* as in wxlog(), no direction is logged without a speed */
+        if (FWXB_ISVALID(rp, i) &&
+            (i != FWXB_WINDDIR || FWXB_ISVALID(rp, FWXB_WINDSPEED))) {
+            s = fwxbfmtfixed(s, FWXB_GETVAL(rp, i), fwxbcols[i].places);
+        }
+        *s++ = ',';
+    }
+    *s++ = '\n';
+    *s = '\0';
+    return s;
+}
+
+/*
+ * The commas and the end of a log line are found a vector at a time,
+ * compare a block of bytes against ',' and against '\n', squash each
+ * result to a bit mask and walk the commas ahead of the first newline,
+ * and then each field is parsed knowing where it ends.  SCANEQ() gives
+ * SCANBITS bits per byte, x86's movemask makes one, NEON has no
+ * movemask and shifting each 16 bit lane right by 4 and narrowing
+ * makes four.  Anything else does a byte at a time.  The width is
+ * picked at compile time, -mavx2 (or -march=native) gets the 32 byte
+ * version.
+ */
+#if defined(__AVX2__)
+#define SCANW           32
+#define SCANBITS        1
+#define SCANEQ(p, c)    ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8( \
+        _mm256_loadu_si256((const __m256i *)(p)), _mm256_set1_epi8(c))))
+#elif defined(__SSE2__)
+#define SCANW           16
+#define SCANBITS        1
+#define SCANEQ(p, c)    ((uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8( \
+        _mm_loadu_si128((const __m128i *)(p)), _mm_set1_epi8(c))))
+#elif defined(__ARM_NEON)
+#define SCANW           16
+#define SCANBITS        4
+#define SCANEQ(p, c)    (vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8( \
+        vceqq_u8(vld1q_u8((const uint8_t *)(p)), vdupq_n_u8(c))), 4)), 0) & \
+        0x1111111111111111ULL)
+#endif
+
+#define CSVMAXDELIMS    (FWXB_NFIELDS + 3)      /* commas a line we wrote has */
+
+/*
+ * where the first CSVMAXDELIMS (or fewer) commas on the line starting
+ * at s are, *np of them, returns the newline ending it or end
+ */
+static const char *
+fwxbscandelims(const char *s, const char *end, const char **d, int *np)
+{
+    int n;
+#ifdef SCANW
+    uint64_t mc;
+    uint64_t mn;
+#endif
+
+    n = 0;
+#ifdef SCANW
+    for (; end - s >= SCANW; s += SCANW) {
+        mc = SCANEQ(s, ',');
+        mn = SCANEQ(s, '\n');
+        if (mn) {
+            mc &= (mn & -mn) - 1;       /* only the commas before it */
+        }
+        for (; mc; mc &= mc - 1) {
+            if (n == CSVMAXDELIMS) {
+                *np = n;
+                s += __builtin_ctzll(mc) / SCANBITS;
+                return (s = memchr(s, '\n', (size_t)(end - s))) ? s : end;
+            }
+            d[n++] = s + __builtin_ctzll(mc) / SCANBITS;
+        }
+        if (mn) {
+            *np = n;
+            return s + __builtin_ctzll(mn) / SCANBITS;
+        }
+    }
+#endif
+    for (; s < end && *s != '\n'; ++s) {
+        if (*s == ',') {
+            if (n == CSVMAXDELIMS) {
+                *np = n;
+                return (s = memchr(s, '\n', (size_t)(end - s))) ? s : end;
+            }
+            d[n++] = s;
+        }
+    }
+    *np = n;
+    return s;
+}
+
+/*
+ * all of s to e as a number with places implied decimal places, the
+ * same rules as fwxbparsefixed(), returns 0 if that's all there was
+ */
+static int
+fwxbscanfixed(const char *s, const char *e, int places, long *vp)
+{
+    long v;
+    int neg;
+    int got;
+    int n;
+
+    neg = 0;
+    if (s < e && (*s == '-' || *s == '+')) {
+        neg = *s++ == '-';
+    }
+    v = 0;
+    got = 0;
+    for (; s < e && (unsigned)(*s - '0') < 10; ++s) {
+        v = v * 10 + (*s - '0');
+        got = 1;
+    }
+    n = 0;
+    if (s < e && *s == '.') {
+        for (++s; s < e && (unsigned)(*s - '0') < 10; ++s) {
+            if (n < places) {
+                v = v * 10 + (*s - '0');
+                ++n;
+            } else if (n++ == places && *s >= '5') {
+                ++v;                    /* round what we can't keep */
+            }
+            got = 1;
+        }
+    }
+    if (!got || s != e) {
+        return -1;
+    }
+    for (; n < places; ++n) {
+        v *= 10;
+    }
+    *vp = neg ? -v : v;
+    return 0;
+}
+
+/*
+ * eight ASCII digits, the first (most significant) in the low byte,
+ * as a number or -1 if they aren't all digits.  Neighbouring lanes
+ * are folded together, bytes into 16 bit pairs, pairs into fours and
+ * fours into eight, three multiplies instead of eight dependent ones.
+ */
+static inline long
+fwxbswar8(uint64_t w)
+{
+    if (((w & 0xf0f0f0f0f0f0f0f0ULL) |
+         (((w + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) !=
+        0x3333333333333333ULL) {
+        return -1;
+    }
+    w -= 0x3030303030303030ULL;
+    w = (w * 10 + (w >> 8)) & 0x00ff00ff00ff00ffULL;
+    w = (w * 100 + (w >> 16)) & 0x0000ffff0000ffffULL;
+    w = (w * 10000 + (w >> 32)) & 0xffffffffULL;
+    return (long)w;
+}
+
+/*
+ * with places decimals the bytes a word ending at the field's end keeps
+ * where they are and the ones below the '.' that move up over it, and
+ * the bytes ahead of nd digits, tables rather than variable shifts
+ */
+static const uint64_t dotkeep[4] = {
+    0, 0xff00000000000000ULL, 0xffff000000000000ULL, 0xffffff0000000000ULL
+};
+static const uint64_t dotbelow[4] = {
+    0, 0x0000ffffffffffffULL, 0x000000ffffffffffULL, 0x00000000ffffffffULL
+};
+static const uint64_t leadmask[8] = {
+    ~0ULL, 0x00ffffffffffffffULL, 0x0000ffffffffffffULL, 0x000000ffffffffffULL,
+    0x00000000ffffffffULL, 0x0000000000ffffffULL, 0x000000000000ffffULL, 0xffULL
+};
+
+/*
+ * fwxbscanfixed() for a field written the way fwxbfmtfixed() writes
+ * them, an optional '-' then digits with exactly places of them after
+ * the '.', 7 digits at most with a '.' and 16 without.  The last
+ * eight bytes are loaded as one word ending at e, the '.' squeezed
+ * out and whatever's ahead of the number turned into leading zeros,
+ * the caller makes sure there are eight bytes of the line before e.
+ * Anything else goes the long way.
+ */
+static inline int
+fwxbscanfast(const char *s, const char *e, int places, long *vp)
+{
+    const char *p;
+    uint64_t w;
+    long hi;
+    long v;
+    int neg;
+    int nd;
+
+    neg = *s == '-';
+    nd = (int)(e - s) - neg - (places > 0);
+    if (nd <= places || nd > (places ? 7 : 16) ||
+        (places && (places > 3 || e[-places - 1] != '.'))) {
+        return fwxbscanfixed(s, e, places, vp);
+    }
+    memcpy(&w, e - 8, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    if (places) {
+        w = (w & dotkeep[places]) | ((w & dotbelow[places]) << 8);
+    }
+    hi = 0;
+    if (nd > 8) {
+        /* only the time has more, the rest of it one at a time */
+        for (p = s + neg; p < e - 8; ++p) {
+            if ((unsigned)(*p - '0') >= 10) {
+                return fwxbscanfixed(s, e, places, vp);
+            }
+            hi = hi * 10 + (*p - '0');
+        }
+    } else if (nd < 8) {
+        w = (w & ~leadmask[nd]) | (0x3030303030303030ULL & leadmask[nd]);
+    }
+    if ((v = fwxbswar8(w)) < 0) {
+        return fwxbscanfixed(s, e, places, vp);
+    }
+    v += hi * 100000000L;
+    *vp = neg ? -v : v;
+    return 0;
+}
+
+/*
+ * parse the README.datafile line starting at s (v0.4 lacks the solar
+ * column), it needn't be NUL terminated, nothing past end is looked
+ * at.  *rcp is 0 if the line was good, returns the start of the next.
+ */
+const char *
+fwxbscancsv(const char *s, const char *end, fwxbrec_t *rp, int *rcp)
+{
+    const char *d[CSVMAXDELIMS + 1];
+    const char *e;
+    long v;
+    int nfields;
+    int n;
+    int i;
+
+    memset((void *)rp, 0, sizeof(fwxbrec_t));
+    *rcp = -1;
+    e = fwxbscandelims(s, end, d, &n);
+    end = e < end ? e + 1 : end;
+    if (n < 3) {
+        return end;
+    }
+    if (e > s && e[-1] == '\r') {
+        --e;
+    }
+    d[n] = e;
+    if (d[0] - s != 1 || s[0] != '0' || d[1] - d[0] != 2 ||
+        (d[0][1] != '4' && d[0][1] != '5')) {
+        return end;
+    }
+    nfields = d[0][1] == '4' ? FWXB_SOLAR : FWXB_NFIELDS;
+    /*
+     * files we wrote always end fields with a comma, the last one can
+     * end the line instead
+     */
+    if (n < nfields + 2 || d[1] + 1 == d[2]) {
+        return end;
+    }
+    if ((d[2] - s >= 8 ? fwxbscanfast(d[1] + 1, d[2], 0, &v) :
+         fwxbscanfixed(d[1] + 1, d[2], 0, &v)) != 0 ||
+        memchr(d[1], '.', (size_t)(d[2] - d[1]))) {
+        return end;
+    }
+    rp->time = v;
+    for (i = 0; i < nfields; ++i) {
+        if (d[i + 2] + 1 == d[i + 3]) {
+            continue;           /* empty, no reading */
+        }
+        if ((d[i + 3] - s >= 8 ?
+             fwxbscanfast(d[i + 2] + 1, d[i + 3], fwxbcols[i].places, &v) :
+             fwxbscanfixed(d[i + 2] + 1, d[i + 3], fwxbcols[i].places, &v)) != 0) {
+            return end;
+        }
+        /* it has to fit in 16 bits, wrapping it would be a lie */
+        if (fwxbcols[i].issigned ? v < INT16_MIN || v > INT16_MAX : v < 0 || v > UINT16_MAX) {
+            return end;
+        }
+        rp->val[i] = (uint16_t)v;
+        rp->valid |= 1 << i;
+    }
+    *rcp = 0;
+    return end;
+}
+
+/*
+ * parse a NUL terminated README.datafile line, returns 0 on success
+ */
+int
+fwxbparsecsv(const char *s, fwxbrec_t *rp)
+{
+    int rc;
+
+    (void)fwxbscancsv(s, s + strlen(s), rp, &rc);
+    return rc;
+}
+
+/*
+ * add a record to a rollup slot starting at start, rain is what fell
+ * since the record before it
+ */
+void
+fwxradd(fwxrrec_t *sp, int64_t start, const fwxbrec_t *rp, int rain)
+{
+    fwxrcol_t *cp;
+    long v;
+    int i;
+
+    if (sp->start == 0) {
+        sp->start = start;
+    }
+    ++sp->n;
+    sp->rain += rain;
+    for (i = 0; i < FWXB_NFIELDS; ++i) {
+        if (!FWXB_ISVALID(rp, i)) {
+            continue;
+        }
+        v = FWXB_GETVAL(rp, i);
+        cp = &sp->col[i];
+        if (cp->n == 0 || v < cp->min) {
+            cp->min = (int32_t)v;
+        }
+        if (cp->n == 0 || v > cp->max) {
+            cp->max = (int32_t)v;
+        }
+        cp->sum += v;
+        ++cp->n;
+    }
+}
+
+/*
+ * fwxradd() for a short slot, a field whose count is full is left
+ * as it is
+ */
+void
+fwxrsadd(fwxrsrec_t *sp, int64_t start, const fwxbrec_t *rp, int rain)
+{
+    fwxrscol_t *cp;
+    long v;
+    int i;
+
+    if (sp->start == 0) {
+        sp->start = start;
+    }
+    ++sp->n;
+    sp->rain += rain;
+    for (i = 0; i < FWXB_NFIELDS; ++i) {
+        cp = &sp->col[i];
+        if (!FWXB_ISVALID(rp, i) || cp->n == UINT16_MAX) {
+            continue;
+        }
+        v = FWXB_GETVAL(rp, i);
+        if (cp->n == 0 || v < FWXR_SGET(cp, min, i)) {
+            cp->min = rp->val[i];
+        }
+        if (cp->n == 0 || v > FWXR_SGET(cp, max, i)) {
+            cp->max = rp->val[i];
+        }
+        cp->sum += (int32_t)v;
+        ++cp->n;
+    }
+}
+
+/*
+ * slot i of the rollup hp starts, widened into *bufp if it's short
+ */
+const fwxrrec_t *
+fwxrget(const fwxrhdr_t *hp, int i, fwxrrec_t *bufp)
+{
+    const fwxrsrec_t *sp;
+    int c;
+
+    if (!FWXR_SHORT(hp)) {
+        return (const fwxrrec_t *)FWXR_SLOT(hp, i);
+    }
+    sp = (const fwxrsrec_t *)FWXR_SLOT(hp, i);
+    memset((void *)bufp, 0, sizeof(fwxrrec_t));
+    bufp->start = sp->start;
+    bufp->n = sp->n;
+    bufp->rain = sp->rain;
+    for (c = 0; c < FWXB_NFIELDS; ++c) {
+        bufp->col[c].min = (int32_t)FWXR_SGET(&sp->col[c], min, c);
+        bufp->col[c].max = (int32_t)FWXR_SGET(&sp->col[c], max, c);
+        bufp->col[c].sum = sp->col[c].sum;
+        bufp->col[c].n = sp->col[c].n;
+    }
+    return bufp;
+}
+
+/*
+ * format a rollup slot as a line of CSV (see README.datafile), newline
+ * included: start, samples, rain, then min, max & mean of each field,
+ * all three empty where it never had a value
+ */
+char *
+fwxrfmtcsv(char *s, const fwxrrec_t *sp)
+{
+    const fwxrcol_t *cp;
+    int64_t mean;
+    int64_t half;
+    int i;
+
+    s += sprintf(s, "%lld,%u,", (long long)sp->start, sp->n);
+    s = fwxbfmtfixed(s, sp->rain, fwxbcols[FWXB_RAINYEAR].places);
+    for (i = 0; i < FWXB_NFIELDS; ++i) {
+        cp = &sp->col[i];
+        if (cp->n == 0) {
+            s = stpcpy(s, ",,,");
+            continue;
+        }
+        *s++ = ',';
+        s = fwxbfmtfixed(s, cp->min, fwxbcols[i].places);
+        *s++ = ',';
+        s = fwxbfmtfixed(s, cp->max, fwxbcols[i].places);
+        *s++ = ',';
+        /* rounded to the station's resolution */
+        half = (int64_t)cp->n / 2;
+        mean = (cp->sum < 0 ? cp->sum - half : cp->sum + half) / (int64_t)cp->n;
+        s = fwxbfmtfixed(s, (long)mean, fwxbcols[i].places);
+    }
+    *s++ = '\n';
+    *s = '\0';
+    return s;
+}
+
+/*
+ * returns 0 if we know how to read the packed archive hp starts, size
+ * bytes long
+ */
+int
+fwxphdrcheck(const fwxphdr_t *hp, size_t size)
+{
+    if (size < sizeof(fwxphdr_t) || memcmp(hp->magic, FWXP_MAGIC, sizeof(hp->magic)) != 0) {
+        return -1;
+    }
+    if (hp->bom != FWXB_BOM) {
+        fprintf(stderr, "fwxphdrcheck - wrong byte order\n");
+        return -1;
+    }
+    if (hp->vermaj != FWXP_VERMAJ) {
+        fprintf(stderr, "fwxphdrcheck - version %d.%d not supported\n",
+                hp->vermaj, hp->vermin);
+        return -1;
+    }
+    /* the blocks have a column per field, so those have to match */
+    if (hp->hdrsize < sizeof(fwxphdr_t) || hp->idxsize < sizeof(fwxpidx_t) ||
+        hp->nfields != FWXB_NFIELDS ||
+        size < hp->hdrsize + (size_t)hp->nblocks * hp->idxsize) {
+        fprintf(stderr, "fwxphdrcheck - bogus sizes\n");
+        return -1;
+    }
+    return 0;
+}
+
+#define ZIGZAG(d)       (((uint64_t)(d) << 1) ^ ((d) < 0 ? ~(uint64_t)0 : 0))
+#define UNZIGZAG(u)     ((int64_t)((u) >> 1) ^ -(int64_t)((u) & 1))
+
+/*
+ * column c of a record, a field that isn't valid keeps the last value
+ */
+static int64_t
+fwxpcol(const fwxbrec_t *rp, int c, int64_t last)
+{
+    if (c == FWXP_TIME) {
+        return rp->time;
+    }
+    if (c == FWXP_VALID) {
+        return rp->valid;
+    }
+    return FWXB_ISVALID(rp, c - FWXP_FIELD(0)) ? FWXB_GETVAL(rp, c - FWXP_FIELD(0)) : last;
+}
+
+/*
+ * pack n (1 to FWXP_BLOCKRECS) records into a block at out, which has
+ * room for FWXP_BLKMAX(n), returns its length
+ */
+size_t
+fwxppack(void *out, const fwxbrec_t *rp, int n)
+{
+    fwxpblk_t *bp;
+    uint64_t *wp;
+    uint64_t m;
+    uint64_t u;
+    int64_t last;
+    int64_t lo;
+    int64_t hi;
+    int64_t step;
+    int64_t v;
+    size_t nw;
+    int bit;
+    int w;
+    int c;
+    int i;
+
+    bp = out;
+    memset((void *)bp, 0, sizeof(fwxpblk_t));
+    bp->time = rp[0].time;
+    bp->n = (uint16_t)n;
+    wp = (uint64_t *)(bp + 1);
+    for (c = 0; c < FWXP_NCOLS; ++c) {
+        /* differences are kept from the middle of their range */
+        last = fwxpcol(&rp[0], c, 0);
+        if (c != FWXP_TIME) {
+            bp->first[c] = (int32_t)last;
+        }
+        lo = hi = 0;
+        for (i = 1; i < n; ++i) {
+            v = fwxpcol(&rp[i], c, last);
+            if (i == 1 || v - last < lo) {
+                lo = v - last;
+            }
+            if (i == 1 || v - last > hi) {
+                hi = v - last;
+            }
+            last = v;
+        }
+        step = lo + (hi - lo) / 2;
+        if (step < INT32_MIN || step > INT32_MAX) {
+            step = 0;
+        }
+        bp->step[c] = (int32_t)step;
+        m = ZIGZAG(lo - step) | ZIGZAG(hi - step);
+        w = m ? 64 - __builtin_clzll(m) : 0;
+        bp->width[c] = (uint8_t)w;
+
+        nw = FWXP_WORDS(n, w);
+        memset((void *)wp, 0, nw * sizeof(uint64_t));
+        last = fwxpcol(&rp[0], c, 0);
+        for (i = 1, bit = 0; i < n; ++i, bit += w) {
+            v = fwxpcol(&rp[i], c, last);
+            u = ZIGZAG(v - last - step);
+            last = v;
+            wp[bit >> 6] |= u << (bit & 63);
+            if ((bit & 63) + w > 64) {
+                wp[(bit >> 6) + 1] |= u >> (64 - (bit & 63));
+            }
+        }
+        wp += nw;
+    }
+    return (size_t)((char *)wp - (char *)out);
+}
+
+/*
+ * unpack the len byte block at blk into rp, which has room for
+ * FWXP_BLOCKRECS, returns how many records it held or -1 if it's bad
+ */
+int
+fwxpunpack(const void *blk, size_t len, fwxbrec_t *rp)
+{
+    const fwxpblk_t *bp;
+    const uint64_t *wp;
+    uint64_t mask;
+    uint64_t u;
+    int64_t step;
+    int64_t v;
+    size_t need;
+    int bit;
+    int n;
+    int w;
+    int c;
+    int f;
+    int i;
+
+    bp = blk;
+    if (len < sizeof(fwxpblk_t) || bp->n == 0 || bp->n > FWXP_BLOCKRECS) {
+        return -1;
+    }
+    n = bp->n;
+    need = sizeof(fwxpblk_t);
+    for (c = 0; c < FWXP_NCOLS; ++c) {
+        if (bp->width[c] > 64) {
+            return -1;
+        }
+        need += FWXP_WORDS(n, bp->width[c]) * sizeof(uint64_t);
+    }
+    if (need > len) {
+        return -1;
+    }
+
+    memset((void *)rp, 0, (size_t)n * sizeof(fwxbrec_t));
+    wp = (const uint64_t *)(bp + 1);
+    for (c = 0; c < FWXP_NCOLS; ++c) {
+        w = bp->width[c];
+        mask = w == 64 ? ~(uint64_t)0 : ((uint64_t)1 << w) - 1;
+        step = bp->step[c];
+        v = c == FWXP_TIME ? bp->time : bp->first[c];
+        /* the valid bits come before the fields, so we know which to keep */
+        f = c - FWXP_FIELD(0);
+        for (i = 0, bit = 0; i < n; ++i) {
+            if (i) {
+                u = wp[bit >> 6] >> (bit & 63);
+                if ((bit & 63) + w > 64) {
+                    u |= wp[(bit >> 6) + 1] << (64 - (bit & 63));
+                }
+                v += step + UNZIGZAG(u & mask);
+                bit += w;
+            }
+            if (c == FWXP_TIME) {
+                rp[i].time = v;
+            } else if (c == FWXP_VALID) {
+                rp[i].valid = (uint16_t)v;
+            } else if (FWXB_ISVALID(&rp[i], f)) {
+                rp[i].val[f] = (uint16_t)v;
+            }
+        }
+        wp += FWXP_WORDS(n, w);
+    }
+    return n;
+}
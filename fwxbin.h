@@ -0,0 +1,77 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Binary daily log, written alongside the CSV file as %Y.%m.%d.fwb.
+ * A fixed header is followed by fixed size records so the file can
+ * be mmap()ed and record n found at hdrsize + n * recsize.  Values
+ * are the scaled integers the station sends (bar * 1000, temps * 10,
+ * rain * 100, ...), the number of implied decimal places for each is
+ * in fwxbcols[].  Everything is in host byte order, bom tells a
+ * reader if that isn't its own.  Needs <stdint.h>.
+ */
+
+#define FWXB_MAGIC      "FWXB"
+#define FWXB_BOM        0xfeff
+#define FWXB_VERMAJ     0               /* same as fwx's VERSION_MAJ */
+#define FWXB_VERMIN     5               /* same as fwx's VERSION_MIN */
+
+/* fields in the same order as the CSV columns after the time stamp */
+#define FWXB_BAR        0
+#define FWXB_WINDSPEED  1
+#define FWXB_WINDDIR    2
+#define FWXB_AVGWIND    3
+#define FWXB_TEMPIN     4
+#define FWXB_TEMPOUT    5
+#define FWXB_DEWPOINT   6
+#define FWXB_HUMIN      7
+#define FWXB_HUMOUT     8
+#define FWXB_RAINRATE   9
+#define FWXB_RAINDAY    10
+#define FWXB_RAINMONTH  11
+#define FWXB_RAINYEAR   12
+#define FWXB_SOLAR      13
+#define FWXB_NFIELDS    14
+
+typedef struct fwxbhdr {
+    char magic[4];                      /* FWXB_MAGIC, no terminator */
+    uint16_t bom;                       /* FWXB_BOM as written */
+    uint16_t vermaj;                    /* FWXB_VERMAJ */
+    uint16_t vermin;                    /* FWXB_VERMIN */
+    uint16_t hdrsize;                   /* bytes before the first record */
+    uint16_t recsize;                   /* bytes per record */
+    uint16_t nfields;                   /* values per record */
+    int64_t day;                        /* local midnight starting the file */
+    uint8_t spare[8];
+} fwxbhdr_t;
+
+typedef struct fwxbrec {
+    int64_t time;                       /* seconds past the epoch */
+    uint16_t valid;                     /* bit n set if val[n] is good */
+    uint16_t val[FWXB_NFIELDS];         /* signed fields stored 2's comp */
+    uint16_t spare;
+} fwxbrec_t;
+
+/*
+ * how each field is scaled and whether it's signed
+ */
+typedef struct fwxbcol {
+    const char *name;
+    int places;                         /* implied decimal places */
+    int issigned;
+} fwxbcol_t;
+
+#define FWXB_ISVALID(r, n)      ((r)->valid & (1 << (n)))
+#define FWXB_GETVAL(r, n)       (fwxbcols[n].issigned ? \
+                                 (long)(int16_t)(r)->val[n] : (long)(r)->val[n])
+
+extern const fwxbcol_t fwxbcols[FWXB_NFIELDS];
@@ -0,0 +1,50 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Raw capture of what a console sent, %Y.%m.%d.fwc, written with
+ * FWXCAPTURE 1 and played back with fwx -R.  A header, then records
+ * as they came in: a fixed part giving the length, what kind of read
+ * it was and when (wall clock microseconds) it arrived, followed by
+ * len bytes exactly as read.  Stream reads are whatever the port had,
+ * frame boundaries and all, a poll is the LOOP (or LOOP & LOOP2 for
+ * LPS) that answered it and an archive record is a vparchive_t as
+ * DMPAFT paged it out.  fwxbin.h must be included first, everything
+ * is in host byte order.
+ */
+
+#define FWXC_MAGIC      "FWXC"
+#define FWXC_VERMAJ     0
+#define FWXC_VERMIN     1
+
+#define FWXC_STREAM     1               /* record types */
+#define FWXC_LOOP       2
+#define FWXC_ARCHIVE    3
+
+#define FWXC_MAXLEN     512             /* biggest record fwx writes */
+
+typedef struct fwxchdr {
+    char magic[4];                      /* FWXC_MAGIC, no terminator */
+    uint16_t bom;                       /* FWXB_BOM as written */
+    uint16_t vermaj;                    /* FWXC_VERMAJ */
+    uint16_t vermin;                    /* FWXC_VERMIN */
+    uint16_t hdrsize;                   /* bytes before the first record */
+    uint16_t recsize;                   /* bytes of each record's fixed part */
+    uint8_t spare[6];
+} fwxchdr_t;
+
+typedef struct fwxcrec {
+    uint32_t len;                       /* bytes that follow */
+    uint16_t type;                      /* FWXC_STREAM ... */
+    uint16_t spare;
+    int64_t us;                         /* when it came in */
+} fwxcrec_t;
@@ -0,0 +1,294 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * fwxconv - convert daily logs between the README.datafile CSV
+ * format and the binary format in fwxbin.h.  The direction is picked
+ * by looking at the input, binary becomes CSV and CSV becomes binary.
+ * Rollup files (fwxroll.h) and packed archives (fwxpack.h) only go
+ * one way, to CSV, fwxpack makes the archives.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "fwxbin.h"
+#include "fwxroll.h"
+#include "fwxpack.h"
+
+#define USAGE "usage:\n%s <infile> [<outfile>]\n"
+
+/* from fwxbin.c */
+extern void fwxbhdrinit(fwxbhdr_t *hp, time_t day);
+extern int fwxbhdrcheck(const fwxbhdr_t *hp);
+extern char *fwxbfmtcsv(char *s, const fwxbrec_t *rp);
+extern char *fwxrfmtcsv(char *s, const fwxrrec_t *sp);
+extern const fwxrrec_t *fwxrget(const fwxrhdr_t *hp, int i, fwxrrec_t *bufp);
+extern const char *fwxbscancsv(const char *s, const char *end, fwxbrec_t *rp, int *rcp);
+extern int fwxphdrcheck(const fwxphdr_t *hp, size_t size);
+extern int fwxpunpack(const void *blk, size_t len, fwxbrec_t *rp);
+
+static int
+bin2csv(const char *in, FILE *out)
+{
+    const fwxbhdr_t *hp;
+    const fwxbrec_t *rp;
+    struct stat st;
+    size_t nrecs;
+    size_t i;
+    char str[512];
+    void *base;
+    int fd;
+
+    if ((fd = open(in, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(in);
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(fwxbhdr_t)) {
+        fprintf(stderr, "%s: too short\n", in);
+        (void)close(fd);
+        return -1;
+    }
+    if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("mmap");
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+    hp = (const fwxbhdr_t *)base;
+    if (fwxbhdrcheck(hp) != 0) {
+        fprintf(stderr, "%s: not a log file we can read\n", in);
+        (void)munmap(base, st.st_size);
+        return -1;
+    }
+    /* a torn record at the end (crash mid-write) is ignored */
+    nrecs = (st.st_size - hp->hdrsize) / hp->recsize;
+    for (i = 0; i < nrecs; ++i) {
+        rp = (const fwxbrec_t *)((const char *)base + hp->hdrsize + i * hp->recsize);
+        (void)fwxbfmtcsv(str, rp);
+        fputs(str, out);
+    }
+    (void)munmap(base, st.st_size);
+    return 0;
+}
+
+/*
+ * every record of a packed archive, as the CSV it was packed from
+ */
+static int
+pack2csv(const char *in, FILE *out)
+{
+    fwxbrec_t recs[FWXP_BLOCKRECS];
+    const fwxphdr_t *hp;
+    const fwxpidx_t *ip;
+    struct stat st;
+    char str[512];
+    void *base;
+    uint32_t i;
+    int fd;
+    int n;
+    int j;
+
+    if ((fd = open(in, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(in);
+        return -1;
+    }
+    if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("mmap");
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+    hp = (const fwxphdr_t *)base;
+    if (fwxphdrcheck(hp, (size_t)st.st_size) != 0) {
+        fprintf(stderr, "%s: not a packed archive we can read\n", in);
+        (void)munmap(base, st.st_size);
+        return -1;
+    }
+    for (i = 0; i < hp->nblocks; ++i) {
+        ip = FWXP_IDX(hp, i);
+        if (ip->off > (uint64_t)st.st_size || ip->len > (uint64_t)st.st_size - ip->off ||
+            (n = fwxpunpack((const char *)base + ip->off, ip->len, recs)) < 0) {
+            fprintf(stderr, "%s: block %u is bad\n", in, i);
+            (void)munmap(base, st.st_size);
+            return -1;
+        }
+        for (j = 0; j < n; ++j) {
+            (void)fwxbfmtcsv(str, &recs[j]);
+            fputs(str, out);
+        }
+    }
+    (void)munmap(base, st.st_size);
+    return 0;
+}
+
+/*
+ * one line per slot that has samples
+ */
+static int
+roll2csv(const char *in, FILE *out)
+{
+    const fwxrhdr_t *hp;
+    const fwxrrec_t *rp;
+    fwxrrec_t buf;
+    struct stat st;
+    char str[1024];
+    void *base;
+    int fd;
+    int i;
+
+    if ((fd = open(in, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(in);
+        return -1;
+    }
+    if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("mmap");
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+    hp = (const fwxrhdr_t *)base;
+    if (st.st_size < (off_t)sizeof(fwxrhdr_t) || hp->bom != FWXB_BOM ||
+        hp->vermaj != FWXR_VERMAJ || hp->hdrsize < sizeof(fwxrhdr_t) ||
+        hp->recsize < (FWXR_SHORT(hp) ? sizeof(fwxrsrec_t) : sizeof(fwxrrec_t)) ||
+        hp->nfields < FWXB_NFIELDS ||
+        st.st_size < (off_t)(hp->hdrsize + (size_t)hp->nslots * hp->recsize)) {
+        fprintf(stderr, "%s: not a rollup we can read\n", in);
+        (void)munmap(base, st.st_size);
+        return -1;
+    }
+    for (i = 0; i < hp->nslots; ++i) {
+        rp = fwxrget(hp, i, &buf);
+        if (rp->n != 0) {
+            (void)fwxrfmtcsv(str, rp);
+            fputs(str, out);
+        }
+    }
+    (void)munmap(base, st.st_size);
+    return 0;
+}
+
+static int
+csv2bin(const char *in, FILE *out)
+{
+    fwxbhdr_t hdr;
+    fwxbrec_t rec;
+    struct stat st;
+    struct tm tm;
+    time_t day;
+    const char *p;
+    const char *end;
+    void *base;
+    int lineno;
+    int nrecs;
+    int fd;
+    int rc;
+
+    if ((fd = open(in, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(in);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        (void)close(fd);
+        return 0;
+    }
+    if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("mmap");
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+
+    nrecs = 0;
+    lineno = 0;
+    end = (const char *)base + st.st_size;
+    for (p = base; p < end; ) {
+        ++lineno;
+        p = fwxbscancsv(p, end, &rec, &rc);
+        if (rc != 0) {
+            fprintf(stderr, "%s:%d: can't parse, skipped\n", in, lineno);
+            continue;
+        }
+        if (nrecs++ == 0) {
+            /* the header claims the local day of the first record */
+            day = (time_t)rec.time;
+            (void)localtime_r(&day, &tm);
+            tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+            tm.tm_isdst = -1;
+            fwxbhdrinit(&hdr, mktime(&tm));
+            if (fwrite(&hdr, sizeof(hdr), 1, out) != 1) {
+                perror("fwrite");
+                (void)munmap(base, st.st_size);
+                return -1;
+            }
+        }
+        if (fwrite(&rec, sizeof(rec), 1, out) != 1) {
+            perror("fwrite");
+            (void)munmap(base, st.st_size);
+            return -1;
+        }
+    }
+    (void)munmap(base, st.st_size);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *in;
+    FILE *out;
+    char magic[4];
+    int rc;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+    if ((in = fopen(argv[1], "r")) == (FILE *)0) {
+        perror(argv[1]);
+        return 1;
+    }
+    out = stdout;
+    if (argc == 3 && (out = fopen(argv[2], "w")) == (FILE *)0) {
+        perror(argv[2]);
+        return 1;
+    }
+    if (fread(magic, sizeof(magic), 1, in) != 1) {
+        memset(magic, 0, sizeof(magic));
+    }
+    if (memcmp(magic, FWXB_MAGIC, sizeof(magic)) == 0) {
+        (void)fclose(in);
+        rc = bin2csv(argv[1], out);
+    } else if (memcmp(magic, FWXR_MAGIC, sizeof(magic)) == 0) {
+        (void)fclose(in);
+        rc = roll2csv(argv[1], out);
+    } else if (memcmp(magic, FWXP_MAGIC, sizeof(magic)) == 0) {
+        (void)fclose(in);
+        rc = pack2csv(argv[1], out);
+    } else {
+        (void)fclose(in);
+        rc = csv2bin(argv[1], out);
+    }
+    if (fclose(out) == EOF) {
+        perror("fclose");
+        rc = -1;
+    }
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,634 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * fwxpack - turn closed out daily logs into packed archives (see
+ * fwxpack.h) and, with -u, back again.  Logs are given by name or
+ * found in the log directories named, today's is left alone since
+ * fwx is still writing it.  A day with both is packed from the CSV
+ * log, the binary one never has anything it doesn't.  A day that was
+ * packed before (its log made again by a backfill, say) is merged with
+ * its archive by time, the archive's record winning where both have
+ * one, and left alone if the archive can't be read.  The archive is
+ * written to a temporary file, synced and read back, and only once it
+ * holds the same records is it renamed into place and the day's .fwx,
+ * .fwb and .fwi removed (never with -k, or when some of the CSV
+ * didn't parse).  Meant to be run from cron.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+
+#include "fwxbin.h"
+#include "fwxpack.h"
+
+#define USAGE "usage:\n%s [-k] [-u] [-v] <logdir|log> ...\n" \
+    "    -k keeps what was packed (or unpacked), -u unpacks, -v says what was done\n"
+
+#define PATHMAX (FILENAME_MAX + 16)
+
+/* from fwxbin.c */
+extern int fwxbhdrcheck(const fwxbhdr_t *hp);
+extern char *fwxbfmtcsv(char *s, const fwxbrec_t *rp);
+extern const char *fwxbscancsv(const char *s, const char *end, fwxbrec_t *rp, int *rcp);
+extern int fwxphdrcheck(const fwxphdr_t *hp, size_t size);
+extern size_t fwxppack(void *out, const fwxbrec_t *rp, int n);
+extern int fwxpunpack(const void *blk, size_t len, fwxbrec_t *rp);
+
+typedef struct precs {
+    fwxbrec_t *r;
+    size_t n;
+    size_t cap;
+} precs_t;
+
+static int pkeep;
+static int punpack;
+static int pverbose;
+static time_t ptoday;
+
+static int
+precsadd(precs_t *rp, const fwxbrec_t *recp, size_t n)
+{
+    fwxbrec_t *p;
+
+    if (rp->n + n > rp->cap) {
+        rp->cap = rp->cap ? rp->cap * 2 : 8192;
+        while (rp->n + n > rp->cap) {
+            rp->cap *= 2;
+        }
+        if (!(p = realloc(rp->r, rp->cap * sizeof(fwxbrec_t)))) {
+            perror("realloc");
+            return -1;
+        }
+        rp->r = p;
+    }
+    memcpy(&rp->r[rp->n], recp, n * sizeof(fwxbrec_t));
+    rp->n += n;
+    return 0;
+}
+
+/*
+ * all of path mmap()ed, NULL if it's empty or can't be
+ */
+static void *
+pmap(const char *path, size_t *sizep)
+{
+    struct stat st;
+    void *base;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        if (fd != -1) {
+            (void)close(fd);
+        }
+        return (void *)0;
+    }
+    if (st.st_size == 0) {
+        (void)close(fd);
+        return (void *)0;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return (void *)0;
+    }
+    *sizep = (size_t)st.st_size;
+    return base;
+}
+
+/*
+ * the records of a CSV or binary daily log, *skippedp CSV lines that
+ * didn't parse
+ */
+static int
+ploadlog(const char *path, precs_t *rp, int *skippedp)
+{
+    const fwxbhdr_t *hp;
+    fwxbrec_t rec;
+    const char *p;
+    const char *end;
+    void *base;
+    size_t size;
+    size_t n;
+    int rc;
+
+    *skippedp = 0;
+    if (!(base = pmap(path, &size))) {
+        return -1;
+    }
+    hp = base;
+    rc = 0;
+    if (size >= sizeof(fwxbhdr_t) && memcmp(hp->magic, FWXB_MAGIC, sizeof(hp->magic)) == 0) {
+        if (fwxbhdrcheck(hp) != 0 || size < hp->hdrsize) {
+            fprintf(stderr, "%s: not a log file we can read\n", path);
+            (void)munmap(base, size);
+            return -1;
+        }
+        /* a torn record at the end (crash mid-write) is ignored */
+        for (n = 0; rc == 0 && n < (size - hp->hdrsize) / hp->recsize; ++n) {
+            rc = precsadd(rp, (const fwxbrec_t *)((const char *)base + hp->hdrsize +
+                                                  n * hp->recsize), 1);
+        }
+    } else {
+        end = (const char *)base + size;
+        for (p = base; rc == 0 && p < end; ) {
+            p = fwxbscancsv(p, end, &rec, &rc);
+            if (rc != 0) {
+                ++*skippedp;
+                rc = 0;
+                continue;
+            }
+            rc = precsadd(rp, &rec, 1);
+        }
+    }
+    (void)munmap(base, size);
+    return rc;
+}
+
+/*
+ * the records of a packed archive
+ */
+static int
+ploadpacked(const char *path, precs_t *rp)
+{
+    fwxbrec_t recs[FWXP_BLOCKRECS];
+    const fwxphdr_t *hp;
+    const fwxpidx_t *ip;
+    void *base;
+    size_t size;
+    uint32_t i;
+    int n;
+
+    if (!(base = pmap(path, &size))) {
+        return -1;
+    }
+    hp = base;
+    if (fwxphdrcheck(hp, size) != 0) {
+        fprintf(stderr, "%s: not a packed archive we can read\n", path);
+        (void)munmap(base, size);
+        return -1;
+    }
+    for (i = 0; i < hp->nblocks; ++i) {
+        ip = FWXP_IDX(hp, i);
+        if (ip->off > size || ip->len > size - ip->off ||
+            (n = fwxpunpack((const char *)base + ip->off, ip->len, recs)) < 0 ||
+            (uint32_t)n != ip->n) {
+            fprintf(stderr, "%s: block %u is bad\n", path, i);
+            (void)munmap(base, size);
+            return -1;
+        }
+        if (precsadd(rp, recs, (size_t)n) != 0) {
+            (void)munmap(base, size);
+            return -1;
+        }
+    }
+    (void)munmap(base, size);
+    return 0;
+}
+
+static int
+precscmp(const void *a, const void *b)
+{
+    const fwxbrec_t *x;
+    const fwxbrec_t *y;
+
+    x = a;
+    y = b;
+    return x->time < y->time ? -1 : x->time > y->time;
+}
+
+/*
+ * fold the records already packed, old, into rp by time, where both
+ * have the same second old's is kept
+ */
+static int
+pmerge(precs_t *rp, const precs_t *old)
+{
+    precs_t out;
+    size_t i;
+    size_t j;
+    int rc;
+
+    qsort(rp->r, rp->n, sizeof(fwxbrec_t), precscmp);
+    memset((void *)&out, 0, sizeof(out));
+    rc = 0;
+    for (i = j = 0; rc == 0 && (i < rp->n || j < old->n); ) {
+        if (j < old->n && (i == rp->n || old->r[j].time <= rp->r[i].time)) {
+            while (i < rp->n && rp->r[i].time == old->r[j].time) {
+                ++i;
+            }
+            rc = precsadd(&out, &old->r[j++], 1);
+        } else {
+            rc = precsadd(&out, &rp->r[i++], 1);
+        }
+    }
+    if (rc != 0) {
+        free(out.r);
+        return -1;
+    }
+    free(rp->r);
+    *rp = out;
+    return 0;
+}
+
+/*
+ * 1 if a and b hold the same readings
+ */
+static int
+psame(const precs_t *a, const precs_t *b)
+{
+    size_t i;
+    int f;
+
+    if (a->n != b->n) {
+        return 0;
+    }
+    for (i = 0; i < a->n; ++i) {
+        if (a->r[i].time != b->r[i].time || a->r[i].valid != b->r[i].valid) {
+            return 0;
+        }
+        for (f = 0; f < FWXB_NFIELDS; ++f) {
+            if (FWXB_ISVALID(&a->r[i], f) && a->r[i].val[f] != b->r[i].val[f]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * write path (through a temporary file) and get it to the disk
+ */
+static int
+psave(const char *path, const void *s, size_t len)
+{
+    char tpath[PATHMAX + 16];
+    int fd;
+
+    (void)snprintf(tpath, sizeof(tpath), "%s.%ld", path, (long)getpid());
+    if ((fd = open(tpath, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1) {
+        perror(tpath);
+        return -1;
+    }
+    if (write(fd, s, len) != (ssize_t)len || fsync(fd) == -1) {
+        perror(tpath);
+        (void)close(fd);
+        (void)unlink(tpath);
+        return -1;
+    }
+    if (close(fd) == -1 || rename(tpath, path) == -1) {
+        perror(tpath);
+        (void)unlink(tpath);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * the packed archive of day's records
+ */
+static int
+psavepacked(const char *path, time_t day, const precs_t *rp)
+{
+    fwxphdr_t *hp;
+    fwxpidx_t *ip;
+    char *buf;
+    size_t nblocks;
+    size_t off;
+    size_t i;
+    int n;
+    int rc;
+
+    nblocks = (rp->n + FWXP_BLOCKRECS - 1) / FWXP_BLOCKRECS;
+    off = sizeof(fwxphdr_t) + nblocks * sizeof(fwxpidx_t);
+    if (!(buf = malloc(off + nblocks * FWXP_BLKMAX(FWXP_BLOCKRECS)))) {
+        perror("malloc");
+        return -1;
+    }
+    hp = (fwxphdr_t *)buf;
+    memset((void *)hp, 0, sizeof(fwxphdr_t));
+    memcpy(hp->magic, FWXP_MAGIC, sizeof(hp->magic));
+    hp->bom = FWXB_BOM;
+    hp->vermaj = FWXP_VERMAJ;
+    hp->vermin = FWXP_VERMIN;
+    hp->hdrsize = sizeof(fwxphdr_t);
+    hp->idxsize = sizeof(fwxpidx_t);
+    hp->nfields = FWXB_NFIELDS;
+    hp->nblocks = (uint32_t)nblocks;
+    hp->nrecs = (uint32_t)rp->n;
+    hp->day = (int64_t)day;
+    ip = (fwxpidx_t *)(hp + 1);
+    for (i = 0; i < nblocks; ++i, ++ip) {
+        n = (int)(rp->n - i * FWXP_BLOCKRECS < FWXP_BLOCKRECS ?
+                  rp->n - i * FWXP_BLOCKRECS : FWXP_BLOCKRECS);
+        ip->first = rp->r[i * FWXP_BLOCKRECS].time;
+        ip->last = rp->r[i * FWXP_BLOCKRECS + (size_t)n - 1].time;
+        ip->off = off;
+        ip->len = (uint32_t)fwxppack(buf + off, &rp->r[i * FWXP_BLOCKRECS], n);
+        ip->n = (uint32_t)n;
+        off += ip->len;
+    }
+    rc = psave(path, buf, off);
+    free(buf);
+    return rc;
+}
+
+static void
+punlink(const char *path)
+{
+    if (unlink(path) == -1 && errno != ENOENT) {
+        perror(path);
+    }
+}
+
+/*
+ * pack the day whose logs are base.fwx and/or base.fwb
+ */
+static int
+ppackday(const char *base, time_t day)
+{
+    char csv[PATHMAX];
+    char bin[PATHMAX];
+    char idx[PATHMAX];
+    char packed[PATHMAX];
+    char tpacked[PATHMAX + 8];
+    const char *src;
+    precs_t recs;
+    precs_t back;
+    precs_t old;
+    struct stat st;
+    int skipped;
+    int rc;
+
+    (void)snprintf(csv, sizeof(csv), "%s.fwx", base);
+    (void)snprintf(bin, sizeof(bin), "%s.fwb", base);
+    (void)snprintf(idx, sizeof(idx), "%s.fwi", base);
+    (void)snprintf(packed, sizeof(packed), "%s.fwp", base);
+    (void)snprintf(tpacked, sizeof(tpacked), "%s.new", packed);
+    src = stat(csv, &st) == 0 ? csv : bin;
+
+    memset((void *)&recs, 0, sizeof(recs));
+    memset((void *)&back, 0, sizeof(back));
+    memset((void *)&old, 0, sizeof(old));
+    if (ploadlog(src, &recs, &skipped) != 0) {
+        free(recs.r);
+        return -1;
+    }
+    if (recs.n == 0) {
+        fprintf(stderr, "%s: no records, not packed\n", src);
+        free(recs.r);
+        return 0;
+    }
+    /* never lose what an earlier run packed */
+    if (stat(packed, &st) == 0) {
+        if (ploadpacked(packed, &old) != 0 || pmerge(&recs, &old) != 0) {
+            fprintf(stderr, "%s: can't merge with %s, not packed\n", src, packed);
+            free(recs.r);
+            free(old.r);
+            return -1;
+        }
+        if (pverbose) {
+            printf("%s: merging with the %lu records in %s\n", src,
+                   (unsigned long)old.n, packed);
+        }
+        free(old.r);
+    }
+    rc = -1;
+    if (psavepacked(tpacked, day, &recs) == 0 && ploadpacked(tpacked, &back) == 0) {
+        if (!psame(&recs, &back)) {
+            fprintf(stderr, "%s: doesn't read back the same, removed\n", tpacked);
+        } else if (rename(tpacked, packed) == -1) {
+            perror(packed);
+        } else {
+            rc = 0;
+        }
+    }
+    if (rc != 0) {
+        punlink(tpacked);
+    }
+    if (rc == 0 && pverbose) {
+        (void)stat(packed, &st);
+        printf("%s: %lu records packed into %lld bytes\n", src, (unsigned long)recs.n,
+               (long long)st.st_size);
+    }
+    if (rc == 0 && skipped) {
+        fprintf(stderr, "%s: %d lines couldn't be parsed, kept\n", src, skipped);
+    } else if (rc == 0 && !pkeep) {
+        punlink(csv);
+        punlink(bin);
+        punlink(idx);
+    }
+    free(recs.r);
+    free(back.r);
+    return rc;
+}
+
+/*
+ * turn base.fwp back into base.fwx
+ */
+static int
+punpackday(const char *base)
+{
+    char csv[PATHMAX];
+    char packed[PATHMAX];
+    precs_t recs;
+    struct stat st;
+    char *buf;
+    char *s;
+    size_t i;
+    int rc;
+
+    (void)snprintf(csv, sizeof(csv), "%s.fwx", base);
+    (void)snprintf(packed, sizeof(packed), "%s.fwp", base);
+    if (stat(csv, &st) == 0) {
+        fprintf(stderr, "%s: already there, %s not unpacked\n", csv, packed);
+        return -1;
+    }
+    memset((void *)&recs, 0, sizeof(recs));
+    if (ploadpacked(packed, &recs) != 0) {
+        free(recs.r);
+        return -1;
+    }
+    /* each line is well under 256 bytes */
+    if (!(buf = malloc(recs.n * 256 + 1))) {
+        perror("malloc");
+        free(recs.r);
+        return -1;
+    }
+    for (s = buf, i = 0; i < recs.n; ++i) {
+        s = fwxbfmtcsv(s, &recs.r[i]);
+    }
+    rc = psave(csv, buf, (size_t)(s - buf));
+    if (rc == 0 && pverbose) {
+        printf("%s: %lu records unpacked\n", packed, (unsigned long)recs.n);
+    }
+    if (rc == 0 && !pkeep) {
+        punlink(packed);
+    }
+    free(buf);
+    free(recs.r);
+    return rc;
+}
+
+/*
+ * local midnight of the day a log is named for and its path without
+ * the suffix, -1 if it isn't one
+ */
+static time_t
+pday(const char *path, char *base, char *suffix)
+{
+    struct tm tm;
+    const char *name;
+    size_t len;
+
+    name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    memset((void *)&tm, 0, sizeof(tm));
+    len = strlen(path);
+    if (strlen(name) != 14 || len >= FILENAME_MAX ||
+        sscanf(name, "%4d.%2d.%2d.%3s", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               suffix) != 4) {
+        return (time_t)-1;
+    }
+    memcpy(base, path, len - 4);
+    base[len - 4] = '\0';
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/*
+ * pack or unpack the log at path, if it's one we should
+ */
+static int
+pfile(const char *path, int named)
+{
+    char base[FILENAME_MAX];
+    char other[PATHMAX];
+    char suffix[4];
+    struct stat st;
+    time_t day;
+
+    if ((day = pday(path, base, suffix)) == (time_t)-1) {
+        if (named) {
+            fprintf(stderr, "%s: not named for a day\n", path);
+        }
+        return named ? -1 : 0;
+    }
+    if (punpack) {
+        if (strcmp(suffix, "fwp") != 0) {
+            return 0;
+        }
+        return punpackday(base);
+    }
+    if (strcmp(suffix, "fwb") == 0) {
+        /* the .fwx, if there is one, takes care of it */
+        (void)snprintf(other, sizeof(other), "%s.fwx", base);
+        if (!named && stat(other, &st) == 0) {
+            return 0;
+        }
+    } else if (strcmp(suffix, "fwx") != 0) {
+        return 0;
+    }
+    if (day >= ptoday) {
+        if (named) {
+            fprintf(stderr, "%s: still being written, not packed\n", path);
+        }
+        return 0;
+    }
+    return ppackday(base, day);
+}
+
+static int
+pdir(const char *dir)
+{
+    char path[FILENAME_MAX];
+    struct dirent *dp;
+    DIR *d;
+    int rc;
+
+    if (!(d = opendir(dir))) {
+        perror(dir);
+        return -1;
+    }
+    rc = 0;
+    while ((dp = readdir(d))) {
+        (void)snprintf(path, sizeof(path), "%s/%s", dir, dp->d_name);
+        if (pfile(path, 0) != 0) {
+            rc = -1;
+        }
+    }
+    (void)closedir(d);
+    return rc;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct stat st;
+    struct tm tm;
+    time_t now;
+    int rc;
+    int c;
+    int i;
+
+    while ((c = getopt(argc, argv, "kuv")) != -1) {
+        switch (c) {
+        case 'k':
+            ++pkeep;
+            break;
+        case 'u':
+            ++punpack;
+            break;
+        case 'v':
+            ++pverbose;
+            break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+    now = time(0);
+    (void)localtime_r(&now, &tm);
+    tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+    tm.tm_isdst = -1;
+    ptoday = mktime(&tm);
+
+    rc = 0;
+    for (i = optind; i < argc; ++i) {
+        if (stat(argv[i], &st) == -1) {
+            perror(argv[i]);
+            rc = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            rc |= pdir(argv[i]);
+        } else {
+            rc |= pfile(argv[i], 1);
+        }
+    }
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Packed archive of a closed out day, %Y.%m.%d.fwp, made by fwxpack.
+ * A header, an index with an entry per block, then the blocks.  Each
+ * block holds up to FWXP_BLOCKRECS records a column at a time: the
+ * time, the valid bits and the fields of the binary log (see fwxbin.h,
+ * which must be included first) scaled as the station sent them.  A
+ * column is its first value followed by the difference from one
+ * record to the next, less the column's step (the middle of the
+ * block's smallest and largest difference), zig-zag encoded (0, -1,
+ * 1, -2, ... as 0, 1, 2, 3, ...) and packed width bits apiece, least
+ * significant first, into 64 bit words.  width is whatever the
+ * block's largest difference needs, 0 when the column never changes
+ * or, like the time, changes by the same step every record.  A field
+ * is carried forward through records it isn't valid in.  Blocks start
+ * on 8 byte boundaries, everything is in host byte order.
+ */
+
+#define FWXP_MAGIC      "FWXP"
+#define FWXP_VERMAJ     0
+#define FWXP_VERMIN     1
+
+#define FWXP_BLOCKRECS  512             /* most records per block */
+
+#define FWXP_TIME       0               /* columns of a block */
+#define FWXP_VALID      1
+#define FWXP_FIELD(n)   ((n) + 2)
+#define FWXP_NCOLS      FWXP_FIELD(FWXB_NFIELDS)
+
+typedef struct fwxphdr {
+    char magic[4];                      /* FWXP_MAGIC, no terminator */
+    uint16_t bom;                       /* FWXB_BOM as written */
+    uint16_t vermaj;                    /* FWXP_VERMAJ */
+    uint16_t vermin;                    /* FWXP_VERMIN */
+    uint16_t hdrsize;                   /* bytes before the index */
+    uint16_t idxsize;                   /* bytes per index entry */
+    uint16_t nfields;                   /* fields per record */
+    uint32_t nblocks;
+    uint32_t nrecs;
+    int64_t day;                        /* local midnight starting the file */
+    uint8_t spare[8];
+} fwxphdr_t;
+
+typedef struct fwxpidx {
+    int64_t first;                      /* time of the block's first record */
+    int64_t last;                       /* ... and its last */
+    uint64_t off;                       /* of the block from the start of the file */
+    uint32_t len;                       /* bytes */
+    uint32_t n;                         /* records */
+} fwxpidx_t;
+
+typedef struct fwxpblk {
+    int64_t time;                       /* first record's */
+    uint16_t n;                         /* records */
+    uint8_t width[FWXP_NCOLS];          /* bits per difference */
+    uint8_t spare[6];
+    int32_t first[FWXP_NCOLS];          /* first value, the time's is above */
+    int32_t step[FWXP_NCOLS];           /* taken off each difference */
+} fwxpblk_t;
+
+/* 64 bit words of differences a column of n records packs into */
+#define FWXP_WORDS(n, w)        ((((size_t)(n) - 1) * (size_t)(w) + 63) / 64)
+/* room a block of n records could need */
+#define FWXP_BLKMAX(n)          (sizeof(fwxpblk_t) + \
+                                 FWXP_NCOLS * FWXP_WORDS(n, 64) * sizeof(uint64_t))
+
+#define FWXP_IDX(hp, i)         ((const fwxpidx_t *)((const char *)(hp) + (hp)->hdrsize + \
+                                                     (size_t)(i) * (hp)->idxsize))
@@ -0,0 +1,729 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * fwxq - pull a span of time out of years of daily logs, either the
+ * records themselves as README.datafile CSV or (-s) a summary of each
+ * day in the rollup CSV format.  Logs can be CSV, binary or packed by
+ * fwxpack, given by name or found in the log directories named, a day
+ * with more than one is read from the binary one, then the packed one.
+ * Days outside the span are never opened.
+ *
+ * Every file is mmap()ed.  Binary records are fixed size so the start
+ * of the span is a binary search, as is the block it's in for packed
+ * archives (which are unpacked a block at a time), CSV logs get a
+ * sparse index of the time of every INDEXSTEP'th line kept next to
+ * them as %Y.%m.%d.fwi (when the directory is writable), rebuilt
+ * whenever the log changes.
+ *
+ * A file is a task.  Each worker starts with a run of consecutive
+ * days and steals from the far end of another's run when its own is
+ * done, so a few big files don't leave the others idle.  Output is
+ * written in day order as each file finishes.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwxbin.h"
+#include "fwxroll.h"
+#include "fwxpack.h"
+
+#define USAGE "usage:\n%s [-s] [-j <threads>] [-f <from>] [-t <to>] <logdir|log> ...\n" \
+    "    <from> & <to> are seconds past the epoch or local YYYY.MM.DD[.HH:MM]\n"
+
+#define MAXJOBS 64              /* most worker threads */
+#define INDEXSTEP 64            /* CSV lines per index entry */
+#define INDEXMAGIC "FWXI"
+#define LINEMAX 512
+
+#define QCSV 0                  /* kinds of log, the one we'd rather read last */
+#define QPACKED 1
+#define QBINARY 2
+
+/* from fwxbin.c */
+extern int fwxbhdrcheck(const fwxbhdr_t *hp);
+extern char *fwxbfmtcsv(char *s, const fwxbrec_t *rp);
+extern const char *fwxbscancsv(const char *s, const char *end, fwxbrec_t *rp, int *rcp);
+extern void fwxradd(fwxrrec_t *sp, int64_t start, const fwxbrec_t *rp, int rain);
+extern char *fwxrfmtcsv(char *s, const fwxrrec_t *sp);
+extern int fwxphdrcheck(const fwxphdr_t *hp, size_t size);
+extern int fwxpunpack(const void *blk, size_t len, fwxbrec_t *rp);
+
+typedef struct qindexhdr {
+    char magic[4];
+    uint32_t step;              /* lines per entry */
+    int64_t size;               /* of the log when it was indexed ... */
+    int64_t mtime;              /* ... and when it was last changed */
+    uint64_t n;                 /* entries */
+} qindexhdr_t;
+
+typedef struct qindex {
+    int64_t time;               /* of the line ... */
+    uint64_t off;               /* ... that starts here */
+} qindex_t;
+
+typedef struct qfile {
+    char path[FILENAME_MAX];
+    time_t day;                 /* local midnight from the name, -1 if unnamed */
+    int kind;                   /* QCSV, QPACKED or QBINARY */
+    char *out;                  /* what this file has to say */
+    size_t len;
+    size_t cap;
+    int skipped;                /* lines that didn't parse */
+    int done;
+} qfile_t;
+
+typedef struct qdeque {
+    pthread_mutex_t lock;
+    int head;                   /* the owner takes from here ... */
+    int tail;                   /* ... thieves from just before here */
+} qdeque_t;
+
+static qfile_t *qfiles;
+static int qnfiles;
+static int qcapfiles;
+static qdeque_t qdeques[MAXJOBS];
+static int qnjobs;
+static pthread_mutex_t qdonelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t qdonecond = PTHREAD_COND_INITIALIZER;
+static int64_t qfrom = INT64_MIN;
+static int64_t qto = INT64_MAX;
+static int qsummary;
+
+/*
+ * seconds past the epoch, or a local YYYY.MM.DD[.HH:MM]
+ */
+static int
+qparsetime(const char *s, int64_t *tp)
+{
+    struct tm tm;
+    char *e;
+    int n;
+
+    memset((void *)&tm, 0, sizeof(tm));
+    n = sscanf(s, "%d.%d.%d.%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min);
+    if (n == 3 || n == 5) {
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        *tp = (int64_t)mktime(&tm);
+        return 0;
+    }
+    *tp = strtoll(s, &e, 10);
+    return e != s && *e == '\0' ? 0 : -1;
+}
+
+/*
+ * local midnight of the day a log is named for, -1 if it isn't one
+ */
+static time_t
+qlogday(const char *path, int *kindp)
+{
+    struct tm tm;
+    const char *name;
+    char suffix[4];
+
+    name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    memset((void *)&tm, 0, sizeof(tm));
+    if (strlen(name) != 14 ||
+        sscanf(name, "%4d.%2d.%2d.%3s", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               suffix) != 4) {
+        return (time_t)-1;
+    }
+    if (strcmp(suffix, "fwx") == 0) {
+        *kindp = QCSV;
+    } else if (strcmp(suffix, "fwp") == 0) {
+        *kindp = QPACKED;
+    } else if (strcmp(suffix, "fwb") == 0) {
+        *kindp = QBINARY;
+    } else {
+        return (time_t)-1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/*
+ * the day after local midnight day
+ */
+static time_t
+qnextday(time_t day)
+{
+    struct tm tm;
+
+    (void)localtime_r(&day, &tm);
+    ++tm.tm_mday;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+static int
+qaddfile(const char *path, time_t day, int kind)
+{
+    qfile_t *qp;
+
+    /* days that are all outside the span aren't worth a task */
+    if (day != (time_t)-1 &&
+        ((int64_t)qnextday(day) <= qfrom || (int64_t)day >= qto)) {
+        return 0;
+    }
+    if (qnfiles == qcapfiles) {
+        qcapfiles = qcapfiles ? qcapfiles * 2 : 1024;
+        if (!(qfiles = realloc(qfiles, (size_t)qcapfiles * sizeof(qfile_t)))) {
+            perror("realloc");
+            return -1;
+        }
+    }
+    qp = &qfiles[qnfiles++];
+    memset((void *)qp, 0, sizeof(qfile_t));
+    strncpy(qp->path, path, sizeof(qp->path)-1);
+    qp->day = day;
+    qp->kind = kind;
+    return 0;
+}
+
+static int
+qcmpfile(const void *a, const void *b)
+{
+    const qfile_t *ap = a;
+    const qfile_t *bp = b;
+
+    if (ap->day != bp->day) {
+        return ap->day < bp->day ? -1 : 1;
+    }
+    /* the quickest to read first, it's the one we'll keep */
+    return bp->kind - ap->kind;
+}
+
+/*
+ * every daily log in dir, one per day in day order
+ */
+static int
+qadddir(const char *dir)
+{
+    char path[FILENAME_MAX];
+    struct dirent *dp;
+    time_t day;
+    DIR *d;
+    int first;
+    int kind;
+    int i;
+    int j;
+
+    if (!(d = opendir(dir))) {
+        perror(dir);
+        return -1;
+    }
+    first = qnfiles;
+    while ((dp = readdir(d))) {
+        if ((day = qlogday(dp->d_name, &kind)) == (time_t)-1) {
+            continue;
+        }
+        (void)snprintf(path, sizeof(path), "%s/%s", dir, dp->d_name);
+        if (qaddfile(path, day, kind) != 0) {
+            (void)closedir(d);
+            return -1;
+        }
+    }
+    (void)closedir(d);
+    qsort(&qfiles[first], (size_t)(qnfiles - first), sizeof(qfile_t), qcmpfile);
+    for (i = j = first; i < qnfiles; ++i) {
+        if (j == first || qfiles[j-1].day != qfiles[i].day) {
+            qfiles[j++] = qfiles[i];
+        }
+    }
+    qnfiles = j;
+    return 0;
+}
+
+static int
+qout(qfile_t *qp, const char *s, size_t len)
+{
+    char *p;
+
+    if (qp->len + len > qp->cap) {
+        qp->cap = qp->cap ? qp->cap * 2 : 65536;
+        while (qp->len + len > qp->cap) {
+            qp->cap *= 2;
+        }
+        if (!(p = realloc(qp->out, qp->cap))) {
+            perror("realloc");
+            return -1;
+        }
+        qp->out = p;
+    }
+    memcpy(&qp->out[qp->len], s, len);
+    qp->len += len;
+    return 0;
+}
+
+/*
+ * the index for a CSV log, from next to it if that's current or made
+ * (and put there if we can), *np entries
+ */
+static qindex_t *
+qindex(const char *path, const struct stat *stp, const char *base, uint64_t *np)
+{
+    char ipath[FILENAME_MAX];
+    char tpath[FILENAME_MAX + 32];
+    qindexhdr_t hdr;
+    fwxbrec_t rec;
+    qindex_t *ip;
+    qindex_t *nip;
+    const char *p;
+    const char *nl;
+    const char *end;
+    uint64_t cap;
+    uint64_t n;
+    size_t len;
+    int keep;
+    int fd;
+    int rc;
+    int i;
+
+    /* only %Y.%m.%d.fwx has somewhere obvious to keep one */
+    len = strlen(path);
+    keep = len > 4 && strcmp(&path[len - 4], ".fwx") == 0;
+    strcpy(ipath, path);
+    if (keep) {
+        strcpy(&ipath[len - 4], ".fwi");
+    }
+
+    if (keep && (fd = open(ipath, O_RDONLY)) != -1) {
+        if (read(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+            memcmp(hdr.magic, INDEXMAGIC, sizeof(hdr.magic)) == 0 &&
+            hdr.step == INDEXSTEP && hdr.size == (int64_t)stp->st_size &&
+            hdr.mtime == (int64_t)stp->st_mtime && hdr.n < (uint64_t)stp->st_size &&
+            (ip = malloc((size_t)(hdr.n ? hdr.n : 1) * sizeof(qindex_t))) != NULL) {
+            if (read(fd, ip, (size_t)hdr.n * sizeof(qindex_t)) ==
+                (ssize_t)(hdr.n * sizeof(qindex_t))) {
+                (void)close(fd);
+                *np = hdr.n;
+                return ip;
+            }
+            free(ip);
+        }
+        (void)close(fd);
+    }
+
+    cap = (uint64_t)stp->st_size / (INDEXSTEP * 32) + 1;
+    if (!(ip = malloc((size_t)cap * sizeof(qindex_t)))) {
+        perror("malloc");
+        return (qindex_t *)0;
+    }
+    end = base + stp->st_size;
+    n = 0;
+    for (p = base; p < end; ) {
+        (void)fwxbscancsv(p, end, &rec, &rc);
+        if (rc == 0) {
+            if (n == cap) {
+                cap *= 2;
+                if (!(nip = realloc(ip, (size_t)cap * sizeof(qindex_t)))) {
+                    perror("realloc");
+                    free(ip);
+                    return (qindex_t *)0;
+                }
+                ip = nip;
+            }
+            ip[n].time = rec.time;
+            ip[n].off = (uint64_t)(p - base);
+            ++n;
+        }
+        /* the next entry starts INDEXSTEP lines on */
+        for (i = 0; i < INDEXSTEP && p < end; ++i) {
+            p = (nl = memchr(p, '\n', (size_t)(end - p))) ? nl + 1 : end;
+        }
+    }
+
+    *np = n;
+    if (!keep) {
+        return ip;
+    }
+
+    /* leave it for next time if we're allowed, it's only a cache */
+    memset((void *)&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, INDEXMAGIC, sizeof(hdr.magic));
+    hdr.step = INDEXSTEP;
+    hdr.size = (int64_t)stp->st_size;
+    hdr.mtime = (int64_t)stp->st_mtime;
+    hdr.n = n;
+    (void)snprintf(tpath, sizeof(tpath), "%s.%ld", ipath, (long)getpid());
+    if ((fd = open(tpath, O_WRONLY|O_CREAT|O_TRUNC, 0644)) != -1) {
+        if (write(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+            write(fd, ip, (size_t)n * sizeof(qindex_t)) == (ssize_t)(n * sizeof(qindex_t)) &&
+            close(fd) == 0) {
+            (void)rename(tpath, ipath);
+        } else {
+            (void)unlink(tpath);
+        }
+    }
+    return ip;
+}
+
+/*
+ * one record in the span, summaries keep the rain going by the yearly
+ * total like the rollups do
+ */
+static int
+qrec(qfile_t *qp, const fwxbrec_t *rp, fwxrrec_t *sump, long *rainlastp)
+{
+    char str[LINEMAX];
+    long v;
+    int rain;
+
+    if (!qsummary) {
+        return qout(qp, str, (size_t)(fwxbfmtcsv(str, rp) - str));
+    }
+    rain = 0;
+    if (FWXB_ISVALID(rp, FWXB_RAINYEAR)) {
+        v = FWXB_GETVAL(rp, FWXB_RAINYEAR);
+        if (*rainlastp >= 0 && v > *rainlastp) {
+            rain = (int)(v - *rainlastp);
+        }
+        *rainlastp = v;
+    }
+    fwxradd(sump, qp->day != (time_t)-1 ? (int64_t)qp->day : rp->time, rp, rain);
+    return 0;
+}
+
+static void
+qscanbin(qfile_t *qp, const char *base, size_t size, fwxrrec_t *sump, long *rainlastp)
+{
+    const fwxbhdr_t *hp;
+    const fwxbrec_t *rp;
+    size_t nrecs;
+    size_t lo;
+    size_t hi;
+    size_t mid;
+
+    hp = (const fwxbhdr_t *)base;
+    if (size < sizeof(fwxbhdr_t) || fwxbhdrcheck(hp) != 0) {
+        fprintf(stderr, "%s: not a log file we can read\n", qp->path);
+        return;
+    }
+#define REC(i)  ((const fwxbrec_t *)(base + hp->hdrsize + (i) * hp->recsize))
+    nrecs = (size - hp->hdrsize) / hp->recsize;
+    lo = 0;
+    hi = nrecs;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (REC(mid)->time < qfrom) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < nrecs && (rp = REC(lo))->time < qto; ++lo) {
+        if (qrec(qp, rp, sump, rainlastp) != 0) {
+            return;
+        }
+    }
+#undef REC
+}
+
+static void
+qscanpacked(qfile_t *qp, const char *base, size_t size, fwxrrec_t *sump, long *rainlastp)
+{
+    fwxbrec_t recs[FWXP_BLOCKRECS];
+    const fwxphdr_t *hp;
+    const fwxpidx_t *ip;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+    int n;
+    int i;
+
+    hp = (const fwxphdr_t *)base;
+    if (fwxphdrcheck(hp, size) != 0) {
+        fprintf(stderr, "%s: not a packed archive we can read\n", qp->path);
+        return;
+    }
+    /* the first block that ends in the span */
+    lo = 0;
+    hi = hp->nblocks;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (FWXP_IDX(hp, mid)->last < qfrom) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < hp->nblocks && (ip = FWXP_IDX(hp, lo))->first < qto; ++lo) {
+        if (ip->off > size || ip->len > size - ip->off ||
+            (n = fwxpunpack(base + ip->off, ip->len, recs)) < 0) {
+            fprintf(stderr, "%s: block %u is bad\n", qp->path, lo);
+            return;
+        }
+        for (i = 0; i < n && recs[i].time < qto; ++i) {
+            if (recs[i].time >= qfrom && qrec(qp, &recs[i], sump, rainlastp) != 0) {
+                return;
+            }
+        }
+    }
+}
+
+static void
+qscancsv(qfile_t *qp, const char *base, const struct stat *stp, fwxrrec_t *sump,
+         long *rainlastp)
+{
+    fwxbrec_t rec;
+    qindex_t *ip;
+    const char *p;
+    const char *end;
+    uint64_t n;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t mid;
+    int rc;
+
+    if (!(ip = qindex(qp->path, stp, base, &n))) {
+        return;
+    }
+    /* the last entry before the span, the span starts in its run */
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ip[mid].time < qfrom) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    p = base + (lo ? ip[lo - 1].off : 0);
+    free(ip);
+    end = base + stp->st_size;
+    while (p < end) {
+        p = fwxbscancsv(p, end, &rec, &rc);
+        if (rc != 0) {
+            ++qp->skipped;
+            continue;
+        }
+        if (rec.time < qfrom) {
+            continue;
+        }
+        if (rec.time >= qto || qrec(qp, &rec, sump, rainlastp) != 0) {
+            break;
+        }
+    }
+}
+
+static void
+qscan(qfile_t *qp)
+{
+    char str[LINEMAX * 4];
+    fwxrrec_t sum;
+    struct stat st;
+    void *base;
+    long rainlast;
+    int fd;
+
+    if ((fd = open(qp->path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(qp->path);
+        if (fd != -1) {
+            (void)close(fd);
+        }
+        return;
+    }
+    if (st.st_size == 0) {
+        (void)close(fd);
+        return;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+    memset((void *)&sum, 0, sizeof(sum));
+    rainlast = -1;
+    if (st.st_size >= 4 && memcmp(base, FWXB_MAGIC, 4) == 0) {
+        qscanbin(qp, base, (size_t)st.st_size, &sum, &rainlast);
+    } else if (st.st_size >= 4 && memcmp(base, FWXP_MAGIC, 4) == 0) {
+        qscanpacked(qp, base, (size_t)st.st_size, &sum, &rainlast);
+    } else {
+        qscancsv(qp, base, &st, &sum, &rainlast);
+    }
+    (void)munmap(base, (size_t)st.st_size);
+    if (qsummary && sum.n) {
+        (void)qout(qp, str, (size_t)(fwxrfmtcsv(str, &sum) - str));
+    }
+}
+
+/*
+ * our own next task or, failing that, the last one of somebody else's,
+ * -1 when there's nothing left anywhere
+ */
+static int
+qtake(int id)
+{
+    qdeque_t *dp;
+    int task;
+    int i;
+
+    for (i = 0; i < qnjobs; ++i) {
+        dp = &qdeques[(id + i) % qnjobs];
+        task = -1;
+        pthread_mutex_lock(&dp->lock);
+        if (dp->head < dp->tail) {
+            task = i == 0 ? dp->head++ : --dp->tail;
+        }
+        pthread_mutex_unlock(&dp->lock);
+        if (task != -1) {
+            return task;
+        }
+    }
+    return -1;
+}
+
+static void *
+qworker(void *arg)
+{
+    int task;
+    int id;
+
+    id = (int)(intptr_t)arg;
+    while ((task = qtake(id)) != -1) {
+        qscan(&qfiles[task]);
+        pthread_mutex_lock(&qdonelock);
+        qfiles[task].done = 1;
+        pthread_cond_broadcast(&qdonecond);
+        pthread_mutex_unlock(&qdonelock);
+    }
+    return (void *)0;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t tids[MAXJOBS];
+    struct stat st;
+    time_t day;
+    int kind;
+    int skipped;
+    int rc;
+    int c;
+    int i;
+
+    qnjobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    while ((c = getopt(argc, argv, "f:j:st:")) != -1) {
+        switch (c) {
+        case 'f':
+            if (qparsetime(optarg, &qfrom) != 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                return 1;
+            }
+            break;
+        case 'j':
+            qnjobs = (int)strtol(optarg, (char **)0, 0);
+            break;
+        case 's':
+            ++qsummary;
+            break;
+        case 't':
+            if (qparsetime(optarg, &qto) != 0) {
+                fprintf(stderr, USAGE, argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+    if (qnjobs < 1) {
+        qnjobs = 1;
+    } else if (qnjobs > MAXJOBS) {
+        qnjobs = MAXJOBS;
+    }
+
+    for (i = optind; i < argc; ++i) {
+        if (stat(argv[i], &st) == -1) {
+            perror(argv[i]);
+            return 1;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            rc = qadddir(argv[i]);
+        } else {
+            /* a file that isn't named for a day is told apart by its magic */
+            kind = QCSV;
+            day = qlogday(argv[i], &kind);
+            rc = qaddfile(argv[i], day, kind);
+        }
+        if (rc != 0) {
+            return 1;
+        }
+    }
+    if (qnfiles == 0) {
+        return 0;
+    }
+    if (qnjobs > qnfiles) {
+        qnjobs = qnfiles;
+    }
+
+    /* a run of consecutive days each */
+    for (i = 0; i < qnjobs; ++i) {
+        pthread_mutex_init(&qdeques[i].lock, (pthread_mutexattr_t *)0);
+        qdeques[i].head = (int)((int64_t)qnfiles * i / qnjobs);
+        qdeques[i].tail = (int)((int64_t)qnfiles * (i + 1) / qnjobs);
+    }
+    for (i = 0; i < qnjobs; ++i) {
+        if ((errno = pthread_create(&tids[i], (pthread_attr_t *)0, qworker,
+                                    (void *)(intptr_t)i)) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    skipped = 0;
+    for (i = 0; i < qnfiles; ++i) {
+        pthread_mutex_lock(&qdonelock);
+        while (!qfiles[i].done) {
+            pthread_cond_wait(&qdonecond, &qdonelock);
+        }
+        pthread_mutex_unlock(&qdonelock);
+        if (qfiles[i].len && fwrite(qfiles[i].out, qfiles[i].len, 1, stdout) != 1) {
+            perror("fwrite");
+            return 1;
+        }
+        free(qfiles[i].out);
+        qfiles[i].out = (char *)0;
+        skipped += qfiles[i].skipped;
+    }
+    for (i = 0; i < qnjobs; ++i) {
+        (void)pthread_join(tids[i], (void **)0);
+    }
+    if (skipped) {
+        fprintf(stderr, "%d lines couldn't be parsed, skipped\n", skipped);
+    }
+    return fflush(stdout) == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Rollups of the daily log, kept up to date as samples are logged:
+ * per minute slots in %Y.%m.%d.fwm, per hour in %Y.fwh and per day in
+ * %Y.fwd.  Each file is a header and a slot for every period it could
+ * cover, so slot n is always at hdrsize + n * recsize and is updated
+ * in place.  Minute and hour slots are counted in seconds from start,
+ * so a DST change just leaves a slot empty or makes one more, day
+ * slots follow the local day of the year.
+ *
+ * Fields and their scaling are those of the binary log, see fwxbin.h
+ * (which must be included first).  Rain is what fell during the slot
+ * going by the yearly total.  Everything is in host byte order.
+ *
+ * From 0.2 minute and hour slots are fwxrsrec_t, min and max stored
+ * like the binary log's values and a 16 bit count, which an hour at
+ * one sample a second doesn't get near, about half the size of the
+ * fwxrrec_t day slots still use.  fwxrget() reads either as an
+ * fwxrrec_t, both start with the same start, n and rain.
+ */
+
+#define FWXR_MAGIC      "FWXR"
+#define FWXR_VERMAJ     0
+#define FWXR_VERMIN     2
+
+#define FWXR_MINUTE     0               /* period of a file's slots */
+#define FWXR_HOUR       1
+#define FWXR_DAY        2
+#define FWXR_NPERIODS   3
+
+#define FWXR_MINSLOTS   (25 * 60)       /* a day, with room for DST */
+#define FWXR_HOURSLOTS  (367 * 24)      /* a leap year, ditto */
+#define FWXR_DAYSLOTS   366
+
+typedef struct fwxrhdr {
+    char magic[4];                      /* FWXR_MAGIC, no terminator */
+    uint16_t bom;                       /* FWXB_BOM as written */
+    uint16_t vermaj;                    /* FWXR_VERMAJ */
+    uint16_t vermin;                    /* FWXR_VERMIN */
+    uint16_t hdrsize;                   /* bytes before the first slot */
+    uint16_t recsize;                   /* bytes per slot */
+    uint16_t nfields;                   /* columns per slot */
+    uint16_t period;                    /* FWXR_MINUTE, _HOUR or _DAY */
+    uint16_t nslots;
+    int32_t rainlast;                   /* last yearly rain total seen, or -1 */
+    int64_t start;                      /* local midnight starting the file */
+    uint8_t spare[8];
+} fwxrhdr_t;
+
+typedef struct fwxrcol {
+    int32_t min;
+    int32_t max;
+    int64_t sum;                        /* the mean is sum / n */
+    uint32_t n;                         /* samples this field was valid in */
+    uint32_t spare;
+} fwxrcol_t;
+
+typedef struct fwxrrec {
+    int64_t start;                      /* first second the slot covers, 0 if unused */
+    uint32_t n;                         /* samples */
+    int32_t rain;                       /* hundredths of an inch that fell */
+    fwxrcol_t col[FWXB_NFIELDS];
+} fwxrrec_t;
+
+typedef struct fwxrscol {
+    int32_t sum;
+    uint16_t min;                       /* signed fields stored 2's comp */
+    uint16_t max;
+    uint16_t n;
+    uint16_t spare;
+} fwxrscol_t;
+
+typedef struct fwxrsrec {
+    int64_t start;                      /* as in fwxrrec_t */
+    uint32_t n;
+    int32_t rain;
+    fwxrscol_t col[FWXB_NFIELDS];
+} fwxrsrec_t;
+
+/* a short column's min or max, like FWXB_GETVAL() */
+#define FWXR_SGET(cp, m, n)     (fwxbcols[n].issigned ? \
+                                 (long)(int16_t)(cp)->m : (long)(cp)->m)
+
+/* slots of hp are fwxrsrec_t */
+#define FWXR_SHORT(hp)          ((hp)->period != FWXR_DAY && (hp)->vermin >= 2)
+
+#define FWXR_SLOT(hp, i)        ((void *)((char *)(hp) + (hp)->hdrsize + \
+                                          (size_t)(i) * (hp)->recsize))
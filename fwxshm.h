@@ -0,0 +1,39 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Shared memory segment fwx publishes each sample to when FWXSHM is
+ * set, the latest sample plus a ring of recent ones, all as fwxbin.h
+ * records.  fwx is the only writer, readers map it read only and
+ * take snapshots under the seqlock: seq is odd while an update is in
+ * progress and bumped again when it's done, a copy made between two
+ * reads of the same even seq is good.  libfwxshm (fwxshmread.c) does
+ * that for you.  Needs <stdint.h>, <stdatomic.h> and fwxbin.h.
+ */
+
+#define FWXSHM_MAGIC    "FWXS"
+#define FWXSHM_VERMAJ   1               /* layout changed incompatibly */
+#define FWXSHM_VERMIN   0               /* added to at the end */
+#define FWXSHM_RING     256             /* recent samples kept */
+
+typedef struct fwxshm {
+    char magic[4];                      /* FWXSHM_MAGIC, set last */
+    uint16_t vermaj;                    /* FWXSHM_VERMAJ */
+    uint16_t vermin;                    /* FWXSHM_VERMIN */
+    uint32_t size;                      /* sizeof(fwxshm_t) */
+    uint32_t nring;                     /* FWXSHM_RING */
+    _Atomic uint32_t seq;               /* odd while being written */
+    uint32_t pid;                       /* of the writer */
+    uint64_t count;                     /* samples published, ever */
+    fwxbrec_t latest;                   /* newest sample */
+    fwxbrec_t ring[FWXSHM_RING];        /* count % nring is next */
+} fwxshm_t;
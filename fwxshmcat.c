@@ -0,0 +1,96 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * fwxshmcat - print samples from fwx's shared memory segment as
+ * README.datafile lines, the latest one by default, the last n with
+ * -n, and with -f keep printing new ones as they're published.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fwxbin.h"
+#include "fwxshm.h"
+
+#define USAGE "usage:\n%s [-f] [-n <count>] [-s <segment>]\n"
+#define SHMNAME "/fwx"
+#define FOLLOWUS 250000         /* us between looks with -f */
+
+/* from fwxbin.c */
+extern char *fwxbfmtcsv(char *s, const fwxbrec_t *rp);
+/* from fwxshmread.c */
+extern fwxshm_t *fwxshmopen(const char *name);
+extern int fwxshmrecent(const fwxshm_t *sp, fwxbrec_t *rp, int max, uint64_t *countp);
+
+int
+main(int argc, char **argv)
+{
+    static fwxbrec_t recs[FWXSHM_RING];
+    const char *name;
+    fwxshm_t *sp;
+    uint64_t count;
+    uint64_t seen;
+    char str[512];
+    int follow;
+    int max;
+    int n;
+    int i;
+    int c;
+
+    name = SHMNAME;
+    follow = 0;
+    max = 1;
+    while ((c = getopt(argc, argv, "fn:s:")) != -1) {
+        switch (c) {
+        case 'f':
+            ++follow;
+            break;
+        case 'n':
+            max = atoi(optarg);
+            break;
+        case 's':
+            name = optarg;
+            break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 1;
+        }
+    }
+    if (!(sp = fwxshmopen(name))) {
+        fprintf(stderr, "%s: no fwx segment\n", name);
+        return 1;
+    }
+    n = fwxshmrecent(sp, recs, max, &seen);
+    for (i = 0; i < n; ++i) {
+        (void)fwxbfmtcsv(str, &recs[i]);
+        fputs(str, stdout);
+    }
+    while (follow) {
+        fflush(stdout);
+        (void)usleep(FOLLOWUS);
+        n = fwxshmrecent(sp, recs, FWXSHM_RING, &count);
+        /* only what's new, if we fell a whole ring behind so be it */
+        i = count - seen < (uint64_t)n ? n - (int)(count - seen) : 0;
+        for (; i < n; ++i) {
+            (void)fwxbfmtcsv(str, &recs[i]);
+            fputs(str, stdout);
+        }
+        seen = count;
+    }
+    return 0;
+}
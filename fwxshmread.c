@@ -0,0 +1,152 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * libfwxshm - reader side of the fwxshm.h segment.  Nothing here
+ * blocks or takes a lock, a reader that collides with an update just
+ * copies again.
+ *
+ *     fwxshm_t *sp = fwxshmopen("/fwx");
+ *     fwxbrec_t rec;
+ *     if (sp && fwxshmlatest(sp, &rec, (uint64_t *)0) == 0) ...
+ *
+ * The segment outlives fwx, so check rec.time if staleness matters.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include "fwxbin.h"
+#include "fwxshm.h"
+
+#define SPINS 100               /* collisions before yielding the cpu */
+
+fwxshm_t *
+fwxshmopen(const char *name)
+{
+    struct stat st;
+    fwxshm_t *sp;
+    int fd;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1) {
+        return (fwxshm_t *)0;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(fwxshm_t)) {
+        (void)close(fd);
+        return (fwxshm_t *)0;
+    }
+    sp = mmap((void *)0, sizeof(fwxshm_t), PROT_READ, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (sp == MAP_FAILED) {
+        return (fwxshm_t *)0;
+    }
+    if (memcmp(sp->magic, FWXSHM_MAGIC, sizeof(sp->magic)) != 0 ||
+        sp->vermaj != FWXSHM_VERMAJ || sp->size < sizeof(fwxshm_t) ||
+        sp->nring != FWXSHM_RING) {
+        (void)munmap((void *)sp, sizeof(fwxshm_t));
+        return (fwxshm_t *)0;
+    }
+    return sp;
+}
+
+void
+fwxshmclose(fwxshm_t *sp)
+{
+    (void)munmap((void *)sp, sizeof(fwxshm_t));
+}
+
+static uint32_t
+fwxshmbegin(const fwxshm_t *sp, int *spins)
+{
+    uint32_t seq;
+
+    while ((seq = atomic_load_explicit(&((fwxshm_t *)sp)->seq,
+                                       memory_order_acquire)) & 1) {
+        if (++*spins % SPINS == 0) {
+            (void)sched_yield();
+        }
+    }
+    return seq;
+}
+
+static int
+fwxshmretry(const fwxshm_t *sp, uint32_t seq)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&((fwxshm_t *)sp)->seq,
+                                memory_order_relaxed) != seq;
+}
+
+/*
+ * the newest sample and how many have been published, -1 if there
+ * haven't been any yet
+ */
+int
+fwxshmlatest(const fwxshm_t *sp, fwxbrec_t *rp, uint64_t *countp)
+{
+    uint64_t count;
+    uint32_t seq;
+    int spins;
+
+    spins = 0;
+    do {
+        seq = fwxshmbegin(sp, &spins);
+        memcpy(rp, (const void *)&sp->latest, sizeof(fwxbrec_t));
+        count = sp->count;
+    } while (fwxshmretry(sp, seq));
+    if (countp) {
+        *countp = count;
+    }
+    return count ? 0 : -1;
+}
+
+/*
+ * up to max of the most recent samples, oldest first, returns how
+ * many were copied.  countp gets the count the copy goes up to.
+ */
+int
+fwxshmrecent(const fwxshm_t *sp, fwxbrec_t *rp, int max, uint64_t *countp)
+{
+    uint64_t count;
+    uint32_t seq;
+    int spins;
+    int first;
+    int n;
+    int i;
+
+    if (max > FWXSHM_RING) {
+        max = FWXSHM_RING;
+    }
+    spins = 0;
+    do {
+        seq = fwxshmbegin(sp, &spins);
+        count = sp->count;
+        n = count < (uint64_t)max ? (int)count : max;
+        first = (int)((count - n) % FWXSHM_RING);
+        for (i = 0; i < n; ++i) {
+            memcpy(&rp[i], (const void *)&sp->ring[(first + i) % FWXSHM_RING],
+                   sizeof(fwxbrec_t));
+        }
+    } while (fwxshmretry(sp, seq));
+    if (countp) {
+        *countp = count;
+    }
+    return n;
+}
@@ -0,0 +1,527 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * fwxsim - pretend to be a Vantage Pro console on a pty so fwx can
+ * be run (and timed) without a station on the wire.  The slave side
+ * of the pty is printed on stdout, point fwx's -d at it.
+ *
+ * Only what fwx uses is answered: a bare newline wakes the console
+ * ("\n\r"), WRD gets an ACK and the Vantage Pro ident, and LOOP n
+ * gets an ACK followed by n packets, any further input cancels the
+ * LOOP like it does on the real thing.  LPS 3 n alternates LOOP and
+ * LOOP2 packets, -1 makes fwxsim play an older console that refuses
+ * LPS.  Packets are synthetic unless
+ * -f names a file of raw 99 byte LOOP packets, which is replayed
+ * round and round.  With -e n every nth packet loses a byte, which
+ * is good for exercising fwx's resync.
+ *
+ * DMPAFT is answered out of an archive of -a records (a day's worth
+ * by default) five minutes apart ending when fwxsim started, with -e
+ * every nth page goes out corrupted the first time.
+ *
+ * With -p fwxsim plays a WeatherLinkIP instead, listening on that TCP
+ * port on the loopback address and printing 127.0.0.1:port for fwx's
+ * -d.  One connection is served at a time, when it closes the next
+ * one is accepted.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "davis.h"
+
+#define USAGE "usage:\n%s [-1] [-r <secs between packets>] [-e <n>] [-f <loopfile>] [-a <records>] [-p <port>]\n"
+
+#define ACK 0x06
+#define CMDLEN 64
+#define ARCHIVEINTERVAL 300     /* secs between archive records */
+#define ARCHIVESKEW 2           /* first record's slot in its page */
+
+/* DMPAFT progress */
+#define DMPIDLE 0
+#define DMPSTAMP 1              /* waiting for the time stamp */
+#define DMPPAGES 2              /* sending pages */
+
+/* from support.c */
+extern int64_t wxmsnow(void);
+/* from crc.c */
+extern int wxcrc(unsigned char *buf, int len);
+extern unsigned short wxcrcupdate(unsigned short crc, unsigned char c);
+/* from synth.c */
+extern void wxsynthloop(vploopdata_t *ld, unsigned int n);
+extern void wxsynthloop2(vploop2data_t *l2, unsigned int n);
+extern void wxpageseal(vparchpage_t *pp);
+extern void wxsyntharch(vparchive_t *ap, time_t t, unsigned int n);
+
+static vploopdata_t *simrec;    /* recorded packets from -f */
+static size_t simnrec;
+
+static vparchive_t *simarch;    /* the archive, ARCHIVESKEW empty slots first */
+static unsigned int simnarch;
+static int simdmp = DMPIDLE;
+static unsigned int simpage;    /* next page to send */
+static unsigned int simpages;   /* of this many */
+static unsigned int simsentpages;
+static int simevery;
+static int simlps = 1;          /* answer LPS */
+static int simlooptype;         /* what's going out, LOOP or LPS */
+
+static int
+simload(const char *path)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)VPLOOPSIZE) {
+        fprintf(stderr, "%s: no LOOP packets\n", path);
+        (void)close(fd);
+        return -1;
+    }
+    simnrec = st.st_size / VPLOOPSIZE;
+    if (!(simrec = malloc(simnrec * VPLOOPSIZE))) {
+        perror("malloc");
+        (void)close(fd);
+        return -1;
+    }
+    if (read(fd, simrec, simnrec * VPLOOPSIZE) != (ssize_t)(simnrec * VPLOOPSIZE)) {
+        perror(path);
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+    return 0;
+}
+
+/*
+ * a listening socket on the loopback address
+ */
+static int
+simlisten(int port)
+{
+    struct sockaddr_in sin;
+    int on;
+    int s;
+
+    if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+        perror("socket");
+        return -1;
+    }
+    on = 1;
+    (void)setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset((void *)&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+        listen(s, 1) == -1) {
+        perror("bind");
+        (void)close(s);
+        return -1;
+    }
+    return s;
+}
+
+static int
+simsend(int fd, const void *buf, size_t len)
+{
+    const char *p;
+    ssize_t rc;
+
+    p = buf;
+    while (len) {
+        if ((rc = write(fd, p, len)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return -1;
+        }
+        p += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+static int
+simarchinit(unsigned int n)
+{
+    unsigned int i;
+    time_t t;
+
+    simnarch = n;
+    if (!(simarch = malloc((n + ARCHIVESKEW + VPARCHPERPAGE) * VPARCHSIZE))) {
+        perror("malloc");
+        return -1;
+    }
+    memset((void *)simarch, 0xff, (n + ARCHIVESKEW + VPARCHPERPAGE) * VPARCHSIZE);
+    t = time((time_t *)0);
+    t -= t % ARCHIVEINTERVAL;
+    for (i = 0; i < n; ++i) {
+        wxsyntharch(&simarch[ARCHIVESKEW + i], t - (time_t)(n - 1 - i) * ARCHIVEINTERVAL, i);
+    }
+    return 0;
+}
+
+/*
+ * records are picked by comparing packed date and time stamps, the
+ * same thing the console does
+ */
+static unsigned long
+simstamp(const vparchive_t *ap)
+{
+    return (unsigned long)get_d_16(ap->date) << 16 | get_d_16(ap->time);
+}
+
+/*
+ * the time stamp after DMPAFT, ACK it and say how many pages follow
+ */
+static void
+simdmpstamp(int fd, const unsigned char *req)
+{
+    static const unsigned char ack = ACK;
+    unsigned char hdr[6];
+    unsigned short crc;
+    unsigned long want;
+    unsigned int i;
+
+    if (!wxcrc((unsigned char *)req, 6)) {
+        hdr[0] = 0x18;
+        (void)simsend(fd, hdr, 1);
+        simdmp = DMPIDLE;
+        return;
+    }
+    (void)simsend(fd, &ack, 1);
+    want = (unsigned long)(req[0] | req[1] << 8) << 16 | (req[2] | req[3] << 8);
+    for (i = 0; i < simnarch; ++i) {
+        if (want == 0 || simstamp(&simarch[ARCHIVESKEW + i]) > want) {
+            break;
+        }
+    }
+    i += ARCHIVESKEW;
+    /* pages from the one holding record i through the newest */
+    simpage = i / VPARCHPERPAGE;
+    if (i >= simnarch + ARCHIVESKEW) {
+        simpages = 0;
+    } else {
+        simpages = (simnarch + ARCHIVESKEW - 1) / VPARCHPERPAGE + 1 - simpage;
+    }
+    hdr[0] = simpages & 0xff;
+    hdr[1] = simpages >> 8;
+    hdr[2] = (i % VPARCHPERPAGE) & 0xff;
+    hdr[3] = 0;
+    for (crc = 0, i = 0; i < 4; ++i) {
+        crc = wxcrcupdate(crc, hdr[i]);
+    }
+    hdr[4] = crc >> 8;
+    hdr[5] = crc & 0xff;
+    (void)simsend(fd, hdr, sizeof(hdr));
+    simpages += simpage;        /* now the page to stop at */
+    simdmp = simpages > simpage ? DMPPAGES : DMPIDLE;
+}
+
+static void
+simdmpsend(int fd, int again)
+{
+    vparchpage_t page;
+
+    memset((void *)&page, 0, sizeof(page));
+    page.seq = simpage & 0xff;
+    memcpy(page.rec, &simarch[simpage * VPARCHPERPAGE], sizeof(page.rec));
+    wxpageseal(&page);
+    if (!again && simevery && ++simsentpages % simevery == 0) {
+        page.rec[1].bar ^= 1;   /* fwx should NAK this one */
+    }
+    (void)simsend(fd, &page, sizeof(page));
+}
+
+/*
+ * ACK, NAK or ESC while pages are going out, returns 0 for anything
+ * else so it's treated as a command
+ */
+static int
+simdmpreply(int fd, unsigned char c)
+{
+    switch (c) {
+    case ACK:
+        /* the first ACK is for the page count, none comes after the last page */
+        if (simpage < simpages) {
+            simdmpsend(fd, 0);
+            ++simpage;
+        } else {
+            simdmp = DMPIDLE;
+        }
+        return 1;
+    case VPNAK:
+        if (simpage > 0) {
+            --simpage;
+            simdmpsend(fd, 1);
+            ++simpage;
+        }
+        return 1;
+    case VPESC:
+        simdmp = DMPIDLE;
+        return 1;
+    }
+    simdmp = DMPIDLE;
+    return 0;
+}
+
+/*
+ * act on one command line, returns the number of LOOP packets wanted
+ */
+static int
+simcmd(int fd, const char *cmd, size_t len, int nl)
+{
+    static const unsigned char ident[] = { ACK, IDENT_VP };
+    static const unsigned char ack = ACK;
+    int n;
+
+    if (len == 0) {
+        return nl ? simsend(fd, "\n\r", 2) : 0;
+    }
+    if (len >= 3 && strncmp(cmd, "WRD", 3) == 0) {
+        (void)simsend(fd, ident, sizeof(ident));
+        return 0;
+    }
+    if (len == 6 && strncmp(cmd, "DMPAFT", 6) == 0) {
+        (void)simsend(fd, &ack, 1);
+        simdmp = DMPSTAMP;
+        return 0;
+    }
+    if (len > 5 && strncmp(cmd, "LOOP ", 5) == 0) {
+        if ((n = atoi(&cmd[5])) > 0) {
+            (void)simsend(fd, &ack, 1);
+            simlooptype = 1;
+            return n;
+        }
+    }
+    if (simlps && len > 6 && strncmp(cmd, "LPS 3 ", 6) == 0) {
+        if ((n = atoi(&cmd[6])) > 0) {
+            (void)simsend(fd, &ack, 1);
+            simlooptype = 3;
+            return n;
+        }
+    }
+    fprintf(stderr, "fwxsim: ignoring %zu byte command\n", len);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct termios termios;
+    struct pollfd pfd;
+    vploopdata_t ld;
+    char cmd[CMDLEN];
+    unsigned int sent;
+    int64_t next;
+    size_t clen;
+    double rate;
+    char *slave;
+    int every;
+    int narch;
+    int master;
+    int port;
+    int ls;
+    int left;
+    int k;
+    int sfd;
+    int c;
+    int i;
+    int n;
+
+    rate = VPLOOPINTERVAL;
+    every = 0;
+    port = 0;
+    narch = 24 * 60 * 60 / ARCHIVEINTERVAL;
+    while ((c = getopt(argc, argv, "1a:e:f:p:r:")) != -1) {
+        switch (c) {
+        case '1':
+            simlps = 0;
+            break;
+        case 'a':
+            narch = atoi(optarg);
+            break;
+        case 'e':
+            every = atoi(optarg);
+            break;
+        case 'f':
+            if (simload(optarg) != 0) {
+                return 1;
+            }
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, USAGE, argv[0]);
+            return 1;
+        }
+    }
+    simevery = every;
+    if (narch < 0 || simarchinit((unsigned int)narch) != 0) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+
+    ls = -1;                    /* only listening with -p */
+    if (port) {
+        (void)signal(SIGPIPE, SIG_IGN);
+        if ((ls = simlisten(port)) == -1) {
+            return 1;
+        }
+        printf("127.0.0.1:%d\n", port);
+        fflush(stdout);
+        master = -1;
+    } else if ((master = posix_openpt(O_RDWR|O_NOCTTY)) == -1 ||
+        grantpt(master) == -1 || unlockpt(master) == -1 ||
+        !(slave = ptsname(master))) {
+        perror("pty");
+        return 1;
+    } else {
+        /* hold the slave open and raw so nothing is echoed before fwx shows up */
+        if ((sfd = open(slave, O_RDWR|O_NOCTTY)) == -1 ||
+            tcgetattr(sfd, &termios) == -1) {
+            perror(slave);
+            return 1;
+        }
+        cfmakeraw(&termios);
+        (void)tcsetattr(sfd, TCSANOW, &termios);
+        printf("%s\n", slave);
+        fflush(stdout);
+    }
+
+    clen = 0;
+    left = 0;
+    k = 0;
+    sent = 0;
+    next = 0;
+    pfd.fd = master;
+    pfd.events = POLLIN;
+    for (;;) {
+        if (master == -1) {
+            if ((master = accept(ls, (struct sockaddr *)0, (socklen_t *)0)) == -1) {
+                perror("accept");
+                return 1;
+            }
+            pfd.fd = master;
+            clen = 0;
+            left = 0;
+            simdmp = DMPIDLE;
+        }
+        n = left ? (int)(next - wxmsnow()) : -1;
+        if (left && n < 0) {
+            n = 0;
+        }
+        if (poll(&pfd, 1, n) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return 1;
+        }
+        if (pfd.revents & POLLIN) {
+            if ((n = read(master, &cmd[clen], sizeof(cmd) - clen)) <= 0) {
+                if (port && (n == 0 || errno != EINTR)) {
+                    (void)close(master);
+                    master = -1;    /* fwx hung up, wait for the next one */
+                }
+                continue;
+            }
+            /* anything at all stops a LOOP in progress */
+            left = 0;
+            clen += n;
+            for (i = 0; i < (int)clen; ++i) {
+                /* archive downloads talk in bytes, not lines */
+                if (simdmp == DMPSTAMP && clen - i >= 6) {
+                    simdmpstamp(master, (unsigned char *)&cmd[i]);
+                    memmove(cmd, &cmd[i + 6], clen - i - 6);
+                    clen -= i + 6;
+                    i = -1;
+                    continue;
+                }
+                if (simdmp == DMPSTAMP) {
+                    break;
+                }
+                if (simdmp == DMPPAGES && i == 0 &&
+                    simdmpreply(master, (unsigned char)cmd[0])) {
+                    memmove(cmd, &cmd[1], clen - 1);
+                    clen -= 1;
+                    i = -1;
+                    continue;
+                }
+                if (cmd[i] == '\n' || cmd[i] == '\r') {
+                    if ((n = simcmd(master, cmd, i, cmd[i] == '\n')) > 0) {
+                        left = n;
+                        next = wxmsnow();
+                        k = 0;
+                    }
+                    memmove(cmd, &cmd[i + 1], clen - i - 1);
+                    clen -= i + 1;
+                    i = -1;
+                }
+            }
+            if (clen == sizeof(cmd)) {
+                clen = 0;       /* garbage, forget it */
+            }
+        }
+        if (left && wxmsnow() >= next) {
+            if (simlooptype == 3 && k++ % 2) {
+                wxsynthloop2((vploop2data_t *)&ld, sent);
+            } else if (simnrec) {
+                memcpy(&ld, &simrec[sent % simnrec], VPLOOPSIZE);
+            } else {
+                wxsynthloop(&ld, sent);
+            }
+            ++sent;
+            if (every && sent % every == 0) {
+                /* lose a byte from the middle */
+                memmove((char *)&ld + 40, (char *)&ld + 41, VPLOOPSIZE - 41);
+                n = VPLOOPSIZE - 1;
+            } else {
+                n = VPLOOPSIZE;
+            }
+            if (simsend(master, &ld, n) != 0) {
+                if (!port) {
+                    return 1;
+                }
+                (void)close(master);
+                master = -1;
+                continue;
+            }
+            --left;
+            next += (int64_t)(rate * 1000);
+        }
+    }
+}
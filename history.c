@@ -0,0 +1,147 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Recent history kept column-wise.  A sample is a 32 bit time, a 32
+ * bit validity mask and one 16 bit raw value per wxfields[] row,
+ * about 40 bytes where a wxdat_t is closer to 500, so a week at a 2
+ * second interval fits in about 12M.  Each column is contiguous so
+ * walking one field over a span of time touches only that field.
+ *
+ * Everything lives in one allocation so it can be saved and restored
+ * as a block.  Index 0 is always the oldest sample held.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+/* from schema.c */
+extern const wxfield_t wxfields[];
+extern const int wxnfields;
+
+#define FIELD(wxdp, c)  ((const wxd_t *)((const char *)(wxdp) + wxfields[c].off))
+#define SLOT(hp, i)     (((hp)->n - wxhistcount(hp) + (i)) % (hp)->cap)
+
+int wxhistcount(const wxhist_t *hp);
+
+int
+wxhistinit(wxhist_t *hp, unsigned int cap)
+{
+    memset((void *)hp, 0, sizeof(wxhist_t));
+    if (wxnfields > 32) {
+        fprintf(stderr, "wxhistinit - %d fields won't fit the valid mask\n", wxnfields);
+        return -1;
+    }
+    hp->ncol = wxnfields;
+    hp->memlen = (size_t)cap * (2 * sizeof(uint32_t) + hp->ncol * sizeof(uint16_t));
+    if (cap == 0 || !(hp->mem = calloc(1, hp->memlen))) {
+        perror("wxhistinit - calloc");
+        return -1;
+    }
+    hp->cap = cap;
+    hp->time = hp->mem;
+    hp->valid = &hp->time[cap];
+    hp->col = (uint16_t *)&hp->valid[cap];
+    return 0;
+}
+
+void
+wxhistadd(wxhist_t *hp, const wxdat_t *wxdp)
+{
+    const wxd_t *dp;
+    uint32_t valid;
+    unsigned int i;
+    int c;
+
+    if (!hp->cap) {
+        return;
+    }
+    if (!hp->n) {
+        hp->base = wxdp->time;
+    }
+    i = hp->n % hp->cap;
+    hp->time[i] = wxdp->time > hp->base ? (uint32_t)(wxdp->time - hp->base) : 0;
+    valid = 0;
+    for (c = 0; c < hp->ncol; ++c) {
+        dp = FIELD(wxdp, c);
+        if (WXD_ISVALID(*dp)) {
+            WXHISTCOL(hp, c)[i] = (uint16_t)WXD_GETRAW(*dp);
+            valid |= (uint32_t)1 << c;
+        } else {
+            WXHISTCOL(hp, c)[i] = 0;
+        }
+    }
+    hp->valid[i] = valid;
+    ++hp->n;
+}
+
+int
+wxhistcount(const wxhist_t *hp)
+{
+    return hp->n < hp->cap ? (int)hp->n : (int)hp->cap;
+}
+
+time_t
+wxhisttime(const wxhist_t *hp, int i)
+{
+    return hp->base + hp->time[SLOT(hp, i)];
+}
+
+/*
+ * field c of sample i as the station sent it (see WXD_GETRAW()),
+ * returns 0 if there wasn't one
+ */
+int
+wxhistget(const wxhist_t *hp, int i, int c, long *vp)
+{
+    unsigned int slot;
+    uint16_t v;
+
+    slot = SLOT(hp, i);
+    if (!(hp->valid[slot] & ((uint32_t)1 << c))) {
+        return 0;
+    }
+    v = WXHISTCOL(hp, c)[slot];
+    *vp = wxfields[c].issigned ? (long)(int16_t)v : (long)v;
+    return 1;
+}
+
+/*
+ * index of the first sample taken at or after t, wxhistcount() if
+ * there's none
+ */
+int
+wxhistfind(const wxhist_t *hp, time_t t)
+{
+    int lo;
+    int hi;
+    int mid;
+
+    lo = 0;
+    hi = wxhistcount(hp);
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (wxhisttime(hp, mid) < t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
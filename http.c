@@ -0,0 +1,434 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Just enough HTTP/1.1 to push observations at WU and friends
+ * without forking a shell and fetch for every sample.  Each server
+ * gets one persistent connection (TLS if asked for, with the session
+ * kept for quick resumption when the server drops us) and a cached
+ * address.  Responses are read and thrown away, all we want is the
+ * status code.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "net.h"
+
+#define HTTPBUF 4096            /* response headers must fit in this */
+
+struct wxhttp {
+    wxdns_t dns;                /* where the server is */
+    int tls;                    /* talk https */
+    int fd;                     /* -1 when not connected */
+    int fresh;                  /* no request sent on this connection yet */
+    SSL_CTX *ctx;
+    SSL *ssl;
+    SSL_SESSION *sess;          /* kept for resumption */
+    char rbuf[HTTPBUF];
+    size_t roff;                /* first unread byte in rbuf */
+    size_t rlen;                /* bytes in rbuf */
+    unsigned long requests;
+    unsigned long connects;
+};
+
+/* from support.c */
+extern int64_t wxmsnow(void);
+/* from net.c */
+extern void wxdnsinit(wxdns_t *dp, const char *host, const char *port, int ttl);
+extern int wxconnect(wxdns_t *dp, int timeout);
+extern int wxsockwait(int s, short events, int64_t expire);
+extern void wxdnsnext(wxdns_t *dp);
+
+wxhttp_t *
+wxhttpnew(const char *host, const char *port, int tls)
+{
+    wxhttp_t *hp;
+
+    if ((hp = calloc(1, sizeof(wxhttp_t))) == (wxhttp_t *)0) {
+        perror("wxhttpnew - calloc");
+        return (wxhttp_t *)0;
+    }
+    wxdnsinit(&hp->dns, host, port, WXDNSTTL);
+    hp->fd = -1;
+    if ((hp->tls = tls)) {
+        if ((hp->ctx = SSL_CTX_new(TLS_client_method())) == (SSL_CTX *)0) {
+            fprintf(stderr, "wxhttpnew - SSL_CTX_new failed\n");
+            free(hp);
+            return (wxhttp_t *)0;
+        }
+        (void)SSL_CTX_set_default_verify_paths(hp->ctx);
+        SSL_CTX_set_verify(hp->ctx, SSL_VERIFY_PEER, NULL);
+        SSL_CTX_set_session_cache_mode(hp->ctx, SSL_SESS_CACHE_CLIENT);
+    }
+    return hp;
+}
+
+void
+wxhttpclose(wxhttp_t *hp)
+{
+    if (hp->ssl) {
+        (void)SSL_shutdown(hp->ssl);
+        SSL_free(hp->ssl);
+        hp->ssl = (SSL *)0;
+    }
+    if (hp->fd != -1) {
+        (void)close(hp->fd);
+        hp->fd = -1;
+    }
+    hp->roff = hp->rlen = 0;
+}
+
+/*
+ * wait out an SSL_ERROR_WANT_*, returns 0 to try again
+ */
+static int
+wxtlswait(wxhttp_t *hp, int rc, int64_t expire)
+{
+    switch (SSL_get_error(hp->ssl, rc)) {
+    case SSL_ERROR_WANT_READ:
+        return wxsockwait(hp->fd, POLLIN, expire) == 1 ? 0 : -1;
+    case SSL_ERROR_WANT_WRITE:
+        return wxsockwait(hp->fd, POLLOUT, expire) == 1 ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+static int
+wxhttpconnect(wxhttp_t *hp, int64_t expire)
+{
+    int rc;
+
+    wxhttpclose(hp);
+    if ((hp->fd = wxconnect(&hp->dns, (int)(expire - wxmsnow()))) == -1) {
+        return -1;
+    }
+    ++hp->connects;
+    hp->fresh = 1;
+    if (!hp->tls) {
+        return 0;
+    }
+    if ((hp->ssl = SSL_new(hp->ctx)) == (SSL *)0) {
+        fprintf(stderr, "wxhttpconnect - SSL_new failed\n");
+        wxhttpclose(hp);
+        return -1;
+    }
+    (void)SSL_set_fd(hp->ssl, hp->fd);
+    (void)SSL_set_tlsext_host_name(hp->ssl, hp->dns.host);
+    (void)SSL_set1_host(hp->ssl, hp->dns.host);
+    if (hp->sess) {
+        (void)SSL_set_session(hp->ssl, hp->sess);
+    }
+    while ((rc = SSL_connect(hp->ssl)) != 1) {
+        if (wxtlswait(hp, rc, expire) != 0) {
+            fprintf(stderr, "wxhttpconnect - TLS handshake with %s failed\n",
+                    hp->dns.host);
+            ERR_clear_error();
+            wxhttpclose(hp);
+            wxdnsnext(&hp->dns);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+wxhttpwrite(wxhttp_t *hp, const char *buf, size_t len, int64_t expire)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        if (hp->tls) {
+            if ((rc = SSL_write(hp->ssl, buf, (int)len)) <= 0) {
+                if (wxtlswait(hp, (int)rc, expire) != 0) {
+                    return -1;
+                }
+                continue;
+            }
+        } else if ((rc = write(hp->fd, buf, len)) == -1) {
+            if ((errno != EAGAIN && errno != EINTR) ||
+                wxsockwait(hp->fd, POLLOUT, expire) != 1) {
+                return -1;
+            }
+            continue;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+/*
+ * get more bytes into rbuf, returns bytes added, 0 for EOF, -1 error
+ */
+static int
+wxhttpfill(wxhttp_t *hp, int64_t expire)
+{
+    ssize_t rc;
+
+    if (hp->roff > 0) {
+        memmove(hp->rbuf, &hp->rbuf[hp->roff], hp->rlen - hp->roff);
+        hp->rlen -= hp->roff;
+        hp->roff = 0;
+    }
+    if (hp->rlen >= sizeof(hp->rbuf)) {
+        return -1;
+    }
+    while (1) {
+        if (hp->tls) {
+            if ((rc = SSL_read(hp->ssl, &hp->rbuf[hp->rlen],
+                               (int)(sizeof(hp->rbuf) - hp->rlen))) <= 0) {
+                if (SSL_get_error(hp->ssl, (int)rc) == SSL_ERROR_ZERO_RETURN) {
+                    return 0;
+                }
+                if (wxtlswait(hp, (int)rc, expire) != 0) {
+                    return -1;
+                }
+                continue;
+            }
+        } else if ((rc = read(hp->fd, &hp->rbuf[hp->rlen],
+                              sizeof(hp->rbuf) - hp->rlen)) == -1) {
+            if ((errno != EAGAIN && errno != EINTR) ||
+                wxsockwait(hp->fd, POLLIN, expire) != 1) {
+                return -1;
+            }
+            continue;
+        }
+        hp->rlen += rc;
+        return (int)rc;
+    }
+}
+
+/*
+ * pull one CRLF terminated line out of the response
+ */
+static int
+wxhttpline(wxhttp_t *hp, char *line, size_t len, int64_t expire)
+{
+    char *nl;
+    size_t n;
+
+    while ((nl = memchr(&hp->rbuf[hp->roff], '\n', hp->rlen - hp->roff)) == NULL) {
+        if (wxhttpfill(hp, expire) <= 0) {
+            return -1;
+        }
+    }
+    n = nl - &hp->rbuf[hp->roff];
+    if (n > 0 && nl[-1] == '\r') {
+        --n;
+    }
+    if (n >= len) {
+        n = len - 1;
+    }
+    memcpy(line, &hp->rbuf[hp->roff], n);
+    line[n] = '\0';
+    hp->roff = nl - hp->rbuf + 1;
+    return 0;
+}
+
+/*
+ * throw away len bytes of body, or everything 'til EOF if len < 0
+ */
+static int
+wxhttpskip(wxhttp_t *hp, long len, int64_t expire)
+{
+    size_t have;
+    int rc;
+
+    while (len != 0) {
+        have = hp->rlen - hp->roff;
+        if (len > 0 && (size_t)len <= have) {
+            hp->roff += len;
+            return 0;
+        }
+        if (len > 0) {
+            len -= have;
+        }
+        hp->roff = hp->rlen = 0;
+        if ((rc = wxhttpfill(hp, expire)) <= 0) {
+            return len < 0 && rc == 0 ? 0 : -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * read the response, returns the status code or -1.  *closep is set
+ * when the server isn't going to keep the connection open.
+ */
+static int
+wxhttpresponse(wxhttp_t *hp, int *closep, int64_t expire)
+{
+    char line[512];
+    char *p;
+    long clen;
+    long chunk;
+    int chunked;
+    int status;
+
+    if (wxhttpline(hp, line, sizeof(line), expire) != 0) {
+        return -1;
+    }
+    if (strncmp(line, "HTTP/1.", 7) != 0 || (p = strchr(line, ' ')) == NULL) {
+        fprintf(stderr, "wxhttpresponse - bogus status line \"%s\"\n", line);
+        return -1;
+    }
+    status = (int)strtol(p + 1, (char **)0, 10);
+    *closep = line[7] == '0';           /* HTTP/1.0 closes by default */
+    clen = -1;
+    chunked = 0;
+    while (1) {
+        if (wxhttpline(hp, line, sizeof(line), expire) != 0) {
+            return -1;
+        }
+        if (!*line) {
+            break;
+        }
+        if (strncasecmp(line, "content-length:", 15) == 0) {
+            clen = strtol(&line[15], (char **)0, 10);
+        } else if (strncasecmp(line, "transfer-encoding:", 18) == 0) {
+            for (p = &line[18]; isspace((unsigned char)*p); ++p)
+                ;
+            chunked = strncasecmp(p, "chunked", 7) == 0;
+        } else if (strncasecmp(line, "connection:", 11) == 0) {
+            for (p = &line[11]; isspace((unsigned char)*p); ++p)
+                ;
+            if (strncasecmp(p, "close", 5) == 0) {
+                *closep = 1;
+            } else if (strncasecmp(p, "keep-alive", 10) == 0) {
+                *closep = 0;
+            }
+        }
+    }
+    if (chunked) {
+        do {
+            if (wxhttpline(hp, line, sizeof(line), expire) != 0) {
+                return -1;
+            }
+            chunk = strtol(line, (char **)0, 16);
+            /* chunk data plus its CRLF, the last one has trailers */
+            if (chunk > 0 && wxhttpskip(hp, chunk, expire) != 0) {
+                return -1;
+            }
+            if (chunk > 0 && wxhttpline(hp, line, sizeof(line), expire) != 0) {
+                return -1;
+            }
+        } while (chunk > 0);
+        do {
+            if (wxhttpline(hp, line, sizeof(line), expire) != 0) {
+                return -1;
+            }
+        } while (*line);
+    } else if (clen >= 0) {
+        if (wxhttpskip(hp, clen, expire) != 0) {
+            return -1;
+        }
+    } else if (status >= 200 && status != 204 && status != 304) {
+        /* no length, body runs to EOF */
+        *closep = 1;
+        if (wxhttpskip(hp, -1, expire) != 0) {
+            return -1;
+        }
+    }
+    return status;
+}
+
+/*
+ * GET path (already url encoded) from the server, waits at most
+ * timeout ms.  Returns the HTTP status or -1.
+ */
+int
+wxhttpget(wxhttp_t *hp, const char *path, int timeout)
+{
+    char req[2560];
+    int64_t expire;
+    int status;
+    int closeit;
+    int tries;
+    int len;
+
+    len = snprintf(req, sizeof(req),
+                   "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: fwx\r\n"
+                   "Connection: keep-alive\r\n\r\n", path, hp->dns.host);
+    if (len < 0 || len >= (int)sizeof(req)) {
+        fprintf(stderr, "wxhttpget - request too long\n");
+        return -1;
+    }
+    expire = wxmsnow() + timeout;
+    for (tries = 0; tries < 2; ++tries) {
+        if (hp->fd == -1 && wxhttpconnect(hp, expire) != 0) {
+            return -1;
+        }
+        /*
+         * a kept-alive connection may have been dropped by the server
+         * while idle, in which case we get one retry on a fresh one
+         */
+        if (wxhttpwrite(hp, req, len, expire) == 0 &&
+            (status = wxhttpresponse(hp, &closeit, expire)) != -1) {
+            ++hp->requests;
+            if (hp->tls && hp->fresh) {
+                if (hp->sess) {
+                    SSL_SESSION_free(hp->sess);
+                }
+                hp->sess = SSL_get1_session(hp->ssl);
+            }
+            hp->fresh = 0;
+            if (closeit) {
+                wxhttpclose(hp);
+            }
+            return status;
+        }
+        closeit = hp->fresh;
+        wxhttpclose(hp);
+        if (closeit || wxmsnow() >= expire) {
+            break;      /* failed on a new connection, don't bother */
+        }
+    }
+    fprintf(stderr, "wxhttpget - request to %s failed\n", hp->dns.host);
+    return -1;
+}
+
+/*
+ * append src to s url encoded, returns the new end of s like stpcpy
+ */
+char *
+wxurlcat(char *s, const char *src)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    unsigned char c;
+
+    while ((c = (unsigned char)*src++) != '\0') {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            *s++ = c;
+        } else {
+            *s++ = '%';
+            *s++ = hex[c >> 4];
+            *s++ = hex[c & 0x0f];
+        }
+    }
+    *s = '\0';
+    return s;
+}
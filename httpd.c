@@ -0,0 +1,770 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * A small HTTP server for local displays, JSON only:
+ *
+ *   /current                   the latest sample
+ *   /history[?since=<time>]    samples in memory (after since)
+ *   /rollup                    this minute's, hour's and day's slots
+ *
+ * each taking station=<name or number> for stations past the first.
+ *
+ * Nothing is worked out per request.  As each sample is taken the
+ * sampling loop renders the bodies into buffers that are swapped in
+ * under the lock, the history one gets a row appended.  The server
+ * runs in its own thread with non-blocking sockets and poll(), a
+ * request is a look up and a writev() of the header and a slice of
+ * the buffer, which is reference counted so one that's been
+ * replaced lives until the last client sending it is done.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+#include "fwxbin.h"
+#include "fwxroll.h"
+
+#define HTTPDSITES      32      /* stations served */
+#define HTTPDCONNS      256     /* clients at once, more are turned away */
+#define HTTPDREQMAX     2048    /* longest request head we'll take */
+#define HTTPDIDLE       30      /* seconds a quiet client is kept */
+#define HTTPDBODYMAX    8192    /* longest /rollup body */
+#define HTTPDROWMAX     1024    /* longest history row */
+#define HTTPDFIELDS     32      /* most wxfields[] rows, as for the history */
+
+typedef struct wxhttpdbuf {
+    unsigned int refs;          /* the cache's and each client sending it */
+    size_t len;
+    size_t cap;
+    char data[];
+} wxhttpdbuf_t;
+
+typedef struct wxhttpdsite {
+    char name[32];
+    int places[HTTPDFIELDS];    /* of each field, from the latest sample */
+    wxhttpdbuf_t *current;
+    wxhttpdbuf_t *rollup;
+    wxhttpdbuf_t *hist;         /* ",\n{...}" per sample, oldest first */
+    time_t *rowtime;            /* of each row in hist ... */
+    size_t *rowoff;             /* ... and where it starts */
+    unsigned int rowcap;
+    unsigned int rowfirst;
+    unsigned int rown;
+    unsigned int histn;         /* the history's n when it was last rendered */
+} wxhttpdsite_t;
+
+typedef struct wxhttpdconn {
+    int fd;
+    time_t idle;                /* closed if nothing's happened by then */
+    char in[HTTPDREQMAX];
+    size_t inlen;
+    char hdr[256];
+    struct iovec iov[4];        /* the response ... */
+    int iovi;                   /* ... what's been sent of it */
+    int iovn;
+    wxhttpdbuf_t *buf;          /* the body's in here, or NULL */
+    int closing;                /* once this response is out */
+} wxhttpdconn_t;
+
+/* from schema.c */
+extern const wxfield_t wxfields[];
+extern const int wxnfields;
+
+/* from fwxbin.c */
+extern char *fwxbfmtfixed(char *s, long v, int places);
+
+/* from history.c */
+extern int wxhistcount(const wxhist_t *hp);
+extern time_t wxhisttime(const wxhist_t *hp, int i);
+extern int wxhistget(const wxhist_t *hp, int i, int c, long *vp);
+
+/* from rollup.c */
+extern const fwxrrec_t *wxrollslot(const wxroll_t *rp, int p, time_t t, fwxrrec_t *bufp);
+
+/* from stats.c */
+extern void wxstatinc(int c);
+
+static pthread_mutex_t wxhttpdlock = PTHREAD_MUTEX_INITIALIZER;
+static wxhttpdsite_t wxhttpdsites[HTTPDSITES];
+static int wxhttpdnsites;
+static int wxhttpdfd = -1;
+static wxhttpdconn_t *wxhttpdconns[HTTPDCONNS];
+
+static const char *wxhttpdperiods[FWXR_NPERIODS] = { "minute", "hour", "day" };
+
+#define FIELD(wxdp, c)  ((const wxd_t *)((const char *)(wxdp) + wxfields[c].off))
+
+/*
+ * listen on [host:]port
+ */
+int
+wxhttpdopen(const char *addr)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    char host[64];
+    const char *port;
+    const char *p;
+    int on;
+    int rc;
+
+    *host = '\0';
+    port = addr;
+    if ((p = strrchr(addr, ':'))) {
+        /* [::1]:8080 for an IPv6 address */
+        if (*addr == '[' && p > addr && p[-1] == ']') {
+            ++addr;
+        }
+        (void)snprintf(host, sizeof(host), "%.*s", (int)(p - addr - (p[-1] == ']')), addr);
+        port = p + 1;
+    }
+    memset((void *)&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if ((rc = getaddrinfo(*host ? host : (char *)0, port, &hints, &res)) != 0) {
+        fprintf(stderr, "wxhttpdopen - %s: %s\n", addr, gai_strerror(rc));
+        return -1;
+    }
+    on = 1;
+    if ((wxhttpdfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) == -1 ||
+        setsockopt(wxhttpdfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+        bind(wxhttpdfd, res->ai_addr, res->ai_addrlen) == -1 ||
+        listen(wxhttpdfd, 128) == -1 ||
+        fcntl(wxhttpdfd, F_SETFL, fcntl(wxhttpdfd, F_GETFL) | O_NONBLOCK) == -1) {
+        perror("wxhttpdopen");
+        if (wxhttpdfd != -1) {
+            (void)close(wxhttpdfd);
+            wxhttpdfd = -1;
+        }
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    return 0;
+}
+
+/*
+ * serve station number wxhttpdnsites as name, returns its number
+ */
+int
+wxhttpdsite(const char *name)
+{
+    wxhttpdsite_t *sp;
+
+    if (wxhttpdnsites == HTTPDSITES) {
+        return -1;
+    }
+    sp = &wxhttpdsites[wxhttpdnsites];
+    strncpy(sp->name, name, sizeof(sp->name)-1);
+    return wxhttpdnsites++;
+}
+
+static wxhttpdbuf_t *
+wxhttpdbufnew(const char *s, size_t len, size_t cap)
+{
+    wxhttpdbuf_t *bp;
+
+    if (!(bp = malloc(sizeof(wxhttpdbuf_t) + cap))) {
+        perror("wxhttpdbufnew - malloc");
+        return (wxhttpdbuf_t *)0;
+    }
+    bp->refs = 1;
+    bp->len = len;
+    bp->cap = cap;
+    memcpy(bp->data, s, len);
+    return bp;
+}
+
+/*
+ * let go of bp, the lock has to be held
+ */
+static void
+wxhttpdbufdrop(wxhttpdbuf_t *bp)
+{
+    if (bp && --bp->refs == 0) {
+        free(bp);
+    }
+}
+
+/*
+ * a JSON string, only station names come through here
+ */
+static char *
+wxhttpdstr(char *s, const char *src)
+{
+    *s++ = '"';
+    for (; *src; ++src) {
+        if (*src == '"' || *src == '\\') {
+            *s++ = '\\';
+        }
+        if ((unsigned char)*src >= ' ') {
+            *s++ = *src;
+        }
+    }
+    *s++ = '"';
+    *s = '\0';
+    return s;
+}
+
+/*
+ * history sample i as a row
+ */
+static char *
+wxhttpdrow(char *s, const wxhttpdsite_t *sp, const wxhist_t *hp, int i)
+{
+    long v;
+    int c;
+
+    s += sprintf(s, ",\n{\"time\":%lld", (long long)wxhisttime(hp, i));
+    for (c = 0; c < hp->ncol; ++c) {
+        s += sprintf(s, ",\"%s\":", wxfields[c].name);
+        if (wxhistget(hp, i, c, &v)) {
+            s = fwxbfmtfixed(s, v, sp->places[c]);
+        } else {
+            s = stpcpy(s, "null");
+        }
+    }
+    *s++ = '}';
+    *s = '\0';
+    return s;
+}
+
+static char *
+wxhttpdslot(char *s, const fwxrrec_t *rp)
+{
+    const fwxrcol_t *cp;
+    int64_t mean;
+    int64_t half;
+    int c;
+
+    if (!rp || rp->n == 0) {
+        return stpcpy(s, "null");
+    }
+    s += sprintf(s, "{\"start\":%lld,\"samples\":%u,\"rain\":", (long long)rp->start, rp->n);
+    s = fwxbfmtfixed(s, rp->rain, fwxbcols[FWXB_RAINYEAR].places);
+    /* under the names /current uses */
+    for (c = 0; c < wxnfields; ++c) {
+        if (wxfields[c].csv < 0) {
+            continue;
+        }
+        s += sprintf(s, ",\"%s\":", wxfields[c].name);
+        cp = &rp->col[wxfields[c].csv];
+        if (cp->n == 0) {
+            s = stpcpy(s, "null");
+            continue;
+        }
+        s = stpcpy(s, "{\"min\":");
+        s = fwxbfmtfixed(s, cp->min, fwxbcols[wxfields[c].csv].places);
+        s = stpcpy(s, ",\"max\":");
+        s = fwxbfmtfixed(s, cp->max, fwxbcols[wxfields[c].csv].places);
+        s = stpcpy(s, ",\"mean\":");
+        half = (int64_t)cp->n / 2;
+        mean = (cp->sum < 0 ? cp->sum - half : cp->sum + half) / (int64_t)cp->n;
+        s = fwxbfmtfixed(s, (long)mean, fwxbcols[wxfields[c].csv].places);
+        *s++ = '}';
+    }
+    *s++ = '}';
+    *s = '\0';
+    return s;
+}
+
+static char *
+wxhttpdrollup(char *s, const wxhttpdsite_t *sp, const wxroll_t *rp, time_t t)
+{
+    fwxrrec_t buf;
+    int p;
+
+    s = stpcpy(s, "{\"station\":");
+    s = wxhttpdstr(s, sp->name);
+    for (p = 0; p < FWXR_NPERIODS; ++p) {
+        s += sprintf(s, ",\"%s\":", wxhttpdperiods[p]);
+        s = wxhttpdslot(s, wxrollslot(rp, p, t, &buf));
+    }
+    s = stpcpy(s, "}\n");
+    return s;
+}
+
+/*
+ * bring the history rows up to date with hp
+ */
+static void
+wxhttpdhist(wxhttpdsite_t *sp, const wxhist_t *hp)
+{
+    char row[HTTPDROWMAX];
+    wxhttpdbuf_t *bp;
+    wxhttpdbuf_t *nbp;
+    size_t len;
+    size_t base;
+    size_t live;
+    unsigned int j;
+    int count;
+    int i;
+
+    if (!sp->rowtime) {
+        sp->rowcap = 2 * (hp->cap + 1);
+        sp->rowtime = malloc(sp->rowcap * sizeof(time_t));
+        sp->rowoff = malloc(sp->rowcap * sizeof(size_t));
+        if (!sp->rowtime || !sp->rowoff) {
+            perror("wxhttpdhist - malloc");
+            free(sp->rowtime);
+            free(sp->rowoff);
+            sp->rowtime = (time_t *)0;
+            sp->rowoff = (size_t *)0;
+            return;
+        }
+        sp->histn = hp->n - (unsigned int)wxhistcount(hp);
+    }
+    count = wxhistcount(hp);
+    i = hp->n - sp->histn > (unsigned int)count ? 0 : count - (int)(hp->n - sp->histn);
+    sp->histn = hp->n;
+    for (; i < count; ++i) {
+        len = (size_t)(wxhttpdrow(row, sp, hp, i) - row);
+        (void)pthread_mutex_lock(&wxhttpdlock);
+        bp = sp->hist;
+        if (!bp || bp->len + len > bp->cap) {
+            /*
+             * full, start a new one with what's still in the history
+             * and a little room to grow, once the history's full it
+             * stays about the same size
+             */
+            base = sp->rown ? sp->rowoff[sp->rowfirst] : bp ? bp->len : 0;
+            live = bp ? bp->len - base : 0;
+            if (!(nbp = wxhttpdbufnew(bp ? bp->data + base : "", live,
+                                      (live + len) / 4 * 5 + 65536))) {
+                (void)pthread_mutex_unlock(&wxhttpdlock);
+                return;
+            }
+            for (j = 0; j < sp->rown; ++j) {
+                sp->rowoff[sp->rowfirst + j] -= base;
+            }
+            wxhttpdbufdrop(bp);
+            sp->hist = bp = nbp;
+        }
+        if (sp->rowfirst + sp->rown == sp->rowcap) {
+            memmove(sp->rowtime, &sp->rowtime[sp->rowfirst], sp->rown * sizeof(time_t));
+            memmove(sp->rowoff, &sp->rowoff[sp->rowfirst], sp->rown * sizeof(size_t));
+            sp->rowfirst = 0;
+        }
+        memcpy(bp->data + bp->len, row, len);
+        sp->rowtime[sp->rowfirst + sp->rown] = wxhisttime(hp, i);
+        sp->rowoff[sp->rowfirst + sp->rown] = bp->len;
+        ++sp->rown;
+        bp->len += len;
+        /* what the history has let go of */
+        while (sp->rown > (unsigned int)count) {
+            ++sp->rowfirst;
+            --sp->rown;
+        }
+        (void)pthread_mutex_unlock(&wxhttpdlock);
+    }
+}
+
+/*
+ * render what station site has to say after a new sample, json is
+ * the sample from wxschemajson(), rp is NULL when there are no
+ * rollups
+ */
+void
+wxhttpdput(int site, const char *json, size_t len, const wxdat_t *wxdp,
+           const wxhist_t *hp, const wxroll_t *rp)
+{
+    char str[HTTPDBODYMAX];
+    wxhttpdsite_t *sp;
+    wxhttpdbuf_t *cur;
+    wxhttpdbuf_t *roll;
+    const wxd_t *dp;
+    int c;
+
+    if (site < 0 || site >= wxhttpdnsites) {
+        return;
+    }
+    sp = &wxhttpdsites[site];
+    for (c = 0; c < wxnfields && c < HTTPDFIELDS; ++c) {
+        dp = FIELD(wxdp, c);
+        if (WXD_ISVALID(*dp)) {
+            sp->places[c] = WXD_GVPLACES(*dp);
+        }
+    }
+    if ((cur = wxhttpdbufnew(json, len, len + 1))) {
+        cur->data[cur->len++] = '\n';
+    }
+    roll = (wxhttpdbuf_t *)0;
+    if (rp) {
+        roll = wxhttpdbufnew(str, (size_t)(wxhttpdrollup(str, sp, rp, wxdp->time) - str),
+                             HTTPDBODYMAX);
+    }
+    (void)pthread_mutex_lock(&wxhttpdlock);
+    if (cur) {
+        wxhttpdbufdrop(sp->current);
+        sp->current = cur;
+    }
+    if (roll) {
+        wxhttpdbufdrop(sp->rollup);
+        sp->rollup = roll;
+    }
+    (void)pthread_mutex_unlock(&wxhttpdlock);
+    if (hp->cap) {
+        wxhttpdhist(sp, hp);
+    }
+}
+
+/*
+ * which station a request's for, -1 if there's no such one
+ */
+static int
+wxhttpdwhich(const char *v, size_t len)
+{
+    char *e;
+    long n;
+    int i;
+
+    if (len == 0) {
+        return 0;
+    }
+    for (i = 0; i < wxhttpdnsites; ++i) {
+        if (strlen(wxhttpdsites[i].name) == len && strncmp(wxhttpdsites[i].name, v, len) == 0) {
+            return i;
+        }
+    }
+    n = strtol(v, &e, 10);
+    return e == v + len && n >= 0 && n < wxhttpdnsites ? (int)n : -1;
+}
+
+static void
+wxhttpdrespond(wxhttpdconn_t *cp, int status, const char *reason, int head,
+               wxhttpdbuf_t *bp, const char *pre, const char *body, size_t len,
+               const char *post)
+{
+    size_t total;
+
+    total = strlen(pre) + len + strlen(post);
+    cp->iov[0].iov_base = cp->hdr;
+    cp->iov[0].iov_len = (size_t)snprintf(cp->hdr, sizeof(cp->hdr),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+        "Content-Length: %lu\r\nCache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n%s\r\n",
+        status, reason, (unsigned long)total, cp->closing ? "Connection: close\r\n" : "");
+    cp->iov[1].iov_base = (void *)pre;
+    cp->iov[1].iov_len = head ? 0 : strlen(pre);
+    cp->iov[2].iov_base = (void *)body;
+    cp->iov[2].iov_len = head ? 0 : len;
+    cp->iov[3].iov_base = (void *)post;
+    cp->iov[3].iov_len = head ? 0 : strlen(post);
+    cp->iovi = 0;
+    cp->iovn = 4;
+    cp->buf = bp;
+}
+
+#define ERROR(cp, st, why, head) \
+    wxhttpdrespond(cp, st, why, head, (wxhttpdbuf_t *)0, "{\"error\":\"" why "\"}\n", "", 0, "")
+
+/*
+ * answer the request head at the start of cp->in
+ */
+static void
+wxhttpdrequest(wxhttpdconn_t *cp)
+{
+    wxhttpdsite_t *sp;
+    wxhttpdbuf_t *bp;
+    const char *target;
+    const char *query;
+    const char *v;
+    const char *e;
+    size_t tlen;
+    size_t plen;
+    int64_t since;
+    unsigned int lo;
+    unsigned int hi;
+    unsigned int mid;
+    size_t off;
+    int head;
+    int site;
+    char *s;
+
+    wxstatinc(WXC_HTTPREQS);
+    s = cp->in;
+    head = strncmp(s, "HEAD ", 5) == 0;
+    if (!head && strncmp(s, "GET ", 4) != 0) {
+        cp->closing = 1;
+        ERROR(cp, 405, "Method Not Allowed", 0);
+        return;
+    }
+    target = s + (head ? 5 : 4);
+    if (!(e = strchr(target, ' ')) || strncmp(e, " HTTP/1.", 8) != 0) {
+        cp->closing = 1;
+        ERROR(cp, 400, "Bad Request", head);
+        return;
+    }
+    tlen = (size_t)(e - target);
+    /* 1.0 clients get one response, 1.1 ones until they say otherwise */
+    if (e[8] == '0') {
+        cp->closing = 1;
+    }
+    for (s = strstr(s, "\r\n"); s && s[2] != '\r'; s = strstr(s + 2, "\r\n")) {
+        if (strncasecmp(s + 2, "Connection:", 11) == 0) {
+            for (v = s + 13; *v == ' '; ++v)
+                ;
+            if (strncasecmp(v, "close", 5) == 0) {
+                cp->closing = 1;
+            }
+        }
+    }
+
+    query = memchr(target, '?', tlen);
+    plen = query ? (size_t)(query - target) : tlen;
+    since = INT64_MIN;
+    site = 0;
+    for (v = query; v && v < target + tlen; v = e) {
+        ++v;
+        if (!(e = memchr(v, '&', (size_t)(target + tlen - v)))) {
+            e = target + tlen;
+        }
+        if (strncmp(v, "since=", 6) == 0) {
+            since = strtoll(v + 6, (char **)0, 10);
+        } else if (strncmp(v, "station=", 8) == 0) {
+            site = wxhttpdwhich(v + 8, (size_t)(e - v - 8));
+        }
+    }
+    if (site < 0 || site >= wxhttpdnsites) {
+        ERROR(cp, 404, "Not Found", head);
+        return;
+    }
+    sp = &wxhttpdsites[site];
+
+    (void)pthread_mutex_lock(&wxhttpdlock);
+    if (plen == 8 && strncmp(target, "/current", 8) == 0) {
+        if ((bp = sp->current)) {
+            ++bp->refs;
+            wxhttpdrespond(cp, 200, "OK", head, bp, "", bp->data, bp->len, "");
+        }
+    } else if (plen == 7 && strncmp(target, "/rollup", 7) == 0) {
+        if ((bp = sp->rollup)) {
+            ++bp->refs;
+            wxhttpdrespond(cp, 200, "OK", head, bp, "", bp->data, bp->len, "");
+        }
+    } else if (plen == 8 && strncmp(target, "/history", 8) == 0) {
+        if ((bp = sp->hist)) {
+            /* the first row after since */
+            lo = sp->rowfirst;
+            hi = sp->rowfirst + sp->rown;
+            while (lo < hi) {
+                mid = lo + (hi - lo) / 2;
+                if ((int64_t)sp->rowtime[mid] <= since) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            ++bp->refs;
+            if (lo == sp->rowfirst + sp->rown) {
+                wxhttpdrespond(cp, 200, "OK", head, bp, "[]\n", "", 0, "");
+            } else {
+                /* skipping the first row's ",\n" */
+                off = sp->rowoff[lo] + 2;
+                wxhttpdrespond(cp, 200, "OK", head, bp, "[", bp->data + off,
+                               bp->len - off, "]\n");
+            }
+        }
+    } else {
+        bp = (wxhttpdbuf_t *)0;
+        (void)pthread_mutex_unlock(&wxhttpdlock);
+        ERROR(cp, 404, "Not Found", head);
+        return;
+    }
+    (void)pthread_mutex_unlock(&wxhttpdlock);
+    if (!bp) {
+        ERROR(cp, 503, "Service Unavailable", head);
+    }
+}
+
+static void
+wxhttpdclose(int i)
+{
+    wxhttpdconn_t *cp;
+
+    cp = wxhttpdconns[i];
+    (void)close(cp->fd);
+    (void)pthread_mutex_lock(&wxhttpdlock);
+    wxhttpdbufdrop(cp->buf);
+    (void)pthread_mutex_unlock(&wxhttpdlock);
+    free(cp);
+    wxhttpdconns[i] = (wxhttpdconn_t *)0;
+}
+
+/*
+ * send what we can of the response, returns -1 if the client's gone
+ */
+static int
+wxhttpdsend(wxhttpdconn_t *cp)
+{
+    ssize_t n;
+
+    while (cp->iovi < cp->iovn) {
+        if ((n = writev(cp->fd, &cp->iov[cp->iovi], cp->iovn - cp->iovi)) == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        for (; cp->iovi < cp->iovn && (size_t)n >= cp->iov[cp->iovi].iov_len; ++cp->iovi) {
+            n -= (ssize_t)cp->iov[cp->iovi].iov_len;
+        }
+        if (cp->iovi < cp->iovn) {
+            cp->iov[cp->iovi].iov_base = (char *)cp->iov[cp->iovi].iov_base + n;
+            cp->iov[cp->iovi].iov_len -= (size_t)n;
+        }
+    }
+    /* all out */
+    (void)pthread_mutex_lock(&wxhttpdlock);
+    wxhttpdbufdrop(cp->buf);
+    (void)pthread_mutex_unlock(&wxhttpdlock);
+    cp->buf = (wxhttpdbuf_t *)0;
+    cp->iovn = 0;
+    return cp->closing ? -1 : 0;
+}
+
+/*
+ * answer every whole request that's come in, until one has to wait
+ * for the client to take its response, returns -1 to hang up
+ */
+static int
+wxhttpdserve(wxhttpdconn_t *cp)
+{
+    char *e;
+    size_t len;
+
+    while (cp->iovn == 0 && (e = strstr(cp->in, "\r\n\r\n"))) {
+        len = (size_t)(e + 4 - cp->in);
+        wxhttpdrequest(cp);
+        memmove(cp->in, cp->in + len, cp->inlen - len + 1);
+        cp->inlen -= len;
+        if (wxhttpdsend(cp) != 0) {
+            return -1;
+        }
+    }
+    if (cp->iovn == 0 && cp->inlen == sizeof(cp->in) - 1) {
+        /* no end to the head in sight */
+        cp->closing = 1;
+        ERROR(cp, 400, "Bad Request", 0);
+        return wxhttpdsend(cp);
+    }
+    return 0;
+}
+
+static void
+wxhttpdaccept(time_t now)
+{
+    wxhttpdconn_t *cp;
+    int fd;
+    int i;
+
+    while ((fd = accept(wxhttpdfd, (struct sockaddr *)0, (socklen_t *)0)) != -1) {
+        for (i = 0; i < HTTPDCONNS && wxhttpdconns[i]; ++i)
+            ;
+        if (i == HTTPDCONNS || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 ||
+            !(cp = calloc(1, sizeof(wxhttpdconn_t)))) {
+            (void)close(fd);
+            continue;
+        }
+        cp->fd = fd;
+        cp->idle = now + HTTPDIDLE;
+        wxhttpdconns[i] = cp;
+    }
+}
+
+/*
+ * the server thread
+ */
+void *
+wxhttpd(void *arg)
+{
+    struct pollfd pfds[HTTPDCONNS + 1];
+    int which[HTTPDCONNS + 1];
+    wxhttpdconn_t *cp;
+    time_t now;
+    ssize_t n;
+    int npfd;
+    int i;
+    int j;
+
+    (void)arg;
+    while (1) {
+        pfds[0].fd = wxhttpdfd;
+        pfds[0].events = POLLIN;
+        npfd = 1;
+        for (i = 0; i < HTTPDCONNS; ++i) {
+            if ((cp = wxhttpdconns[i])) {
+                pfds[npfd].fd = cp->fd;
+                pfds[npfd].events = cp->iovn ? POLLOUT : POLLIN;
+                which[npfd++] = i;
+            }
+        }
+        if (poll(pfds, (nfds_t)npfd, 1000) == -1) {
+            if (errno != EINTR) {
+                perror("wxhttpd - poll");
+                sleep(1);
+            }
+            continue;
+        }
+        now = time((time_t *)0);
+        for (j = 1; j < npfd; ++j) {
+            i = which[j];
+            cp = wxhttpdconns[i];
+            if (pfds[j].revents & (POLLERR|POLLNVAL)) {
+                wxhttpdclose(i);
+                continue;
+            }
+            if (pfds[j].revents & POLLOUT) {
+                if (wxhttpdsend(cp) != 0 || wxhttpdserve(cp) != 0) {
+                    wxhttpdclose(i);
+                    continue;
+                }
+                cp->idle = now + HTTPDIDLE;
+            } else if (pfds[j].revents & (POLLIN|POLLHUP)) {
+                n = read(cp->fd, cp->in + cp->inlen, sizeof(cp->in) - 1 - cp->inlen);
+                if (n == 0 || (n == -1 && errno != EAGAIN && errno != EINTR)) {
+                    wxhttpdclose(i);
+                    continue;
+                }
+                if (n > 0) {
+                    cp->inlen += (size_t)n;
+                    cp->in[cp->inlen] = '\0';
+                    if (wxhttpdserve(cp) != 0) {
+                        wxhttpdclose(i);
+                        continue;
+                    }
+                }
+                cp->idle = now + HTTPDIDLE;
+            } else if (now >= cp->idle) {
+                wxhttpdclose(i);
+            }
+        }
+        if (pfds[0].revents & POLLIN) {
+            wxhttpdaccept(now);
+        }
+    }
+    return (void *)0;   /*NOTREACHED*/
+}
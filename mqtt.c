@@ -0,0 +1,302 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Just enough of an MQTT 3.1.1 client to publish at QoS 0: CONNECT
+ * with a fixed client id and clean session off so the broker keeps
+ * the session across reconnects, PUBLISH, and PINGREQ when we've been
+ * quiet for half the keepalive.  Whatever the broker sends back
+ * (PINGRESP) is read and tossed.  As in aprs.c all I/O is
+ * non-blocking with a deadline and a broker that fails us is left
+ * alone for a while.
+ *
+ * http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/mqtt-v3.1.1.html
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "net.h"
+
+#define MQTTBACKOFFMIN  10      /* secs to wait after the first failure */
+#define MQTTBACKOFFMAX  (10*60) /* never wait longer than this */
+#define MQTTPKTMAX      4096    /* biggest packet we'll send */
+
+#define MQTTCONNECT     0x10    /* packet types, in the high nibble */
+#define MQTTCONNACK     0x20
+#define MQTTPUBLISH     0x30
+#define MQTTPINGREQ     0xc0
+
+struct wxmqtt {
+    wxdns_t dns;                /* where the broker is */
+    int fd;                     /* -1 when not connected */
+    char id[64];                /* client id, the session's name */
+    int keepalive;              /* seconds */
+    int64_t lastsent;           /* wxmsnow() of our last packet */
+    time_t nexttry;             /* backing off 'til then */
+    int backoff;                /* current backoff in seconds */
+    unsigned long sessions;
+    unsigned long packets;
+};
+
+/* from support.c */
+extern int64_t wxmsnow(void);
+/* from net.c */
+extern void wxdnsinit(wxdns_t *dp, const char *host, const char *port, int ttl);
+extern int wxconnect(wxdns_t *dp, int timeout);
+extern int wxsockwait(int s, short events, int64_t expire);
+extern void wxdnsnext(wxdns_t *dp);
+
+wxmqtt_t *
+wxmqttnew(const char *host, const char *port, const char *id, int keepalive)
+{
+    wxmqtt_t *mp;
+
+    if ((mp = calloc(1, sizeof(wxmqtt_t))) == (wxmqtt_t *)0) {
+        perror("wxmqttnew - calloc");
+        return (wxmqtt_t *)0;
+    }
+    wxdnsinit(&mp->dns, host, port, WXDNSTTL);
+    mp->fd = -1;
+    strncpy(mp->id, id, sizeof(mp->id)-1);
+    mp->keepalive = keepalive;
+    return mp;
+}
+
+static void
+wxmqttclose(wxmqtt_t *mp)
+{
+    if (mp->fd != -1) {
+        (void)close(mp->fd);
+        mp->fd = -1;
+    }
+}
+
+/*
+ * give up on this broker for a while, each failure in a row doubles
+ * the wait
+ */
+static void
+wxmqttfail(wxmqtt_t *mp)
+{
+    wxmqttclose(mp);
+    wxdnsnext(&mp->dns);
+    if (mp->backoff < MQTTBACKOFFMIN) {
+        mp->backoff = MQTTBACKOFFMIN;
+    } else if ((mp->backoff *= 2) > MQTTBACKOFFMAX) {
+        mp->backoff = MQTTBACKOFFMAX;
+    }
+    mp->nexttry = time((time_t *)0) + mp->backoff;
+}
+
+/*
+ * read and toss whatever the broker has sent, returns 0 if the
+ * connection is still good
+ */
+static int
+wxmqttdrain(wxmqtt_t *mp)
+{
+    char buf[512];
+    ssize_t rc;
+
+    while (1) {
+        if ((rc = read(mp->fd, buf, sizeof(buf))) > 0) {
+            continue;
+        }
+        if (rc == 0) {
+            return -1;          /* broker hung up */
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            perror("wxmqttdrain - read");
+            return -1;
+        }
+        return 0;
+    }
+}
+
+static int
+wxmqttwrite(wxmqtt_t *mp, const unsigned char *buf, size_t len, int64_t expire)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        if ((rc = write(mp->fd, buf, len)) == -1) {
+            if ((errno != EAGAIN && errno != EINTR) ||
+                wxsockwait(mp->fd, POLLOUT, expire) != 1) {
+                return -1;
+            }
+            continue;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    mp->lastsent = wxmsnow();
+    return 0;
+}
+
+/*
+ * read exactly len bytes before the deadline
+ */
+static int
+wxmqttread(wxmqtt_t *mp, unsigned char *buf, size_t len, int64_t expire)
+{
+    ssize_t rc;
+
+    while (len > 0) {
+        if ((rc = read(mp->fd, buf, len)) == 0) {
+            return -1;
+        }
+        if (rc == -1) {
+            if ((errno != EAGAIN && errno != EINTR) ||
+                wxsockwait(mp->fd, POLLIN, expire) != 1) {
+                return -1;
+            }
+            continue;
+        }
+        buf += rc;
+        len -= rc;
+    }
+    return 0;
+}
+
+/*
+ * a fixed header, the remaining length is 7 bits a byte, least
+ * significant first
+ */
+static unsigned char *
+wxmqtthdr(unsigned char *p, int type, size_t len)
+{
+    *p++ = (unsigned char)type;
+    do {
+        *p = len & 0x7f;
+        if ((len >>= 7) != 0) {
+            *p |= 0x80;
+        }
+        ++p;
+    } while (len != 0);
+    return p;
+}
+
+static unsigned char *
+wxmqttstr(unsigned char *p, const char *s, size_t len)
+{
+    *p++ = (unsigned char)(len >> 8);
+    *p++ = (unsigned char)len;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+static int
+wxmqttconnect(wxmqtt_t *mp, int64_t expire)
+{
+    unsigned char buf[128];
+    unsigned char *p;
+    size_t idlen;
+
+    if ((mp->fd = wxconnect(&mp->dns, (int)(expire - wxmsnow()))) == -1) {
+        return -1;
+    }
+    idlen = strlen(mp->id);
+    p = wxmqtthdr(buf, MQTTCONNECT, 10 + 2 + idlen);
+    p = wxmqttstr(p, "MQTT", 4);
+    *p++ = 4;                   /* protocol level, 3.1.1 */
+    *p++ = 0;                   /* no will, no login, keep the session */
+    *p++ = (unsigned char)(mp->keepalive >> 8);
+    *p++ = (unsigned char)mp->keepalive;
+    p = wxmqttstr(p, mp->id, idlen);
+    if (wxmqttwrite(mp, buf, (size_t)(p - buf), expire) != 0 ||
+        wxmqttread(mp, buf, 4, expire) != 0) {
+        fprintf(stderr, "wxmqttconnect - no CONNACK from %s\n", mp->dns.host);
+        wxmqttclose(mp);
+        return -1;
+    }
+    if (buf[0] != MQTTCONNACK || buf[1] != 2 || buf[3] != 0) {
+        fprintf(stderr, "wxmqttconnect - %s refused us (%d)\n", mp->dns.host, buf[3]);
+        wxmqttclose(mp);
+        return -1;
+    }
+    ++mp->sessions;
+    return 0;
+}
+
+/*
+ * publish payload to topic at QoS 0 waiting at most timeout ms,
+ * returns 0 on success, -1 if it didn't go (or we're backing off)
+ */
+int
+wxmqttpublish(wxmqtt_t *mp, const char *topic, const char *payload, size_t len,
+              int timeout)
+{
+    unsigned char buf[MQTTPKTMAX];
+    unsigned char *p;
+    size_t topiclen;
+    int64_t expire;
+    int tries;
+
+    topiclen = strlen(topic);
+    if (topiclen + len + 7 > sizeof(buf)) {
+        fprintf(stderr, "wxmqttpublish - %lu bytes to %s won't fit\n",
+                (unsigned long)len, topic);
+        return -1;
+    }
+    if (mp->fd == -1 && time((time_t *)0) < mp->nexttry) {
+        return -1;
+    }
+    p = wxmqtthdr(buf, MQTTPUBLISH, 2 + topiclen + len);
+    p = wxmqttstr(p, topic, topiclen);
+    memcpy(p, payload, len);
+    p += len;
+    expire = wxmsnow() + timeout;
+    for (tries = 0; tries < 2; ++tries) {
+        if (mp->fd == -1 && wxmqttconnect(mp, expire) != 0) {
+            break;
+        }
+        /* as in aprs.c, don't send into a session that's gone */
+        if (wxmqttdrain(mp) == 0 &&
+            wxmqttwrite(mp, buf, (size_t)(p - buf), expire) == 0) {
+            ++mp->packets;
+            mp->backoff = 0;
+            return 0;
+        }
+        wxmqttclose(mp);
+    }
+    wxmqttfail(mp);
+    return -1;
+}
+
+/*
+ * keep a quiet session alive, call this now and then
+ */
+void
+wxmqttidle(wxmqtt_t *mp, int timeout)
+{
+    static const unsigned char ping[2] = { MQTTPINGREQ, 0 };
+
+    if (mp->fd == -1 || mp->keepalive == 0 ||
+        wxmsnow() - mp->lastsent < (int64_t)mp->keepalive * 1000 / 2) {
+        return;
+    }
+    if (wxmqttdrain(mp) != 0 || wxmqttwrite(mp, ping, sizeof(ping), wxmsnow() + timeout) != 0) {
+        wxmqttclose(mp);
+    }
+}
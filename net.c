@@ -0,0 +1,225 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Bits shared by everything that talks to a server: a small DNS
+ * cache and a connect() that gives up on time.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "net.h"
+
+/* from support.c */
+extern int64_t wxmsnow(void);
+/* forward declarations from this file */
+int wxsockwait(int s, short events, int64_t expire);
+
+void
+wxdnsinit(wxdns_t *dp, const char *host, const char *port, int ttl)
+{
+    memset((void *)dp, 0, sizeof(wxdns_t));
+    strncpy(dp->host, host, sizeof(dp->host)-1);
+    strncpy(dp->port, port, sizeof(dp->port)-1);
+    dp->ttl = ttl > 0 ? ttl : WXDNSTTL;
+}
+
+/*
+ * make sure the cache holds something current, returns the number of
+ * cached addresses (0 if we have nothing to try)
+ */
+int
+wxdnsget(wxdns_t *dp)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    struct addrinfo *ai;
+    time_t now;
+    int rc;
+    int n;
+
+    now = time((time_t *)0);
+    if (now < dp->expires) {
+        return dp->naddr;
+    }
+    memset((void *)&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((rc = getaddrinfo(dp->host, dp->port, &hints, &res)) != 0) {
+        fprintf(stderr, "wxdnsget - %s: %s\n", dp->host, gai_strerror(rc));
+        /* an old answer beats no answer, try again in a minute */
+        dp->expires = now + 60;
+        return dp->naddr;
+    }
+    for (n = 0, ai = res; ai && n < WXDNSMAX; ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+        memcpy(&dp->addr[n], ai->ai_addr, ai->ai_addrlen);
+        dp->addrlen[n] = ai->ai_addrlen;
+        ++n;
+    }
+    freeaddrinfo(res);
+    if (n > 0) {
+        dp->naddr = n;
+        dp->cur %= n;
+    }
+    dp->expires = now + dp->ttl;
+    return dp->naddr;
+}
+
+/*
+ * the current address isn't working out, use the next one
+ */
+void
+wxdnsnext(wxdns_t *dp)
+{
+    if (dp->naddr > 0) {
+        dp->cur = (dp->cur + 1) % dp->naddr;
+    }
+}
+
+/*
+ * start a non-blocking connect to the cached address, *pendingp is
+ * set if it's still on its way (see wxconnectdone()).  The returned
+ * socket is left non-blocking.
+ */
+int
+wxconnectstart(wxdns_t *dp, int *pendingp)
+{
+    int s;
+    int on;
+
+    *pendingp = 0;
+    if (wxdnsget(dp) == 0) {
+        return -1;
+    }
+    if ((s = socket(dp->addr[dp->cur].ss_family, SOCK_STREAM, 0)) == -1) {
+        perror("wxconnect - socket");
+        return -1;
+    }
+    if (fcntl(s, F_SETFL, O_NONBLOCK) == -1) {
+        perror("wxconnect - fcntl");
+        (void)close(s);
+        return -1;
+    }
+    on = 1;
+    (void)setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (connect(s, (struct sockaddr *)&dp->addr[dp->cur],
+                dp->addrlen[dp->cur]) == 0) {
+        return s;
+    }
+    if (errno != EINPROGRESS) {
+        perror("wxconnect - connect");
+        (void)close(s);
+        wxdnsnext(dp);
+        return -1;
+    }
+    *pendingp = 1;
+    return s;
+}
+
+/*
+ * how a connect from wxconnectstart() is getting on without waiting
+ * for it, 0 once it's through, 1 while it's on its way and -1 if it
+ * failed or it's past expire (wxmsnow() ms).  A failed socket is
+ * closed and the next address gets the next try.
+ */
+int
+wxconnectdone(wxdns_t *dp, int s, int64_t expire)
+{
+    struct pollfd pfd;
+    socklen_t len;
+    int err;
+    int rc;
+
+    pfd.fd = s;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    do {
+        rc = poll(&pfd, 1, 0);
+    } while (rc == -1 && errno == EINTR);
+    if (rc == 0 && wxmsnow() < expire) {
+        return 1;
+    }
+    err = 0;
+    len = sizeof(err);
+    if (rc == 1 && getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) == 0 &&
+        err == 0) {
+        return 0;
+    }
+    fprintf(stderr, "wxconnect - %s: %s\n", dp->host,
+            rc == 0 ? "timed out" : strerror(err ? err : errno));
+    (void)close(s);
+    wxdnsnext(dp);
+    return -1;
+}
+
+/*
+ * connect to the cached address, waits at most timeout ms.  The
+ * returned socket is left non-blocking.
+ */
+int
+wxconnect(wxdns_t *dp, int timeout)
+{
+    int64_t expire;
+    int pending;
+    int rc;
+    int s;
+
+    expire = wxmsnow() + timeout;
+    if ((s = wxconnectstart(dp, &pending)) == -1 || !pending) {
+        return s;
+    }
+    while ((rc = wxconnectdone(dp, s, expire)) == 1) {
+        (void)wxsockwait(s, POLLOUT, expire);
+    }
+    return rc == 0 ? s : -1;
+}
+
+/*
+ * wait for a socket to be ready until the deadline (wxmsnow() ms),
+ * returns 1 when ready, 0 on timeout, -1 on error
+ */
+int
+wxsockwait(int s, short events, int64_t expire)
+{
+    struct pollfd pfd;
+    int64_t left;
+    int rc;
+
+    pfd.fd = s;
+    pfd.events = events;
+    do {
+        if ((left = expire - wxmsnow()) < 0) {
+            left = 0;
+        }
+        rc = poll(&pfd, 1, (int)left);
+    } while (rc == -1 && errno == EINTR);
+    if (rc == -1) {
+        perror("wxsockwait - poll");
+        return -1;
+    }
+    return rc > 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * cached name lookups, resolving a server costs a DNS round trip so
+ * we keep the answers for ttl seconds and walk through them if the
+ * one we're using stops answering.  Needs <sys/socket.h>.
+ */
+#define WXDNSMAX        8       /* addresses kept per name */
+#define WXDNSTTL        3600    /* default seconds to trust an answer */
+
+typedef struct wxdns {
+    char host[128];
+    char port[8];
+    struct sockaddr_storage addr[WXDNSMAX];
+    socklen_t addrlen[WXDNSMAX];
+    int naddr;                  /* addresses in the cache */
+    int cur;                    /* the one we're using */
+    time_t expires;             /* when to look again */
+    int ttl;                    /* seconds to keep answers */
+} wxdns_t;
+
+/*
+ * persistent HTTP/1.1 connection, private to http.c
+ */
+typedef struct wxhttp wxhttp_t;
+
+/*
+ * persistent APRS-IS session, private to aprs.c
+ */
+typedef struct wxaprs wxaprs_t;
+
+/*
+ * MQTT 3.1.1 client session, private to mqtt.c
+ */
+typedef struct wxmqtt wxmqtt_t;
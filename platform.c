@@ -0,0 +1,131 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Keeping the sampling loop's timing steady on a busy machine:
+ * real-time scheduling, optionally pinned to one CPU with all our
+ * memory locked in.  Each OS does this its own way, rtprio() and
+ * cpuset on FreeBSD, SCHED_FIFO and sched_setaffinity() on Linux.
+ * Only the calling thread is moved, threads started before this
+ * (the uploader, the HTTP server and the publishers) stay ordinary.
+ * None of it is fatal, without the privileges we say so and carry on
+ * at normal priority.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#ifdef __FreeBSD__
+#include <sys/param.h>
+#include <sys/cpuset.h>
+#include <sys/rtprio.h>
+#endif /*__FreeBSD__*/
+
+/*
+ * real-time priority for the calling thread, halfway up the range so
+ * the kernel's own interrupt threads still come first
+ */
+static int
+wxplatprio(void)
+{
+#ifdef __FreeBSD__
+    struct rtprio rtp;
+
+    rtp.type = RTP_PRIO_REALTIME;
+    rtp.prio = (RTP_PRIO_MIN + RTP_PRIO_MAX) / 2;       /* lower is better */
+    if (rtprio_thread(RTP_SET, 0, &rtp) != 0) {
+        perror("wxrealtime - rtprio_thread");
+        return -1;
+    }
+    return 0;
+#else
+    struct sched_param sp;
+    int min;
+    int max;
+
+    if ((min = sched_get_priority_min(SCHED_FIFO)) == -1 ||
+        (max = sched_get_priority_max(SCHED_FIFO)) == -1) {
+        perror("wxrealtime - sched_get_priority");
+        return -1;
+    }
+    memset((void *)&sp, 0, sizeof(sp));
+    sp.sched_priority = (min + max) / 2;
+    if ((errno = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp)) != 0) {
+        perror("wxrealtime - pthread_setschedparam(SCHED_FIFO)");
+        return -1;
+    }
+    return 0;
+#endif /*__FreeBSD__*/
+}
+
+/*
+ * keep the calling thread on cpu
+ */
+static int
+wxplatpin(int cpu)
+{
+#if defined(__FreeBSD__)
+    cpuset_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1, sizeof(set), &set) != 0) {
+        perror("wxrealtime - cpuset_setaffinity");
+        return -1;
+    }
+    return 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("wxrealtime - sched_setaffinity");
+        return -1;
+    }
+    return 0;
+#else
+    (void)cpu;
+    fprintf(stderr, "wxrealtime - can't pin to a CPU here\n");
+    return -1;
+#endif
+}
+
+/*
+ * move the calling thread to real-time priority, onto cpu unless
+ * that's -1, and lock our memory in if lock is set.  Returns the
+ * number of those that couldn't be done.
+ */
+int
+wxrealtime(int cpu, int lock)
+{
+    int failed;
+
+    failed = 0;
+    if (wxplatprio() != 0) {
+        fprintf(stderr, "wxrealtime - running at normal priority\n");
+        ++failed;
+    }
+    if (cpu >= 0 && wxplatpin(cpu) != 0) {
+        ++failed;
+    }
+    /* a page fault in the middle of a read is as bad as being scheduled out */
+    if (lock && mlockall(MCL_CURRENT|MCL_FUTURE) != 0) {
+        perror("wxrealtime - mlockall");
+        ++failed;
+    }
+    return failed;
+}
@@ -0,0 +1,309 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Fan out of every sample to internal consumers: an MQTT broker and
+ * a UDP multicast group.  The sampling loop hands us each sample once,
+ * already made JSON by wxschemajson(), and we put a reference to the
+ * same buffer on each sink's queue.  Every sink has its own thread and
+ * its own bounded queue, when one falls behind (a broker that's slow
+ * or gone) its oldest message is thrown away, as in queue.c, so
+ * nothing waits on it but itself.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+#include "net.h"
+
+#define PUBSINKS        2       /* one of each */
+#define PUBQLEN         64      /* messages a sink holds */
+#define PUBTIMEOUT      5000    /* ms a sink gets to send one */
+#define PUBMQTTPORT     "1883"
+#define PUBKEEPALIVE    60      /* seconds, for the broker */
+
+typedef struct wxpubmsg {
+    atomic_uint refs;           /* sinks yet to send it */
+    char topic[128];            /* for MQTT */
+    size_t len;
+    char data[];
+} wxpubmsg_t;
+
+typedef struct wxpubsink wxpubsink_t;
+
+struct wxpubsink {
+    const char *name;
+    int (*send)(wxpubsink_t *pp, const wxpubmsg_t *mp);
+    void (*idle)(wxpubsink_t *pp);
+    wxmqtt_t *mqtt;             /* the broker ... */
+    int fd;                     /* ... or the group's socket */
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    wxpubmsg_t *q[PUBQLEN];
+    unsigned int head;
+    unsigned int tail;
+};
+
+/* from mqtt.c */
+extern wxmqtt_t *wxmqttnew(const char *host, const char *port, const char *id, int keepalive);
+extern int wxmqttpublish(wxmqtt_t *mp, const char *topic, const char *payload, size_t len,
+                         int timeout);
+extern void wxmqttidle(wxmqtt_t *mp, int timeout);
+
+/* from stats.c */
+extern void wxstatinc(int c);
+
+static wxpubsink_t wxpubsinks[PUBSINKS];
+static int wxnpubsinks;
+static char wxpubtopic[64];
+
+static void
+wxpubdrop(wxpubmsg_t *mp)
+{
+    if (atomic_fetch_sub(&mp->refs, 1) == 1) {
+        free(mp);
+    }
+}
+
+static wxpubsink_t *
+wxpubsinknew(const char *name)
+{
+    wxpubsink_t *pp;
+
+    if (wxnpubsinks == PUBSINKS) {
+        fprintf(stderr, "wxpubsinknew - no room for %s\n", name);
+        return (wxpubsink_t *)0;
+    }
+    pp = &wxpubsinks[wxnpubsinks++];
+    memset((void *)pp, 0, sizeof(wxpubsink_t));
+    pp->name = name;
+    pp->fd = -1;
+    (void)pthread_mutex_init(&pp->lock, (pthread_mutexattr_t *)0);
+    (void)pthread_cond_init(&pp->cond, (pthread_condattr_t *)0);
+    return pp;
+}
+
+static int
+wxpubmqttsend(wxpubsink_t *pp, const wxpubmsg_t *mp)
+{
+    return wxmqttpublish(pp->mqtt, mp->topic, mp->data, mp->len, PUBTIMEOUT);
+}
+
+static void
+wxpubmqttidle(wxpubsink_t *pp)
+{
+    wxmqttidle(pp->mqtt, PUBTIMEOUT);
+}
+
+/*
+ * publish to broker host[:port] as client id, under topic/<station>
+ */
+int
+wxpubmqtt(const char *broker, const char *topic, const char *id)
+{
+    wxpubsink_t *pp;
+    char host[128];
+    const char *port;
+    const char *p;
+
+    if ((p = strrchr(broker, ':'))) {
+        (void)snprintf(host, sizeof(host), "%.*s", (int)(p - broker), broker);
+        port = p + 1;
+    } else {
+        (void)snprintf(host, sizeof(host), "%s", broker);
+        port = PUBMQTTPORT;
+    }
+    strncpy(wxpubtopic, topic, sizeof(wxpubtopic)-1);
+    if (!(pp = wxpubsinknew("mqtt"))) {
+        return -1;
+    }
+    if (!(pp->mqtt = wxmqttnew(host, port, id, PUBKEEPALIVE))) {
+        --wxnpubsinks;
+        return -1;
+    }
+    pp->send = wxpubmqttsend;
+    pp->idle = wxpubmqttidle;
+    return 0;
+}
+
+static int
+wxpubmcastsend(wxpubsink_t *pp, const wxpubmsg_t *mp)
+{
+    ssize_t rc;
+
+    do {
+        rc = sendto(pp->fd, mp->data, mp->len, 0, (struct sockaddr *)&pp->addr, pp->addrlen);
+    } while (rc == -1 && errno == EINTR);
+    return rc == (ssize_t)mp->len ? 0 : -1;
+}
+
+/*
+ * send each sample as a datagram to group:port, ttl hops out
+ */
+int
+wxpubmcast(const char *group, int ttl)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    wxpubsink_t *pp;
+    char host[128];
+    const char *p;
+    unsigned char ttl4;
+    int rc;
+
+    if (!(p = strrchr(group, ':'))) {
+        fprintf(stderr, "wxpubmcast - %s isn't group:port\n", group);
+        return -1;
+    }
+    (void)snprintf(host, sizeof(host), "%.*s", (int)(p - group), group);
+    memset((void *)&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if ((rc = getaddrinfo(host, p + 1, &hints, &res)) != 0) {
+        fprintf(stderr, "wxpubmcast - %s: %s\n", group, gai_strerror(rc));
+        return -1;
+    }
+    if (res->ai_addrlen > sizeof(struct sockaddr_storage) || !(pp = wxpubsinknew("mcast"))) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    memcpy(&pp->addr, res->ai_addr, res->ai_addrlen);
+    pp->addrlen = res->ai_addrlen;
+    ttl4 = (unsigned char)ttl;
+    if ((pp->fd = socket(res->ai_family, SOCK_DGRAM, 0)) == -1 ||
+        (res->ai_family == AF_INET &&
+         setsockopt(pp->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl4, sizeof(ttl4)) == -1) ||
+        (res->ai_family == AF_INET6 &&
+         setsockopt(pp->fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl)) == -1)) {
+        perror("wxpubmcast");
+        if (pp->fd != -1) {
+            (void)close(pp->fd);
+        }
+        --wxnpubsinks;
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    pp->send = wxpubmcastsend;
+    return 0;
+}
+
+/*
+ * a sink's thread, sends what's queued and otherwise keeps its
+ * connection alive
+ */
+static void *
+wxpubsinkrun(void *arg)
+{
+    wxpubsink_t *pp;
+    wxpubmsg_t *mp;
+    struct timespec ts;
+
+    pp = arg;
+    while (1) {
+        (void)pthread_mutex_lock(&pp->lock);
+        if (pp->head == pp->tail) {
+            (void)clock_gettime(CLOCK_REALTIME, &ts);
+            ++ts.tv_sec;
+            (void)pthread_cond_timedwait(&pp->cond, &pp->lock, &ts);
+        }
+        if (pp->head == pp->tail) {
+            (void)pthread_mutex_unlock(&pp->lock);
+            if (pp->idle) {
+                pp->idle(pp);
+            }
+            continue;
+        }
+        mp = pp->q[pp->tail++ % PUBQLEN];
+        (void)pthread_mutex_unlock(&pp->lock);
+        if (pp->send(pp, mp) != 0) {
+            wxstatinc(WXC_PUBFAIL);
+        }
+        wxpubdrop(mp);
+    }
+    return (void *)0;   /*NOTREACHED*/
+}
+
+/*
+ * start the sinks' threads, returns how many are running
+ */
+int
+wxpubstart(void)
+{
+    int n;
+    int i;
+
+    for (n = i = 0; i < wxnpubsinks; ++i) {
+        if ((errno = pthread_create(&wxpubsinks[i].tid, (pthread_attr_t *)0,
+                                    wxpubsinkrun, (void *)&wxpubsinks[i])) != 0) {
+            perror("wxpubstart - pthread_create");
+            continue;
+        }
+        ++n;
+    }
+    return n;
+}
+
+/*
+ * queue station's sample, json from wxschemajson(), for every sink
+ */
+void
+wxpubput(const char *station, const char *json, size_t len)
+{
+    wxpubsink_t *pp;
+    wxpubmsg_t *mp;
+    char *p;
+
+    if (wxnpubsinks == 0) {
+        return;
+    }
+    if (!(mp = malloc(sizeof(wxpubmsg_t) + len))) {
+        perror("wxpubput - malloc");
+        return;
+    }
+    atomic_init(&mp->refs, (unsigned int)wxnpubsinks);
+    (void)snprintf(mp->topic, sizeof(mp->topic), "%s/%s", wxpubtopic, station);
+    /* the station is one level, even named for its device, eg /dev/ttyS0 */
+    for (p = mp->topic + strlen(wxpubtopic) + 1; *p; ++p) {
+        if (*p == '/' || *p == '+' || *p == '#') {
+            *p = '_';
+        }
+    }
+    mp->len = len;
+    memcpy(mp->data, json, len);
+    for (pp = wxpubsinks; pp < &wxpubsinks[wxnpubsinks]; ++pp) {
+        (void)pthread_mutex_lock(&pp->lock);
+        if (pp->head - pp->tail >= PUBQLEN) {
+            wxpubdrop(pp->q[pp->tail++ % PUBQLEN]);     /* stale, make room */
+            wxstatinc(WXC_PUBDROPPED);
+        }
+        pp->q[pp->head++ % PUBQLEN] = mp;
+        (void)pthread_cond_signal(&pp->cond);
+        (void)pthread_mutex_unlock(&pp->lock);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Bounded queue of samples between the sampling loop and the upload
+ * thread.  The sampler never waits, if the uploader has fallen behind
+ * the oldest queued sample is thrown away to make room for the new one.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+/*
+ * room for len samples, -1 if we can't get it (the lock is good
+ * either way)
+ */
+int
+wxqinit(wxq_t *qp, unsigned int len)
+{
+    memset((void *)qp, 0, sizeof(wxq_t));
+    (void)pthread_mutex_init(&qp->lock, (pthread_mutexattr_t *)0);
+    (void)pthread_cond_init(&qp->cond, (pthread_condattr_t *)0);
+    if (!(qp->q = calloc(len, sizeof(wxdat_t)))) {
+        perror("wxqinit - calloc");
+        return -1;
+    }
+    qp->len = len;
+    return 0;
+}
+
+void
+wxqput(wxq_t *qp, const wxdat_t *wxdp)
+{
+    (void)pthread_mutex_lock(&qp->lock);
+    if (qp->head - qp->tail >= qp->len) {
+        ++qp->tail;             /* stale, make room */
+        ++qp->dropped;
+    }
+    memcpy(&qp->q[qp->head++ % qp->len], wxdp, sizeof(wxdat_t));
+    (void)pthread_cond_signal(&qp->cond);
+    (void)pthread_mutex_unlock(&qp->lock);
+}
+
+/*
+ * wait for the oldest queued sample
+ */
+void
+wxqget(wxq_t *qp, wxdat_t *wxdp)
+{
+    (void)pthread_mutex_lock(&qp->lock);
+    while (qp->head == qp->tail) {
+        (void)pthread_cond_wait(&qp->cond, &qp->lock);
+    }
+    memcpy(wxdp, &qp->q[qp->tail++ % qp->len], sizeof(wxdat_t));
+    (void)pthread_mutex_unlock(&qp->lock);
+}
+
+/*
+ * is anything waiting, for the uploader to tell whether it can spend
+ * time on old samples
+ */
+int
+wxqpending(wxq_t *qp)
+{
+    int rc;
+
+    (void)pthread_mutex_lock(&qp->lock);
+    rc = qp->head != qp->tail;
+    (void)pthread_mutex_unlock(&qp->lock);
+    return rc;
+}
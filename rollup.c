@@ -0,0 +1,273 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Minute, hour and day rollups of what's logged, see fwxroll.h for
+ * the files.  Each one is sized for every slot it could hold when
+ * it's made and mmap()ed, adding a sample is a few stores into the
+ * minute, hour and day slots it lands in.  Nothing is synced as we
+ * go, the page cache survives us crashing and a slot that's lost to
+ * the machine going down is refilled by the next day's samples.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+#include "fwxbin.h"
+#include "fwxroll.h"
+
+static const struct {
+    const char *name;           /* strftime() format */
+    int nslots;
+    int secs;                   /* per slot, 0 for days */
+} wxrollperiods[FWXR_NPERIODS] = {
+    { "%Y.%m.%d.fwm",   FWXR_MINSLOTS,  60 },
+    { "%Y.fwh",         FWXR_HOURSLOTS, 60 * 60 },
+    { "%Y.fwd",         FWXR_DAYSLOTS,  0 },
+};
+
+/* from fwxbin.c */
+extern void fwxradd(fwxrrec_t *sp, int64_t start, const fwxbrec_t *rp, int rain);
+extern void fwxrsadd(fwxrsrec_t *sp, int64_t start, const fwxbrec_t *rp, int rain);
+extern const fwxrrec_t *fwxrget(const fwxrhdr_t *hp, int i, fwxrrec_t *bufp);
+
+/* what a new file of period p gets, see FWXR_SHORT() */
+#define ROLLRECSIZE(p)  ((p) != FWXR_DAY ? sizeof(fwxrsrec_t) : sizeof(fwxrrec_t))
+#define ROLLLEN(p)      (sizeof(fwxrhdr_t) + \
+                         (size_t)wxrollperiods[p].nslots * ROLLRECSIZE(p))
+
+void
+wxrollinit(wxroll_t *rp)
+{
+    int p;
+
+    memset((void *)rp, 0, sizeof(wxroll_t));
+    for (p = 0; p < FWXR_NPERIODS; ++p) {
+        rp->f[p].fd = -1;
+    }
+    rp->rainlast = -1;
+}
+
+static void
+wxrollfclose(wxrollf_t *fp)
+{
+    if (fp->map) {
+        (void)munmap(fp->map, fp->len);
+        fp->map = (void *)0;
+    }
+    if (fp->fd != -1) {
+        (void)close(fp->fd);
+        fp->fd = -1;
+    }
+    fp->start = fp->end = 0;
+}
+
+/*
+ * open (or make) the file of period p covering t
+ */
+static int
+wxrollfopen(wxroll_t *rp, int p, const char *logdir, time_t t)
+{
+    char name[32];
+    wxrollf_t *fp;
+    fwxrhdr_t *hp;
+    struct stat st;
+    struct tm tm;
+
+    fp = &rp->f[p];
+    wxrollfclose(fp);
+    (void)localtime_r(&t, &tm);
+    (void)strftime(name, sizeof(name), wxrollperiods[p].name, &tm);
+    (void)snprintf(fp->path, sizeof(fp->path), "%s/%s", logdir, name);
+    /* let mktime() sort out month ends & DST */
+    tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+    if (p != FWXR_MINUTE) {
+        tm.tm_mday = 1;
+        tm.tm_mon = 0;
+    }
+    tm.tm_isdst = -1;
+    fp->start = mktime(&tm);
+    if (p == FWXR_MINUTE) {
+        ++tm.tm_mday;
+    } else {
+        ++tm.tm_year;
+    }
+    tm.tm_isdst = -1;
+    fp->end = mktime(&tm);
+
+    if ((fp->fd = open(fp->path, O_RDWR|O_CREAT, 0644)) == -1) {
+        perror(fp->path);
+        fp->start = fp->end = 0;
+        return -1;
+    }
+    if (fstat(fp->fd, &st) == -1 ||
+        (st.st_size == 0 && ftruncate(fp->fd, (off_t)ROLLLEN(p)) == -1)) {
+        perror(fp->path);
+        wxrollfclose(fp);
+        return -1;
+    }
+    /* one made before short slots is kept up in its own format */
+    fp->len = st.st_size == 0 ? ROLLLEN(p) : (size_t)st.st_size;
+    if (fp->len < sizeof(fwxrhdr_t)) {
+        fprintf(stderr, "wxrollfopen - %s isn't a rollup this fwx can update\n", fp->path);
+        wxrollfclose(fp);
+        return -1;
+    }
+    fp->map = mmap((void *)0, fp->len, PROT_READ|PROT_WRITE, MAP_SHARED, fp->fd, 0);
+    if (fp->map == MAP_FAILED) {
+        perror("wxrollfopen - mmap");
+        fp->map = (void *)0;
+        wxrollfclose(fp);
+        return -1;
+    }
+    hp = fp->map;
+    if (st.st_size == 0) {
+        memcpy(hp->magic, FWXR_MAGIC, sizeof(hp->magic));
+        hp->bom = FWXB_BOM;
+        hp->vermaj = FWXR_VERMAJ;
+        hp->vermin = FWXR_VERMIN;
+        hp->hdrsize = sizeof(fwxrhdr_t);
+        hp->recsize = (uint16_t)ROLLRECSIZE(p);
+        hp->nfields = FWXB_NFIELDS;
+        hp->period = (uint16_t)p;
+        hp->nslots = (uint16_t)wxrollperiods[p].nslots;
+        hp->rainlast = rp->rainlast;
+        hp->start = (int64_t)fp->start;
+    } else if (memcmp(hp->magic, FWXR_MAGIC, sizeof(hp->magic)) != 0 ||
+               hp->bom != FWXB_BOM || hp->vermaj != FWXR_VERMAJ ||
+               hp->hdrsize != sizeof(fwxrhdr_t) ||
+               hp->recsize != (FWXR_SHORT(hp) ? sizeof(fwxrsrec_t) : sizeof(fwxrrec_t)) ||
+               hp->nfields != FWXB_NFIELDS || hp->period != p ||
+               hp->nslots != wxrollperiods[p].nslots ||
+               fp->len != hp->hdrsize + (size_t)hp->nslots * hp->recsize) {
+        fprintf(stderr, "wxrollfopen - %s isn't a rollup this fwx can update\n", fp->path);
+        wxrollfclose(fp);
+        return -1;
+    }
+    /* the minute file carries the rain total over a restart */
+    if (p == FWXR_MINUTE && hp->rainlast >= 0) {
+        rp->rainlast = hp->rainlast;
+    }
+    return 0;
+}
+
+/*
+ * the slot of period p's open file t lands in and when that slot
+ * starts, -1 if t isn't in the file
+ */
+static long
+wxrollindex(const wxroll_t *rp, int p, time_t t, time_t *startp)
+{
+    const wxrollf_t *fp;
+    struct tm tm;
+    long slot;
+
+    fp = &rp->f[p];
+    if (!fp->map || t < fp->start || t >= fp->end) {
+        return -1;
+    }
+    if (wxrollperiods[p].secs) {
+        slot = (long)(t - fp->start) / wxrollperiods[p].secs;
+        *startp = fp->start + (time_t)slot * wxrollperiods[p].secs;
+    } else {
+        (void)localtime_r(&t, &tm);
+        slot = tm.tm_yday;
+        tm.tm_sec = tm.tm_min = tm.tm_hour = 0;
+        tm.tm_isdst = -1;
+        *startp = mktime(&tm);
+    }
+    return slot < ((const fwxrhdr_t *)fp->map)->nslots ? slot : -1;
+}
+
+/*
+ * the period p slot t is in, widened into *bufp if need be, NULL if
+ * that isn't open
+ */
+const fwxrrec_t *
+wxrollslot(const wxroll_t *rp, int p, time_t t, fwxrrec_t *bufp)
+{
+    time_t start;
+    long slot;
+
+    if ((slot = wxrollindex(rp, p, t, &start)) < 0) {
+        return (const fwxrrec_t *)0;
+    }
+    return fwxrget((const fwxrhdr_t *)rp->f[p].map, (int)slot, bufp);
+}
+
+/*
+ * add a logged sample to its minute, hour and day
+ */
+int
+wxrolladd(wxroll_t *rp, const char *logdir, const fwxbrec_t *recp)
+{
+    wxrollf_t *fp;
+    fwxrhdr_t *hp;
+    time_t t;
+    time_t start;
+    long slot;
+    int rain;
+    int p;
+
+    t = (time_t)recp->time;
+    for (p = 0; p < FWXR_NPERIODS; ++p) {
+        fp = &rp->f[p];
+        if ((t < fp->start || t >= fp->end) && wxrollfopen(rp, p, logdir, t) != 0) {
+            return -1;
+        }
+    }
+
+    /* rain by the yearly total so the daily & monthly resets don't matter */
+    rain = 0;
+    if (FWXB_ISVALID(recp, FWXB_RAINYEAR)) {
+        if (rp->rainlast >= 0 && FWXB_GETVAL(recp, FWXB_RAINYEAR) > rp->rainlast) {
+            rain = (int)(FWXB_GETVAL(recp, FWXB_RAINYEAR) - rp->rainlast);
+        }
+        rp->rainlast = (int)FWXB_GETVAL(recp, FWXB_RAINYEAR);
+        ((fwxrhdr_t *)rp->f[FWXR_MINUTE].map)->rainlast = rp->rainlast;
+    }
+
+    for (p = 0; p < FWXR_NPERIODS; ++p) {
+        if ((slot = wxrollindex(rp, p, t, &start)) < 0) {
+            continue;
+        }
+        hp = rp->f[p].map;
+        if (FWXR_SHORT(hp)) {
+            fwxrsadd(FWXR_SLOT(hp, slot), (int64_t)start, recp, rain);
+        } else {
+            fwxradd(FWXR_SLOT(hp, slot), (int64_t)start, recp, rain);
+        }
+    }
+    return 0;
+}
+
+void
+wxrollclose(wxroll_t *rp)
+{
+    int p;
+
+    for (p = 0; p < FWXR_NPERIODS; ++p) {
+        if (rp->f[p].map && msync(rp->f[p].map, rp->f[p].len, MS_SYNC) == -1) {
+            perror("wxrollclose - msync");
+        }
+        wxrollfclose(&rp->f[p]);
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Sample deadlines on wall clock interval boundaries, with a 30
+ * second interval samples are due at :00 and :30 past every minute
+ * no matter when fwx started or how long the last one took.  Each
+ * deadline is absolute so lateness never adds up, a sample that runs
+ * past the next boundary costs that boundary (counted as an overrun)
+ * rather than pushing every later sample back.  The interval can be
+ * changed as we go, see wxadapt() in fwx.c.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+/* from stats.c */
+extern void wxstatadd(int c, unsigned long n);
+extern void wxstattime(int h, int64_t us);
+
+/*
+ * microseconds on the wall clock
+ */
+int64_t
+wxschednow(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * the first boundary after t
+ */
+static time_t
+wxschedafter(const wxsched_t *sp, time_t t)
+{
+    return (t / sp->interval + 1) * sp->interval;
+}
+
+void
+wxschedinit(wxsched_t *sp, int interval)
+{
+    sp->interval = interval > 0 ? interval : 1;
+    sp->next = wxschedafter(sp, time((time_t *)0));
+}
+
+/*
+ * sample every interval seconds from now on, the next one is due on
+ * the first of the new boundaries after now
+ */
+void
+wxschedset(wxsched_t *sp, int interval)
+{
+    if (interval < 1) {
+        interval = 1;
+    }
+    if (interval != sp->interval) {
+        sp->interval = interval;
+        sp->next = wxschedafter(sp, time((time_t *)0));
+    }
+}
+
+/*
+ * sleep 'til the next boundary, -1 if a signal got there first.  If
+ * the absolute sleep fails for any other reason we fall back to a
+ * relative one so the caller's retry can't spin (it would hog the cpu
+ * running SCHED_FIFO), a boundary that's already gone by doesn't wait
+ * at all.
+ */
+int
+wxschedwait(const wxsched_t *sp)
+{
+    struct timespec ts;
+    int64_t us;
+    int rc;
+
+    ts.tv_sec = sp->next;
+    ts.tv_nsec = 0;
+    if ((rc = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts,
+                              (struct timespec *)0)) == 0) {
+        return 0;
+    }
+    if (rc == EINTR) {
+        return -1;
+    }
+    errno = rc;
+    perror("wxschedwait - clock_nanosleep");
+    us = (int64_t)sp->next * 1000000 - wxschednow();
+    if (us <= 0) {
+        return 0;               /* already due */
+    }
+    if (us > (int64_t)sp->interval * 1000000) {
+        us = (int64_t)sp->interval * 1000000;
+    }
+    ts.tv_sec = (time_t)(us / 1000000);
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    return nanosleep(&ts, (struct timespec *)0) == 0 ? 0 : -1;
+}
+
+/*
+ * the sample due at sp->next was taken at us (wxschednow()), account
+ * for how late it was and move on to the first boundary after it
+ */
+void
+wxschedtick(wxsched_t *sp, int64_t us)
+{
+    int64_t late;
+    int64_t ivl;
+
+    late = us - (int64_t)sp->next * 1000000;
+    if (late < 0) {
+        late = 0;
+    }
+    ivl = (int64_t)sp->interval * 1000000;
+    if (late >= ivl) {
+        wxstatadd(WXC_OVERRUN, (unsigned long)(late / ivl));
+        late %= ivl;
+    }
+    wxstattime(WXH_JITTER, late);
+    sp->next = wxschedafter(sp, (time_t)(us / 1000000));
+}
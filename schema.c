@@ -0,0 +1,279 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Which wxdat_t fields go where.  The daily log, the binary log, the
+ * WU/PWSweather query and the APRS weather report are all walks over
+ * wxfields[] below, formatted straight from the scaled integers the
+ * station sent (WXD_GETRAW() with WXD_GVPLACES() decimal places) so
+ * no floats are involved on the way out.
+ *
+ * Rows are in daily log column order, csv is also the field number in
+ * fwxbin.h.  Adding a field to an upload is one more row (or one more
+ * key in an existing row), adding one to the log means a new version
+ * of README.datafile and fwxbin.h too.
+ */
+
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+#include "fwxbin.h"
+
+/* from fwxbin.c */
+extern char *fwxbfmtfixed(char *s, long v, int places);
+
+#define F(x)    offsetof(wxdat_t, x)
+
+const wxfield_t wxfields[] = {
+    /* name       field               units   sgn csv needs query               aprs pos wid conv */
+    { "bar",       F(barometer),       "in",    0,   0, -1, "baromin",          'b', 5, 5, WXF_APRSMBAR },
+    { "windspeed", F(windspeed),       "mph",   0,   1, -1, (char *)0,          0,   0, 0, 0 },
+    { "winddir",   F(winddir),         "deg",   0,   2,  1, (char *)0,          0,   0, 0, 0 },
+    { "avgwind",   F(avgwindspeed),    "mph",   0,   3, -1, (char *)0,          0,   0, 0, 0 },
+    { "tempin",    F(indoortemp),      "deg F", 1,   4, -1, (char *)0,          0,   0, 0, 0 },
+    { "tempout",   F(outdoortemp),     "deg F", 1,   5, -1, "tempf",            't', 0, 3, WXF_APRSPLAIN },
+    { "dewpoint",  F(outdoordewpoint), "deg F", 1,   6, -1, "dewptf",           0,   0, 0, 0 },
+    { "humin",     F(indoorhum),       "%",     0,   7, -1, (char *)0,          0,   0, 0, 0 },
+    { "humout",    F(outdoorhum),      "%",     0,   8, -1, "humidity",         'h', 4, 2, WXF_APRSHUM },
+    { "rainrate",  F(rainrate),        "in/hr", 0,   9, -1, (char *)0,          0,   0, 0, 0 },
+    { "rainday",   F(rainday),         "in",    0,  10, -1, "dailyrainin",      'P', 3, 3, WXF_APRSHUND },
+    { "rainmonth", F(rainmonth),       "in",    0,  11, -1, (char *)0,          0,   0, 0, 0 },
+    { "rainyear",  F(rainyear),        "in",    0,  12, -1, (char *)0,          0,   0, 0, 0 },
+    { "solar",     F(solar),           "w/m2",  0,  13, -1, "solarradiation",   'L', 6, 3, WXF_APRSSOLAR },
+    { "rainhour",  F(rainhour),        "in",    0,  -1, -1, "rainin",           'r', 1, 3, WXF_APRSHUND },
+    { "rain24",    F(rain24),          "in",    0,  -1, -1, (char *)0,          'p', 2, 3, WXF_APRSHUND },
+    { "bartrend",  F(bartrend),        "in",    1,  -1, -1, (char *)0,          0,   0, 0, 0 },
+    { "avgwind2",  F(avgwind2),        "mph",   0,  -1, -1, "windspdmph_avg2m", 0,   0, 0, 0 },
+    { "heatindex", F(heatindex),       "deg F", 1,  -1, -1, (char *)0,          0,   0, 0, 0 },
+    { "rain15",    F(rain15),          "in",    0,  -1, -1, (char *)0,          0,   0, 0, 0 },
+};
+
+#define NFIELDS (int)(sizeof(wxfields) / sizeof(wxfields[0]))
+
+const int wxnfields = NFIELDS;
+
+#define FIELD(wxdp, fp) ((const wxd_t *)((const char *)(wxdp) + (fp)->off))
+
+static const long scale10[] = { 1, 10, 100, 1000, 10000, 100000 };
+
+/*
+ * move v from one number of implied decimal places to another,
+ * rounding half away from zero
+ */
+static long
+wxrescale(long v, int from, int to)
+{
+    long d;
+
+    if (from <= to) {
+        return v * scale10[to - from];
+    }
+    d = scale10[from - to];
+    return v < 0 ? -((-v + d / 2) / d) : (v + d / 2) / d;
+}
+
+/*
+ * width digits, zero filled, negatives lose a digit to the sign
+ */
+static char *
+wxfmtpad(char *s, long v, int width)
+{
+    char *e;
+
+    if (v < 0) {
+        *s++ = '-';
+        v = -v;
+        --width;
+    }
+    e = s + width;
+    while (e > s) {
+        *--e = '0' + v % 10;
+        v /= 10;
+    }
+    s += width;
+    *s = '\0';
+    return s;
+}
+
+/*
+ * the data columns of a README.datafile line, each followed by a
+ * comma, empty for anything we don't have
+ */
+char *
+wxschemacsv(char *s, const wxdat_t *wxdp)
+{
+    const wxfield_t *fp;
+    const wxd_t *dp;
+
+    for (fp = wxfields; fp < &wxfields[NFIELDS] && fp->csv >= 0; ++fp) {
+        dp = FIELD(wxdp, fp);
+        if (WXD_ISVALID(*dp) &&
+            (fp->needs < 0 || WXD_ISVALID(*FIELD(wxdp, &wxfields[fp->needs])))) {
+            s = fwxbfmtfixed(s, WXD_GETRAW(*dp), WXD_GVPLACES(*dp));
+        }
+        *s++ = ',';
+    }
+    *s = '\0';
+    return s;
+}
+
+void
+wxschemabin(const wxdat_t *wxdp, fwxbrec_t *rp)
+{
+    const wxfield_t *fp;
+    const wxd_t *dp;
+
+    memset((void *)rp, 0, sizeof(fwxbrec_t));
+    rp->time = wxdp->time;
+    for (fp = wxfields; fp < &wxfields[NFIELDS] && fp->csv >= 0; ++fp) {
+        dp = FIELD(wxdp, fp);
+        if (WXD_ISVALID(*dp)) {
+            rp->val[fp->csv] = (uint16_t)WXD_GETRAW(*dp);
+            rp->valid |= 1 << fp->csv;
+        }
+    }
+}
+
+/*
+ * a sample as a JSON object (name escaped), null for anything we
+ * don't have
+ */
+char *
+wxschemajson(char *s, const char *name, const wxdat_t *wxdp)
+{
+    const wxfield_t *fp;
+    const wxd_t *dp;
+
+    s = stpcpy(s, "{\"station\":\"");
+    for (; *name; ++name) {
+        if (*name == '"' || *name == '\\') {
+            *s++ = '\\';
+        }
+        if ((unsigned char)*name >= ' ') {
+            *s++ = *name;
+        }
+    }
+    s = stpcpy(s, "\",\"time\":");
+    s = fwxbfmtfixed(s, (long)wxdp->time, 0);
+    for (fp = wxfields; fp < &wxfields[NFIELDS]; ++fp) {
+        dp = FIELD(wxdp, fp);
+        *s++ = ',';
+        *s++ = '"';
+        s = stpcpy(s, fp->name);
+        s = stpcpy(s, "\":");
+        if (WXD_ISVALID(*dp)) {
+            s = fwxbfmtfixed(s, WXD_GETRAW(*dp), WXD_GVPLACES(*dp));
+        } else {
+            s = stpcpy(s, "null");
+        }
+    }
+    s = stpcpy(s, ",\"windgust\":");
+    s = fwxbfmtfixed(s, wxdp->windgust.speed, 0);
+    s = stpcpy(s, ",\"windgustdir\":");
+    s = fwxbfmtfixed(s, wxdp->windgust.direction, 0);
+    s = stpcpy(s, "}");
+    return s;
+}
+
+/*
+ * &key=value for everything WU & PWSweather take, they want exactly
+ * the units in the table so anything else stays home
+ */
+char *
+wxschemaquery(char *s, const wxdat_t *wxdp)
+{
+    const wxfield_t *fp;
+    const wxd_t *dp;
+
+    for (fp = wxfields; fp < &wxfields[NFIELDS]; ++fp) {
+        dp = FIELD(wxdp, fp);
+        if (!fp->query || !WXD_ISVALID(*dp) ||
+            strcmp(WXD_GETUNITS(*dp), fp->units) != 0) {
+            continue;
+        }
+        *s++ = '&';
+        s = stpcpy(s, fp->query);
+        *s++ = '=';
+        s = fwxbfmtfixed(s, WXD_GETRAW(*dp), WXD_GVPLACES(*dp));
+    }
+    return s;
+}
+
+/*
+ * the weather part of an APRS position report after the wind, see
+ * http://www.aprs.org/doc/APRS101.PDF chapter 12, missing values are
+ * sent as dots
+ */
+char *
+wxschemaaprs(char *s, const wxdat_t *wxdp)
+{
+    const wxfield_t *fp;
+    const wxd_t *dp;
+    long v;
+    int pos;
+
+    /* the codes have to go out in order, stop at the first gap */
+    for (pos = 0; ; ++pos) {
+        for (fp = wxfields; fp < &wxfields[NFIELDS]; ++fp) {
+            if (fp->aprs && fp->aprspos == pos) {
+                break;
+            }
+        }
+        if (fp == &wxfields[NFIELDS]) {
+            break;
+        }
+        dp = FIELD(wxdp, fp);
+        *s = fp->aprs;
+        if (!WXD_ISVALID(*dp) || strcmp(WXD_GETUNITS(*dp), fp->units) != 0) {
+            memset(s + 1, '.', fp->aprswidth);
+            s += 1 + fp->aprswidth;
+            continue;
+        }
+        v = WXD_GETRAW(*dp);
+        switch (fp->aprsconv) {
+        case WXF_APRSHUND:
+            v = wxrescale(v, WXD_GVPLACES(*dp), 2);
+            break;
+        case WXF_APRSHUM:
+            /* 2 digits, 100 is special cased as 00 */
+            v = wxrescale(v, WXD_GVPLACES(*dp), 0);
+            if (v > 99) {
+                v = 0;
+            }
+            break;
+        case WXF_APRSMBAR:
+            /* tenths of a millibar rather than inches of Hg */
+            v = wxrescale((long)((long long)v * 3386389 / 10000), WXD_GVPLACES(*dp), 0);
+            break;
+        case WXF_APRSSOLAR:
+            /* 3 digits, L for under 1000 w/m^2, l for the rest */
+            v = wxrescale(v, WXD_GVPLACES(*dp), 0);
+            if (v > 999) {
+                *s = 'l';
+                v -= 1000;
+            }
+            break;
+        default:
+            v = wxrescale(v, WXD_GVPLACES(*dp), 0);
+            break;
+        }
+        s = wxfmtpad(s + 1, v, fp->aprswidth);
+    }
+    *s = '\0';
+    return s;
+}
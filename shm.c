@@ -0,0 +1,87 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * writer side of the fwxshm.h segment, only fwx's sampling loop
+ * calls in here so there's never more than one writer
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "fwxbin.h"
+#include "fwxshm.h"
+
+/*
+ * create (or take over) the segment, a leftover from a previous run
+ * is reused so readers that still have it mapped carry on
+ */
+fwxshm_t *
+wxshmcreate(const char *name)
+{
+    fwxshm_t *sp;
+    int fd;
+
+    if ((fd = shm_open(name, O_RDWR|O_CREAT, 0644)) == -1) {
+        perror("wxshmcreate - shm_open");
+        return (fwxshm_t *)0;
+    }
+    if (ftruncate(fd, sizeof(fwxshm_t)) == -1) {
+        perror("wxshmcreate - ftruncate");
+        (void)close(fd);
+        return (fwxshm_t *)0;
+    }
+    sp = mmap((void *)0, sizeof(fwxshm_t), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (sp == MAP_FAILED) {
+        perror("wxshmcreate - mmap");
+        return (fwxshm_t *)0;
+    }
+
+    /* readers ignore it 'til the magic shows up */
+    memset(sp->magic, 0, sizeof(sp->magic));
+    atomic_thread_fence(memory_order_seq_cst);
+    sp->vermaj = FWXSHM_VERMAJ;
+    sp->vermin = FWXSHM_VERMIN;
+    sp->size = sizeof(fwxshm_t);
+    sp->nring = FWXSHM_RING;
+    sp->pid = (uint32_t)getpid();
+    atomic_store_explicit(&sp->seq, 0, memory_order_relaxed);
+    sp->count = 0;
+    memset((void *)&sp->latest, 0, sizeof(fwxbrec_t));
+    memset((void *)sp->ring, 0, sizeof(sp->ring));
+    atomic_thread_fence(memory_order_seq_cst);
+    memcpy(sp->magic, FWXSHM_MAGIC, sizeof(sp->magic));
+    return sp;
+}
+
+void
+wxshmput(fwxshm_t *sp, const fwxbrec_t *rp)
+{
+    uint32_t seq;
+
+    seq = atomic_load_explicit(&sp->seq, memory_order_relaxed);
+    atomic_store_explicit(&sp->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&sp->latest, rp, sizeof(fwxbrec_t));
+    memcpy(&sp->ring[sp->count % FWXSHM_RING], rp, sizeof(fwxbrec_t));
+    ++sp->count;
+    atomic_store_explicit(&sp->seq, seq + 2, memory_order_release);
+}
@@ -0,0 +1,286 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Uploads waiting for a service to come back.  A spool is a header
+ * followed by fixed size wxspoolrec_t records, new ones are appended
+ * and sent ones are only counted off in the header, so the file can
+ * be walked by index.  Once everything has been sent the file is
+ * truncated back to the header, and once at least as much has been
+ * sent as is left the rest is copied down to the front so a service
+ * that's never quite caught up can't grow the file without bound.
+ *
+ * A record is fsync()ed as it's added, it's only written when the
+ * service is down so there aren't many of them.  The header isn't,
+ * after a crash a few records may go out twice, the services keep
+ * the last one they get for a given time.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+#define SPOOLMAGIC "FWXSPOOL"
+#define SPOOLMAX 100000         /* records kept, about 24M, oldest tossed */
+#define SPOOLCOMPACT 1000       /* sent records worth copying the rest over */
+#define SPOOLCOPY 64            /* records moved at a time */
+
+typedef struct wxspoolhdr {
+    char magic[8];
+    uint32_t recsize;           /* sizeof(wxspoolrec_t) */
+    uint32_t nfields;           /* wxfields[] rows when it was made */
+    uint64_t head;              /* records already sent */
+} wxspoolhdr_t;
+
+#define RECOFF(i)       ((off_t)(sizeof(wxspoolhdr_t) + (i) * sizeof(wxspoolrec_t)))
+
+/* from schema.c */
+extern const wxfield_t wxfields[];
+extern const int wxnfields;
+
+#define FIELD(wxdp, c)  ((wxd_t *)((char *)(wxdp) + wxfields[c].off))
+
+void
+wxspoolinit(wxspool_t *qp)
+{
+    memset((void *)qp, 0, sizeof(wxspool_t));
+    qp->fd = -1;
+}
+
+static int
+wxspoolhdr(wxspool_t *qp)
+{
+    wxspoolhdr_t hdr;
+
+    memset((void *)&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SPOOLMAGIC, sizeof(hdr.magic));
+    hdr.recsize = sizeof(wxspoolrec_t);
+    hdr.nfields = (uint32_t)wxnfields;
+    hdr.head = qp->head;
+    if (pwrite(qp->fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        perror("wxspoolhdr - pwrite");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * where the last run left off, or a new header if there wasn't one
+ */
+static int
+wxspoolload(wxspool_t *qp)
+{
+    wxspoolhdr_t hdr;
+    struct stat st;
+    uint64_t n;
+
+    if (fstat(qp->fd, &st) == -1) {
+        perror("wxspoolload - fstat");
+        return -1;
+    }
+    if (st.st_size == 0) {
+        return wxspoolhdr(qp);
+    }
+    if (pread(qp->fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        memcmp(hdr.magic, SPOOLMAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.recsize != sizeof(wxspoolrec_t) || hdr.nfields > (uint32_t)wxnfields) {
+        fprintf(stderr, "wxspoolload - %s isn't a spool this fwx can read\n", qp->path);
+        return -1;
+    }
+    /* whole records only, a crash can leave half of one on the end */
+    n = (uint64_t)(st.st_size - (off_t)sizeof(hdr)) / sizeof(wxspoolrec_t);
+    if (st.st_size != RECOFF(n) && ftruncate(qp->fd, RECOFF(n)) == -1) {
+        perror("wxspoolload - ftruncate");
+        return -1;
+    }
+    qp->tail = n;
+    qp->head = hdr.head <= n ? hdr.head : n;
+    return 0;
+}
+
+int
+wxspoolopen(wxspool_t *qp, const char *path)
+{
+    if (wxnfields > WXSPOOLFIELDS) {
+        fprintf(stderr, "wxspoolopen - %d fields won't fit a record\n", wxnfields);
+        return -1;
+    }
+    wxspoolinit(qp);
+    if ((qp->fd = open(path, O_RDWR|O_CREAT, 0644)) == -1) {
+        perror(path);
+        return -1;
+    }
+    strncpy(qp->path, path, sizeof(qp->path)-1);
+    if (wxspoolload(qp) != 0) {
+        (void)close(qp->fd);
+        qp->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * move what hasn't been sent to the front of the file.  Only done
+ * when the sent part is at least as big as the rest so the copy never
+ * lands on a record it has yet to read, 'til the header says so the
+ * file is still good as it was.  The header goes before the truncate,
+ * a crash between the two sends some records twice rather than
+ * losing them.
+ */
+static int
+wxspoolcompact(wxspool_t *qp)
+{
+    wxspoolrec_t buf[SPOOLCOPY];
+    uint64_t depth;
+    uint64_t i;
+    size_t n;
+    size_t len;
+
+    depth = WXSPOOLDEPTH(qp);
+    for (i = 0; i < depth; i += n) {
+        n = depth - i < SPOOLCOPY ? (size_t)(depth - i) : SPOOLCOPY;
+        len = n * sizeof(wxspoolrec_t);
+        if (pread(qp->fd, buf, len, RECOFF(qp->head + i)) != (ssize_t)len ||
+            pwrite(qp->fd, buf, len, RECOFF(i)) != (ssize_t)len) {
+            perror("wxspoolcompact - copy");
+            return -1;
+        }
+    }
+    if (fsync(qp->fd) == -1) {
+        perror("wxspoolcompact - fsync");
+        return -1;
+    }
+    qp->head = 0;
+    qp->tail = depth;
+    if (wxspoolhdr(qp) != 0) {
+        return -1;
+    }
+    if (ftruncate(qp->fd, RECOFF(depth)) == -1) {
+        perror("wxspoolcompact - ftruncate");
+    }
+    return 0;
+}
+
+/*
+ * compact if enough has been sent
+ */
+static int
+wxspooltrim(wxspool_t *qp)
+{
+    if (qp->head >= SPOOLCOMPACT && qp->head >= WXSPOOLDEPTH(qp)) {
+        return wxspoolcompact(qp);
+    }
+    return wxspoolhdr(qp);
+}
+
+/*
+ * add a sample to the end, when the spool is full the oldest goes
+ */
+int
+wxspoolput(wxspool_t *qp, const wxdat_t *wxdp)
+{
+    wxspoolrec_t rec;
+    const wxd_t *dp;
+    int c;
+
+    if (qp->fd == -1) {
+        return -1;
+    }
+    memset((void *)&rec, 0, sizeof(rec));
+    rec.time = wxdp->time;
+    rec.wind[0] = wxdp->windcur.speed;
+    rec.wind[1] = wxdp->windcur.direction;
+    rec.wind[2] = wxdp->windgust.speed;
+    rec.wind[3] = wxdp->windgust.direction;
+    for (c = 0; c < wxnfields; ++c) {
+        dp = FIELD(wxdp, c);
+        if (WXD_ISVALID(*dp) && strcmp(WXD_GETUNITS(*dp), wxfields[c].units) == 0) {
+            rec.raw[c] = WXD_GETRAW(*dp);
+            rec.flags[c] = WXD_GETFLAGS(*dp);
+        }
+    }
+    if (pwrite(qp->fd, &rec, sizeof(rec), RECOFF(qp->tail)) != (ssize_t)sizeof(rec)) {
+        perror("wxspoolput - pwrite");
+        return -1;
+    }
+    if (fsync(qp->fd) == -1) {
+        perror("wxspoolput - fsync");
+    }
+    ++qp->tail;
+    if (WXSPOOLDEPTH(qp) > SPOOLMAX) {
+        ++qp->head;
+        (void)wxspooltrim(qp);
+    }
+    return 0;
+}
+
+/*
+ * the oldest sample not yet sent, 1 if there is one, 0 if the spool
+ * is empty, -1 if it can't be read
+ */
+int
+wxspoolpeek(wxspool_t *qp, wxdat_t *wxdp)
+{
+    wxspoolrec_t rec;
+    wxd_t *dp;
+    int c;
+
+    if (qp->fd == -1 || qp->head == qp->tail) {
+        return 0;
+    }
+    if (pread(qp->fd, &rec, sizeof(rec), RECOFF(qp->head)) != (ssize_t)sizeof(rec)) {
+        perror("wxspoolpeek - pread");
+        return -1;
+    }
+    memset((void *)wxdp, 0, sizeof(wxdat_t));
+    wxdp->time = (time_t)rec.time;
+    wxdp->windcur.speed = rec.wind[0];
+    wxdp->windcur.direction = rec.wind[1];
+    wxdp->windgust.speed = rec.wind[2];
+    wxdp->windgust.direction = rec.wind[3];
+    for (c = 0; c < wxnfields; ++c) {
+        dp = FIELD(wxdp, c);
+        WXD_SETUNITS(*dp, (char *)wxfields[c].units);
+        WXD_SETRAW(*dp, rec.raw[c]);
+        WXD_SETFLAGS(*dp, rec.flags[c]);
+    }
+    return 1;
+}
+
+/*
+ * the oldest sample has been sent
+ */
+int
+wxspoolpop(wxspool_t *qp)
+{
+    if (qp->fd == -1 || qp->head == qp->tail) {
+        return 0;
+    }
+    if (++qp->head < qp->tail) {
+        return wxspooltrim(qp);
+    }
+    /* all caught up, start over */
+    qp->head = qp->tail = 0;
+    if (ftruncate(qp->fd, RECOFF(0)) == -1) {
+        perror("wxspoolpop - ftruncate");
+    }
+    return wxspoolhdr(qp);
+}
@@ -0,0 +1,367 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * What a station has worked out from its samples, kept across
+ * restarts so gusts, rain totals and the barometric trend don't start
+ * over from nothing.  The state file is mmap()ed: a header, then each
+ * rolling window's ring as it sits in memory, then the history block
+ * as is.  Both are rings, so a checkpoint only copies the samples
+ * that came in since the last one, the header says how far each ring
+ * had got.
+ *
+ * The magic is cleared and synced before a checkpoint touches
+ * anything, and put back only once the rest has reached the disk, a
+ * file left half written by a crash is ignored rather than trusted.
+ * Windows are rebuilt by pushing the saved samples back in, so
+ * anything that aged out while we were down is gone on the first
+ * sample.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+#define STATEMAGIC "FWXSTATE"
+#define STATEVERSION 2
+
+typedef struct wxstatehdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t sampsize;          /* sizeof(wxwinsamp_t) */
+    int64_t saved;              /* when this was written */
+    char dev[64];               /* the station it came from ... */
+    int32_t ident;              /* ... and what wxident() said it was */
+    int32_t rainlast;
+    int32_t nwin;
+    int32_t histncol;
+    uint32_t histcap;
+    uint32_t histn;
+    int64_t histbase;
+    uint64_t histlen;           /* bytes of history after the windows */
+} wxstatehdr_t;
+
+typedef struct wxstatewin {
+    int64_t span;
+    uint32_t cap;               /* samples there's room for */
+    uint32_t head;              /* the ring's next and ... */
+    uint32_t tail;              /* ... oldest sample */
+    uint32_t pad;
+} wxstatewin_t;
+
+#define WINLEN(cap)     (sizeof(wxstatewin_t) + (size_t)(cap) * sizeof(wxwinsamp_t))
+
+/* from window.c */
+extern void wxwinpush(wxwin_t *w, time_t t, int v, int aux);
+extern void wxwinage(wxwin_t *w, time_t now);
+
+void
+wxstateinit(wxstate_t *stp)
+{
+    memset((void *)stp, 0, sizeof(wxstate_t));
+    stp->fd = -1;
+}
+
+/*
+ * open (or create) the state file and map whatever is in it
+ */
+int
+wxstateopen(wxstate_t *stp, const char *path)
+{
+    struct stat st;
+
+    wxstateinit(stp);
+    if ((stp->fd = open(path, O_RDWR|O_CREAT, 0644)) == -1) {
+        perror(path);
+        return -1;
+    }
+    strncpy(stp->path, path, sizeof(stp->path)-1);
+    if (fstat(stp->fd, &st) == -1) {
+        perror("wxstateopen - fstat");
+        (void)close(stp->fd);
+        stp->fd = -1;
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(wxstatehdr_t)) {
+        return 0;               /* nothing saved yet */
+    }
+    stp->map = mmap((void *)0, (size_t)st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                    stp->fd, 0);
+    if (stp->map == MAP_FAILED) {
+        perror("wxstateopen - mmap");
+        stp->map = (void *)0;
+        return 0;
+    }
+    stp->len = (size_t)st.st_size;
+    return 0;
+}
+
+static const wxstatehdr_t *
+wxstatehdr(const wxstate_t *stp)
+{
+    const wxstatehdr_t *hp;
+
+    if (!stp->map || stp->len < sizeof(wxstatehdr_t)) {
+        return (const wxstatehdr_t *)0;
+    }
+    hp = stp->map;
+    if (memcmp(hp->magic, STATEMAGIC, sizeof(hp->magic)) != 0 ||
+        hp->version != STATEVERSION || hp->sampsize != sizeof(wxwinsamp_t)) {
+        return (const wxstatehdr_t *)0;
+    }
+    return hp;
+}
+
+/*
+ * what the station on dev identified as last time, -1 if we don't know
+ */
+int
+wxstateident(const wxstate_t *stp, const char *dev)
+{
+    const wxstatehdr_t *hp;
+
+    if (!(hp = wxstatehdr(stp)) || strncmp(hp->dev, dev, sizeof(hp->dev)) != 0) {
+        return -1;
+    }
+    return hp->ident;
+}
+
+/*
+ * refill the windows and history from the last checkpoint, windows
+ * that have changed span and history that has changed shape are left
+ * empty.  Sets stp->saved and *rainlastp, -1 if there was nothing
+ * usable.
+ */
+int
+wxstateload(wxstate_t *stp, time_t now, wxwin_t **wins, int nwin, wxhist_t *histp,
+            int *rainlastp)
+{
+    const wxstatehdr_t *hp;
+    const wxstatewin_t *wp;
+    const wxwinsamp_t *s;
+    const char *p;
+    const char *end;
+    uint32_t j;
+    int i;
+
+    if (!(hp = wxstatehdr(stp))) {
+        if (stp->len) {
+            fprintf(stderr, "wxstateload - %s isn't a state file this fwx can read\n",
+                    stp->path);
+        }
+        return -1;
+    }
+    if (hp->saved > (int64_t)now) {
+        fprintf(stderr, "wxstateload - %s was saved in the future, ignoring it\n",
+                stp->path);
+        return -1;
+    }
+    p = (const char *)stp->map + sizeof(wxstatehdr_t);
+    end = (const char *)stp->map + stp->len;
+    for (i = 0; i < hp->nwin; ++i) {
+        wp = (const wxstatewin_t *)p;
+        if ((size_t)(end - p) < sizeof(wxstatewin_t) ||
+            (size_t)(end - p) < WINLEN(wp->cap) || wp->head - wp->tail > wp->cap) {
+            fprintf(stderr, "wxstateload - %s is short\n", stp->path);
+            return -1;
+        }
+        if (i < nwin && wins[i]->cap && wp->span == (int64_t)wins[i]->span) {
+            s = (const wxwinsamp_t *)(wp + 1);
+            for (j = wp->tail; j != wp->head; ++j) {
+                wxwinpush(wins[i], s[j % wp->cap].t, s[j % wp->cap].v, s[j % wp->cap].aux);
+            }
+            wxwinage(wins[i], now);
+        }
+        p += WINLEN(wp->cap);
+    }
+    if (histp && histp->cap && histp->cap == hp->histcap && histp->ncol == hp->histncol &&
+        histp->memlen == hp->histlen && (size_t)(end - p) >= hp->histlen) {
+        memcpy(histp->mem, p, histp->memlen);
+        histp->n = hp->histn;
+        histp->base = (time_t)hp->histbase;
+    }
+    *rainlastp = hp->rainlast;
+    stp->saved = (time_t)hp->saved;
+    return 0;
+}
+
+/*
+ * make the file len bytes and map all of it
+ */
+static int
+wxstatesize(wxstate_t *stp, size_t len)
+{
+    if (stp->map && stp->len == len) {
+        return 0;
+    }
+    if (stp->map) {
+        (void)munmap(stp->map, stp->len);
+        stp->map = (void *)0;
+        stp->len = 0;
+    }
+    if (ftruncate(stp->fd, (off_t)len) == -1) {
+        perror("wxstatesize - ftruncate");
+        return -1;
+    }
+    stp->map = mmap((void *)0, len, PROT_READ|PROT_WRITE, MAP_SHARED, stp->fd, 0);
+    if (stp->map == MAP_FAILED) {
+        perror("wxstatesize - mmap");
+        stp->map = (void *)0;
+        return -1;
+    }
+    stp->len = len;
+    return 0;
+}
+
+/*
+ * copy the ring slots written from sample from up to sample to, all
+ * of them if to has lapped from.  Each of the n arrays is cap elements
+ * of size bytes, one after the other, in both src and dst.
+ */
+static void
+wxstatering(char *dst, const char *src, size_t size, int n, unsigned int cap,
+            unsigned int from, unsigned int to)
+{
+    unsigned int first;
+    unsigned int count;
+    unsigned int run;
+    size_t off;
+    int a;
+
+    if (to - from >= cap) {
+        from = to - cap;
+    }
+    first = from % cap;
+    for (count = to - from; count > 0; count -= run) {
+        run = cap - first < count ? cap - first : count;
+        for (a = 0; a < n; ++a) {
+            off = ((size_t)a * cap + first) * size;
+            memcpy(dst + off, src + off, run * size);
+        }
+        first = 0;
+    }
+}
+
+/*
+ * checkpoint, with sync set wait for it to reach the disk.  Unless
+ * the file's been resized, or hasn't been written since we started,
+ * only what's new goes in.
+ */
+int
+wxstatesave(wxstate_t *stp, time_t now, const char *dev, int ident, int rainlast,
+            wxwin_t **wins, int nwin, const wxhist_t *histp, int sync)
+{
+    wxstatehdr_t *hp;
+    wxstatewin_t *wp;
+    unsigned int from;
+    size_t len;
+    char *p;
+    int i;
+
+    if (stp->fd == -1) {
+        return -1;
+    }
+    len = sizeof(wxstatehdr_t);
+    for (i = 0; i < nwin; ++i) {
+        len += WINLEN(wins[i]->cap);
+    }
+    if (histp && histp->cap) {
+        len += histp->memlen;
+    }
+    if (!stp->map || stp->len != len) {
+        stp->current = 0;
+    }
+    if (wxstatesize(stp, len) != 0) {
+        return -1;
+    }
+
+    /* from here 'til the magic's back a crash leaves a file we'll ignore */
+    hp = stp->map;
+    memset((void *)hp->magic, 0, sizeof(hp->magic));
+    if (msync(stp->map, sizeof(wxstatehdr_t), MS_SYNC) == -1) {
+        perror("wxstatesave - msync");
+        stp->current = 0;
+        return -1;
+    }
+    if (!stp->current || hp->nwin != nwin || hp->version != STATEVERSION) {
+        stp->current = 0;
+        memset((void *)hp, 0, sizeof(wxstatehdr_t));
+    }
+    hp->version = STATEVERSION;
+    hp->sampsize = sizeof(wxwinsamp_t);
+    hp->saved = (int64_t)now;
+    memset((void *)hp->dev, 0, sizeof(hp->dev));
+    strncpy(hp->dev, dev, sizeof(hp->dev)-1);
+    hp->ident = ident;
+    hp->rainlast = rainlast;
+    hp->nwin = nwin;
+    p = (char *)stp->map + sizeof(wxstatehdr_t);
+    for (i = 0; i < nwin; ++i) {
+        wp = (wxstatewin_t *)p;
+        from = wp->head;
+        if (!stp->current || wp->span != (int64_t)wins[i]->span ||
+            wp->cap != wins[i]->cap) {
+            from = wins[i]->head - wins[i]->cap;
+        }
+        wp->span = (int64_t)wins[i]->span;
+        wp->cap = wins[i]->cap;
+        if (wins[i]->cap) {
+            wxstatering((char *)(wp + 1), (const char *)wins[i]->s, sizeof(wxwinsamp_t),
+                        1, wins[i]->cap, from, wins[i]->head);
+        }
+        wp->head = wins[i]->head;
+        wp->tail = wins[i]->tail;
+        p += WINLEN(wp->cap);
+    }
+    if (histp && histp->cap) {
+        if (!stp->current || hp->histcap != histp->cap || hp->histncol != histp->ncol ||
+            hp->histlen != histp->memlen) {
+            memcpy(p, histp->mem, histp->memlen);
+        } else {
+            /* time[], valid[], then the columns, all cap long */
+            wxstatering(p, histp->mem, sizeof(uint32_t), 2, histp->cap,
+                        hp->histn, histp->n);
+            wxstatering(p + 2 * sizeof(uint32_t) * histp->cap,
+                        (const char *)histp->col, sizeof(uint16_t), histp->ncol,
+                        histp->cap, hp->histn, histp->n);
+        }
+        hp->histncol = histp->ncol;
+        hp->histcap = histp->cap;
+        hp->histn = histp->n;
+        hp->histbase = (int64_t)histp->base;
+        hp->histlen = histp->memlen;
+    }
+
+    /* everything has to be on the disk before the magic says it is */
+    if (msync(stp->map, stp->len, MS_SYNC) == -1) {
+        perror("wxstatesave - msync");
+        stp->current = 0;
+        return -1;
+    }
+    memcpy(hp->magic, STATEMAGIC, sizeof(hp->magic));
+    if (msync(stp->map, sizeof(wxstatehdr_t), sync ? MS_SYNC : MS_ASYNC) == -1) {
+        perror("wxstatesave - msync");
+        return -1;
+    }
+    stp->current = 1;
+    stp->saved = now;
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Counters and latency histograms for the serial, logging and upload
+ * paths.  Updates are a relaxed atomic add or two so they're safe
+ * from the sampling loop and the upload thread alike and cheap
+ * enough to leave on.  Histogram buckets are powers of 2 us.
+ *
+ * wxstatdump() writes everything as a text file in the Prometheus
+ * exposition format (node_exporter's textfile collector and most
+ * anything else can scrape it), via a rename so a reader never sees
+ * half a file.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+typedef struct wxhisto {
+    atomic_ulong bucket[WXSTATBUCKETS];
+    atomic_ullong sum;          /* us */
+} wxhisto_t;
+
+static atomic_ulong wxcounters[WXC_N];
+static wxhisto_t wxhistos[WXH_N];
+
+static const char *wxcnames[WXC_N] = {
+    "fwx_wakeup_total",
+    "fwx_wakeup_failures_total",
+    "fwx_ack_failures_total",
+    "fwx_short_reads_total",
+    "fwx_crc_errors_total",
+    "fwx_samples_total",
+    "fwx_samples_nodata_total",
+    "fwx_log_failures_total",
+    "fwx_wu_failures_total",
+    "fwx_aeris_failures_total",
+    "fwx_cwop_failures_total",
+    "fwx_overruns_total",
+    "fwx_stream_skipped_bytes_total",
+    "fwx_upload_dropped_total",
+    "fwx_upload_spooled_total",
+    "fwx_upload_unspooled_total",
+    "fwx_http_requests_total",
+    "fwx_publish_failures_total",
+    "fwx_publish_dropped_total",
+};
+
+static const char *wxhnames[WXH_N] = {
+    "fwx_wakeup_us",
+    "fwx_ack_us",
+    "fwx_loop_us",
+    "fwx_log_us",
+    "fwx_wu_us",
+    "fwx_aeris_us",
+    "fwx_cwop_us",
+    "fwx_jitter_us",
+};
+
+/*
+ * microseconds on the monotonic clock, for timing things
+ */
+int64_t
+wxusnow(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+wxstatinc(int c)
+{
+    atomic_fetch_add_explicit(&wxcounters[c], 1, memory_order_relaxed);
+}
+
+void
+wxstatadd(int c, unsigned long n)
+{
+    atomic_fetch_add_explicit(&wxcounters[c], n, memory_order_relaxed);
+}
+
+/*
+ * for counts kept elsewhere (the stream parser, the upload queue)
+ */
+void
+wxstatset(int c, unsigned long v)
+{
+    atomic_store_explicit(&wxcounters[c], v, memory_order_relaxed);
+}
+
+void
+wxstattime(int h, int64_t us)
+{
+    uint64_t v;
+    int b;
+
+    if (us < 0) {
+        us = 0;
+    }
+    /* bucket b holds up to 2^b us, 2^b itself included */
+    for (v = us > 0 ? (uint64_t)us - 1 : 0, b = 0; v && b < WXSTATBUCKETS - 1; v >>= 1) {
+        ++b;
+    }
+    atomic_fetch_add_explicit(&wxhistos[h].bucket[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&wxhistos[h].sum, (uint64_t)us, memory_order_relaxed);
+}
+
+int
+wxstatdump(const char *path)
+{
+    char tmp[FILENAME_MAX];
+    unsigned long cum;
+    FILE *fp;
+    int i;
+    int b;
+
+    (void)snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((fp = fopen(tmp, "w")) == (FILE *)0) {
+        perror("wxstatdump - fopen");
+        return -1;
+    }
+    for (i = 0; i < WXC_N; ++i) {
+        fprintf(fp, "# TYPE %s counter\n%s %lu\n", wxcnames[i], wxcnames[i],
+                atomic_load_explicit(&wxcounters[i], memory_order_relaxed));
+    }
+    for (i = 0; i < WXH_N; ++i) {
+        fprintf(fp, "# TYPE %s histogram\n", wxhnames[i]);
+        cum = 0;
+        for (b = 0; b < WXSTATBUCKETS; ++b) {
+            cum += atomic_load_explicit(&wxhistos[i].bucket[b], memory_order_relaxed);
+            if (b < WXSTATBUCKETS - 1) {
+                fprintf(fp, "%s_bucket{le=\"%lu\"} %lu\n", wxhnames[i], 1UL << b, cum);
+            } else {
+                fprintf(fp, "%s_bucket{le=\"+Inf\"} %lu\n", wxhnames[i], cum);
+            }
+        }
+        fprintf(fp, "%s_sum %llu\n%s_count %lu\n", wxhnames[i],
+                (unsigned long long)atomic_load_explicit(&wxhistos[i].sum,
+                                                         memory_order_relaxed),
+                wxhnames[i], cum);
+    }
+    if (fclose(fp) != 0) {
+        perror("wxstatdump - fclose");
+        (void)unlink(tmp);
+        return -1;
+    }
+    if (rename(tmp, path) != 0) {
+        perror("wxstatdump - rename");
+        (void)unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -13,6 +13,7 @@
  */
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -21,21 +22,52 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "fwx.h"
+#include "net.h"
 
 #ifndef IF_SPEED
 #define IF_SPEED 19200          /* default, override on cc command line */
 #endif /*IF_SPEED*/
 
-#define MAX_TIMEOUT 30          /* the longest time station can take to xmit */
-#define MAX_READ 256            /* the longest data station can xmit */
+#ifndef NOKERNINFO
+#define NOKERNINFO 0            /* no ^T status line to turn off (Linux) */
+#endif /*NOKERNINFO*/
+
+#define MAX_TIMEOUT 30000       /* the longest time (ms) station can take to xmit */
+#define MAX_READ 512            /* the longest data station can xmit */
 #define ACK 0x06                /* station ACKs commands with this */
+#define ACK_TIMEOUT 1000        /* ms to wait for each ACK attempt */
+#define WAKEUP_TIMEOUT 1200     /* ms, Davis says the station wakes within 1.2s */
+#define WRITE_TIMEOUT 1000      /* ms to wait for room in the output queue */
+#define CONNECT_TIMEOUT 5000    /* ms allowed to reach a network console */
+#define KEEPIDLE 30             /* secs quiet before TCP keepalive probes ... */
+#define KEEPINTVL 10            /* ... this far apart ... */
+#define KEEPCNT 3               /* ... and this many unanswered is dead */
 
 /* used for debugging */
 #define LINELEN 80              /* length of a line */
 #define CHARLEN 5               /* width to display one char */
 
-static void __inline
+/* from net.c */
+extern void wxdnsinit(wxdns_t *dp, const char *host, const char *port, int ttl);
+extern int wxconnectstart(wxdns_t *dp, int *pendingp);
+extern int wxconnectdone(wxdns_t *dp, int s, int64_t expire);
+/* from stats.c */
+extern int64_t wxusnow(void);
+extern void wxstatinc(int c);
+extern void wxstattime(int h, int64_t us);
+/* forward declarations from this file */
+int wxopen(char *devname);
+
+static inline void
 dumpbyte(unsigned char c, char *buf)
 {
 #if 0
@@ -67,6 +99,95 @@ dumpbuf(FILE *stream, unsigned char *p, size_t len)
     return;
 }
 
+/*
+ * a console on the network (WeatherLinkIP, or a serial port server)
+ * is named host:port, everything else is a tty
+ */
+int
+wxisnet(const char *devname)
+{
+    return *devname != '/' && strchr(devname, ':') != (char *)0;
+}
+
+/*
+ * TCP to a network console, the socket is non-blocking like the tty
+ * so everything above here can't tell the difference.  The connect
+ * isn't waited on, wxopendone() tells when it's through so a console
+ * that's unreachable doesn't hold up the others.  The address is
+ * looked up once and cached in *dp.  Keepalives notice a console
+ * that's gone away while we're waiting on a LOOP stream, the caller
+ * re-opens it.
+ */
+static int
+wxopennet(wxdns_t *dp, const char *devname, int *pendingp)
+{
+    char host[128];
+    char *port;
+    int on;
+    int s;
+
+    if (!*dp->host) {
+        strncpy(host, devname, sizeof(host)-1);
+        host[sizeof(host)-1] = '\0';
+        port = strrchr(host, ':');
+        *port++ = '\0';
+        if (!*host || !*port) {
+            fprintf(stderr, "wxopen - %s isn't host:port\n", devname);
+            return -1;
+        }
+        wxdnsinit(dp, host, port, 0);
+    }
+    if ((s = wxconnectstart(dp, pendingp)) == -1) {
+        return -1;
+    }
+    on = 1;
+    if (setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) == -1) {
+        perror("wxopen - setsockopt(SO_KEEPALIVE)");
+    }
+#ifdef TCP_KEEPIDLE
+    on = KEEPIDLE;
+    (void)setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE, &on, sizeof(on));
+#endif /*TCP_KEEPIDLE*/
+#ifdef TCP_KEEPINTVL
+    on = KEEPINTVL;
+    (void)setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, &on, sizeof(on));
+#endif /*TCP_KEEPINTVL*/
+#ifdef TCP_KEEPCNT
+    on = KEEPCNT;
+    (void)setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, &on, sizeof(on));
+#endif /*TCP_KEEPCNT*/
+
+#ifdef DEBUG_WXOPEN
+    fprintf(stderr, "wxopen - connecting to %s\n", devname);
+#endif /*DEBUG_WXOPEN*/
+    return s;
+}
+
+/*
+ * a network console's connect from wxopenstart(), started at since
+ * (wxmsnow() ms): 0 when it's through, 1 while it's on its way, -1 if
+ * it failed or took too long, the descriptor is closed then
+ */
+int
+wxopendone(wxdns_t *dp, int fd, int64_t since)
+{
+    return wxconnectdone(dp, fd, since + CONNECT_TIMEOUT);
+}
+
+/*
+ * open a console, *pendingp is set for a network one that's still
+ * connecting (see wxopendone()), dp caches the address between tries
+ */
+int
+wxopenstart(wxdns_t *dp, char *devname, int *pendingp)
+{
+    *pendingp = 0;
+    if (wxisnet(devname)) {
+        return wxopennet(dp, devname, pendingp);
+    }
+    return wxopen(devname);
+}
+
 int
 wxopen(char *devname)
 {
@@ -99,21 +220,16 @@ wxopen(char *devname)
         return -1;
     }
 
-    /*
-     * clear NONBLOCK flag as it should no longer be needed
-     */
-    if (fcntl(wxfd, F_SETFL, 0) == -1) {
-        perror("wxopen - fcntl(F_SETFL)");
-        (void)close(wxfd);
-        return -1;
-    }
-
     if (tcgetattr(wxfd, &termios) != 0) {
         perror("wxopen - tcgetattr");
         (void)close(wxfd);
         return -1;
     }
 
+    /*
+     * this is the only time termios is touched, the descriptor stays
+     * non-blocking and all waiting is done in poll()
+     */
     cfmakeraw(&termios);                /* redundant */
     termios.c_iflag = IGNBRK;
     termios.c_oflag = 0;
@@ -135,33 +251,59 @@ wxopen(char *devname)
     return wxfd;
 }
 
-int
-wxsettimeout(int fd, int timeout)
+/*
+ * milliseconds on a clock that never steps, only good for deadlines
+ */
+int64_t
+wxmsnow(void)
 {
-    struct termios termios;
+    struct timespec ts;
 
-    if (tcgetattr(fd, &termios) == -1) {
-        perror("wxsettimeout - tcgetattr");
-        return -1;
-    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-    termios.c_cc[VMIN] = 0;
-    termios.c_cc[VTIME] = timeout*10;
+/*
+ * wait for fd to become ready for events until the deadline, returns
+ * 1 if ready, 0 on timeout, -1 on error
+ */
+static int
+wxpoll(int fd, short events, int64_t expire)
+{
+    struct pollfd pfd;
+    int64_t left;
+    int rc;
 
-    if (tcsetattr(fd, TCSANOW|TCSASOFT, &termios) == -1) {
-        perror("wxsettimeout - tcsetattr");
+    pfd.fd = fd;
+    pfd.events = events;
+    do {
+        if ((left = expire - wxmsnow()) < 0) {
+            left = 0;
+        }
+        rc = poll(&pfd, 1, (int)left);
+    } while (rc == -1 && errno == EINTR);
+    if (rc == -1) {
+        perror("wxpoll - poll");
         return -1;
     }
-    return 0;
+    if (rc > 0 && (pfd.revents & (POLLERR|POLLNVAL))) {
+        fprintf(stderr, "wxpoll - error on fd %d\n", fd);
+        return -1;
+    }
+    return rc > 0;
 }
 
+/*
+ * read len bytes, or as many as show up within timeout ms
+ */
 int
 wxread(int fd, void *buf, size_t len, int timeout)
 {
-    time_t expire;
+    int64_t expire;
     ssize_t remaining;
     ssize_t rc;
     char *bufp;
+    int ready;                  /* poll() said there was something to read */
 
     if (timeout <= 0 || timeout > MAX_TIMEOUT) {
         fprintf(stderr, "wxread - timeout %d out of range\n", timeout);
@@ -173,29 +315,41 @@ wxread(int fd, void *buf, size_t len, int timeout)
         return -1;
     }
 
-    expire = time((time_t *)NULL) + timeout;
+    expire = wxmsnow() + timeout;
 
     remaining = len;
     bufp = (char *)buf;
-
-    while (remaining > 0 && timeout > 0) {
-        if (wxsettimeout(fd, timeout) == -1) {
-            fprintf(stderr, "wxread - failed to set timeout\n");
+    ready = 0;
+
+    while (remaining > 0) {
+        if ((rc = read(fd, bufp, remaining)) > 0) {
+            remaining -= rc;
+            bufp += rc;
+            ready = 0;
+            continue;
+        }
+        if (rc == 0 && ready) {
+            fprintf(stderr, "wxread - connection closed\n");
+            return -1;
+        }
+        if (rc == -1 && errno != EAGAIN && errno != EINTR) {
+            perror("wxread - read");
             return -1;
         }
-        if ((rc = read(fd, bufp, remaining)) != remaining) {
-            if (rc == -1) {
-                perror("wxread - read");
-                return -1;
+        if ((rc = wxpoll(fd, POLLIN, expire)) == -1) {
+            return -1;
+        }
+        ready = rc;
+        if (rc == 0) {
+            if (remaining < (ssize_t)len) {
+                wxstatinc(WXC_SHORTREAD);
             }
 #ifdef DEBUG_WXREAD
-            fprintf(stderr, "wxread - read got %zd expected %zd\n",
-                    rc, remaining);
+            fprintf(stderr, "wxread - timed out with %zd of %zu\n",
+                    len - remaining, len);
 #endif /*DEBUG_WXREAD*/
+            break;
         }
-        remaining -= rc;
-        bufp += rc;
-        timeout = expire - time((time_t *)NULL);
     }
 #ifdef DEBUG_WXREAD
     dumpbuf(stderr, buf, len - remaining);
@@ -204,25 +358,149 @@ wxread(int fd, void *buf, size_t len, int timeout)
     return (len - remaining);
 }
 
+/*
+ * wait up to timeout ms for something to show up, then return all
+ * that's there (up to len) without waiting for more.  A timeout of
+ * 0 just takes what's already queued.
+ */
 int
-wxflush(int fd)
+wxreadsome(int fd, void *buf, size_t len, int timeout)
 {
-    struct termios termios;
+    ssize_t rc;
+    int64_t expire;
+    int ready;
 
-    if (tcgetattr(fd, &termios) == -1) {
-        perror("wxflush - tcgetattr");
+    if (timeout < 0 || timeout > MAX_TIMEOUT) {
+        fprintf(stderr, "wxreadsome - timeout %d out of range\n", timeout);
         return -1;
     }
+    expire = wxmsnow() + timeout;
+    ready = 0;
+    while (1) {
+        if ((rc = read(fd, buf, len)) > 0) {
+            return (int)rc;
+        }
+        if (rc == 0 && ready) {
+            fprintf(stderr, "wxreadsome - connection closed\n");
+            return -1;
+        }
+        if (rc == -1 && errno != EAGAIN && errno != EINTR) {
+            perror("wxreadsome - read");
+            return -1;
+        }
+        if ((rc = wxpoll(fd, POLLIN, expire)) <= 0) {
+            return (int)rc;
+        }
+        ready = 1;
+    }
+}
 
-    if (tcsetattr(fd, TCSAFLUSH|TCSASOFT, &termios) == -1) {
-        perror("wxflush - tcsetattr");
-        return -1;
+/*
+ * after an exchange with the console failed, 1 if the link itself is
+ * gone (hung up, reset, the USB adapter pulled) and 0 if the console
+ * just didn't answer properly.  Only the first is worth reconnecting
+ * over, a bad crc or a slow answer isn't.  A byte waiting on a tty is
+ * read to tell, after a failure it's garbage anyway.
+ */
+int
+wxlinkdown(int fd)
+{
+    struct pollfd pfd;
+    ssize_t rc;
+    char c;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) == -1) {
+        return errno != EINTR;
+    }
+    if (pfd.revents & (POLLERR|POLLHUP|POLLNVAL)) {
+        return 1;
+    }
+    if (!(pfd.revents & POLLIN)) {
+        return 0;               /* quiet, but still there */
+    }
+    if ((rc = recv(fd, &c, 1, MSG_PEEK)) == -1 && errno == ENOTSOCK) {
+        rc = read(fd, &c, 1);
+    }
+    if (rc == 0) {
+        return 1;
+    }
+    return rc == -1 && errno != EAGAIN && errno != EINTR;
+}
+
+/*
+ * the descriptor is non-blocking so a full output queue has to be
+ * waited out rather than slept through in write()
+ */
+static int
+wxwrite(int fd, const void *buf, size_t len, int timeout)
+{
+    int64_t expire;
+    const char *bufp;
+    ssize_t rc;
+
+    expire = wxmsnow() + timeout;
+    bufp = (const char *)buf;
+    while (len > 0) {
+        if ((rc = write(fd, bufp, len)) > 0) {
+            len -= rc;
+            bufp += rc;
+            continue;
+        }
+        if (rc == -1 && errno != EAGAIN && errno != EINTR) {
+            perror("wxwrite - write");
+            return -1;
+        }
+        if ((rc = wxpoll(fd, POLLOUT, expire)) <= 0) {
+            if (rc == 0) {
+                fprintf(stderr, "wxwrite - timed out with %zu left\n", len);
+            }
+            return -1;
+        }
     }
     return 0;
 }
 
+/*
+ * raw bytes to the station, for replies that aren't commands
+ */
 int
-wxwakeup(int fd)
+wxsend(int fd, const void *buf, size_t len)
+{
+    return wxwrite(fd, buf, len, WRITE_TIMEOUT);
+}
+
+/*
+ * throw away anything the console sent that we haven't read, there's
+ * no tcflush() for a socket so that's read and dropped
+ */
+int
+wxflush(int fd)
+{
+    char buf[MAX_READ];
+    ssize_t rc;
+
+    if (!isatty(fd)) {
+        while ((rc = read(fd, buf, sizeof(buf))) > 0) {
+            ;
+        }
+        if (rc == 0 || (errno != EAGAIN && errno != EINTR)) {
+            fprintf(stderr, "wxflush - connection %s\n", rc == 0 ? "closed" : "failed");
+            return -1;
+        }
+        return 0;
+    }
+    if (tcflush(fd, TCIFLUSH) == -1) {
+        perror("wxflush - tcflush");
+        return -1;
+    }
+    return 0;
+}
+
+static int
+wxwakeup1(int fd)
 {
     ssize_t rc;
     char resp[2];
@@ -231,19 +509,22 @@ wxwakeup(int fd)
         fprintf(stderr, "wxwakeup - flush failed\n");
         return -1;
     }
-    if ((rc = write(fd, &"\n", 1)) != 1) {
-        if (rc == -1) {
-            perror("wxwakeup - write");
-            return -1;
-        }
+    if (wxwrite(fd, "\n", 1, WRITE_TIMEOUT) != 0) {
         fprintf(stderr, "wxwakeup - newline send failed\n");
         return -1;
     }
 
-    if (wxread(fd, (void *)&resp, sizeof(resp), 5) == -1) {
+    if ((rc = wxread(fd, (void *)&resp, sizeof(resp), WAKEUP_TIMEOUT)) == -1) {
         fprintf(stderr, "wxwakeup - wxread failed\n");
         return -1;
     }
+    if (rc != sizeof(resp)) {
+#ifdef DEBUG_WXWAKEUP
+        fprintf(stderr, "wxwakeup - got %zd bytes, expected %zu\n",
+                rc, sizeof(resp));
+#endif /*DEBUG_WXWAKEUP*/
+        return -1;
+    }
     /* Davis doesn't make it clear which to expect */
     if ((resp[0] != '\r' && resp[1] != '\n') &&
         (resp[0] != '\n' && resp[1] != '\r')) {
@@ -258,39 +539,55 @@ wxwakeup(int fd)
     return 0;
 }
 
+int
+wxwakeup(int fd)
+{
+    int64_t start;
+
+    wxstatinc(WXC_WAKEUP);
+    start = wxusnow();
+    if (wxwakeup1(fd) != 0) {
+        wxstatinc(WXC_WAKEUPFAIL);
+        return -1;
+    }
+    wxstattime(WXH_WAKEUP, wxusnow() - start);
+    return 0;
+}
+
 int
 wxgetack(int fd)
 {
+    int64_t start;
+    int rc;
     int i;
     unsigned char ackbuf;
 
+    start = wxusnow();
     i = 0;
     do {
-        if (wxread(fd, (void *)&ackbuf, sizeof(ackbuf), 1) == -1) {
+        if ((rc = wxread(fd, (void *)&ackbuf, sizeof(ackbuf), ACK_TIMEOUT)) == -1) {
             fprintf(stderr, "wxgetack - wxread failed\n");
+            wxstatinc(WXC_ACKFAIL);
             return -1;
         }
+        if (rc == 0) {
+            ackbuf = 0;         /* nothing showed up, try again */
+        }
         if (i++ >= 5) {
             fprintf(stderr, "wxgetack - failing after %d attempts\n", i);
+            wxstatinc(WXC_ACKFAIL);
             return -1;
         }
     } while (ackbuf != ACK);
+    wxstattime(WXH_ACK, wxusnow() - start);
     return 0;
 }
 
 int
 wxcmd(int fd, char *cmd)
 {
-    size_t len;
-    ssize_t rc;
-
-    len = strlen(cmd);
-    if ((rc = write(fd, cmd, len)) == -1) {
-        perror("wxcmd - write");
-        return -1;
-    }
-    if (rc != (ssize_t)len) {
-        fprintf(stderr, "wxcmd - write expected %zu, got %zd\n", len, rc);
+    if (wxwrite(fd, cmd, strlen(cmd), WRITE_TIMEOUT) != 0) {
+        fprintf(stderr, "wxcmd - failed sending cmd\n");
         return -1;
     }
 
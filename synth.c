@@ -0,0 +1,158 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * synthetic LOOP & LOOP2 packets and archive records for fwxsim and fwxbench,
+ * plausible enough that every field decodes and the numbers wander
+ * around a bit
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "davis.h"
+
+/* from crc.c */
+extern unsigned short wxcrcupdate(unsigned short crc, unsigned char c);
+
+/*
+ * the crc goes on the end high byte first
+ */
+void
+wxloopseal(vploopdata_t *ld)
+{
+    unsigned char *p;
+    unsigned short crc;
+    size_t i;
+
+    p = (unsigned char *)ld;
+    crc = 0;
+    for (i = 0; i < VPLOOPSIZE - 2; ++i) {
+        crc = wxcrcupdate(crc, p[i]);
+    }
+    p[VPLOOPSIZE - 2] = crc >> 8;
+    p[VPLOOPSIZE - 1] = crc & 0xff;
+}
+
+/*
+ * packet number n of a made up day, rain only ever goes up
+ */
+void
+wxsynthloop(vploopdata_t *ld, unsigned int n)
+{
+    memset((void *)ld, 0, VPLOOPSIZE);
+    memcpy(ld->sig, "LOO", 3);
+    ld->type = 0;
+    ld->bar = get_d_16(29900 + (n / 8) % 200);
+    ld->tempIn = get_d_16(700 + n % 17);
+    ld->humIn = get_d_8(40 + n % 9);
+    ld->tempOut = get_d_16(400 + (n / 3) % 400);
+    ld->windSpeed = get_d_8((n * 7) % 23);
+    ld->windSpeed10 = get_d_8(6 + n % 5);
+    ld->windDir = get_d_16(1 + (n * 13) % 360);
+    ld->humOut = get_d_8(30 + (n / 5) % 70);
+    ld->rainRate = get_d_16(n % 97 < 10 ? n % 97 : 0);
+    ld->solarRad = get_d_16((n * 3) % 1200);
+    ld->rainDay = get_d_16((n / 97) % 500);
+    ld->rainMonth = get_d_16(500 + (n / 97) % 3000);
+    ld->rainYear = get_d_16(3500 + n / 97);
+    ld->nl = '\n';
+    ld->ret = '\r';
+    wxloopseal(ld);
+}
+
+/*
+ * the LOOP2 packet to go with LOOP packet n
+ */
+void
+wxsynthloop2(vploop2data_t *l2, unsigned int n)
+{
+    memset((void *)l2, 0, VPLOOPSIZE);
+    memcpy(l2->sig, "LOO", 3);
+    l2->type = VPLOOP2TYPE;
+    l2->unused0 = get_d_16(0x7fff);
+    l2->bar = get_d_16(29900 + (n / 8) % 200);
+    l2->tempIn = get_d_16(700 + n % 17);
+    l2->humIn = get_d_8(40 + n % 9);
+    l2->tempOut = get_d_16(400 + (n / 3) % 400);
+    l2->windSpeed = get_d_8((n * 7) % 23);
+    l2->windDir = get_d_16(1 + (n * 13) % 360);
+    l2->windAvg10 = get_d_16(60 + n % 50);
+    l2->windAvg2 = get_d_16(50 + n % 70);
+    l2->windGust10 = get_d_16(22);
+    l2->windGustDir10 = get_d_16(1 + (n * 13) % 360);
+    l2->dewPoint = get_d_16(30 + (n / 3) % 20);
+    l2->humOut = get_d_8(30 + (n / 5) % 70);
+    l2->heatIndex = get_d_16(40 + (n / 3) % 40);
+    l2->windChill = get_d_16(38 + (n / 3) % 40);
+    l2->thswIndex = get_d_16(42 + (n / 3) % 40);
+    l2->rainRate = get_d_16(n % 97 < 10 ? n % 97 : 0);
+    l2->solarRad = get_d_16((n * 3) % 1200);
+    l2->rainDay = get_d_16((n / 97) % 500);
+    l2->rain15 = get_d_16((n / 97) % 3);
+    l2->rainHour = get_d_16((n / 97) % 7);
+    l2->rain24 = get_d_16((n / 97) % 40);
+    l2->nl = '\n';
+    l2->ret = '\r';
+    wxloopseal((vploopdata_t *)l2);
+}
+
+/*
+ * pages carry their crc the same way
+ */
+void
+wxpageseal(vparchpage_t *pp)
+{
+    unsigned char *p;
+    unsigned short crc;
+    size_t i;
+
+    p = (unsigned char *)pp;
+    crc = 0;
+    for (i = 0; i < VPARCHPAGESIZE - 2; ++i) {
+        crc = wxcrcupdate(crc, p[i]);
+    }
+    p[VPARCHPAGESIZE - 2] = crc >> 8;
+    p[VPARCHPAGESIZE - 1] = crc & 0xff;
+}
+
+/*
+ * archive record n, stamped with local time t
+ */
+void
+wxsyntharch(vparchive_t *ap, time_t t, unsigned int n)
+{
+    struct tm tm;
+
+    (void)localtime_r(&t, &tm);
+    memset((void *)ap, 0xff, VPARCHSIZE);
+    ap->date = get_d_16(VPARCHDATE(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday));
+    ap->time = get_d_16(VPARCHTIME(tm.tm_hour, tm.tm_min));
+    ap->tempOut = get_d_16(400 + n % 400);
+    ap->tempOutHi = get_d_16(405 + n % 400);
+    ap->tempOutLo = get_d_16(395 + n % 400);
+    ap->rain = get_d_16(n % 29 < 3 ? 1 : 0);
+    ap->rainRateHi = get_d_16(n % 29 < 3 ? 12 : 0);
+    ap->bar = get_d_16(29900 + n % 200);
+    ap->solarRad = get_d_16((n * 11) % 1000);
+    ap->windSamples = get_d_16(120);
+    ap->tempIn = get_d_16(700 + n % 17);
+    ap->humIn = get_d_8(40 + n % 9);
+    ap->humOut = get_d_8(30 + n % 70);
+    ap->windSpeed = get_d_8(n % 19);
+    ap->windSpeedHi = get_d_8(n % 19 + 7);
+    ap->windDirHi = get_d_8(n % 16);
+    ap->windDir = get_d_8((n / 3) % 16);
+    ap->recType = VPARCHREVB;
+}
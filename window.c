@@ -0,0 +1,199 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Rolling time windows over a stream of samples.  Each window keeps
+ * its samples in a ring plus two monotonic deques of ring positions,
+ * one with values decreasing from the front (for the max) and one
+ * increasing (for the min), and running sums.  A push evicts anything
+ * older than the window's span, every sample goes on and comes off
+ * each structure once so all of it is amortized O(1) per sample.
+ *
+ * Windows are defined by time, not sample count, so they stay right
+ * if samples arrive at an uneven rate.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+#define SAMP(w, i)      ((w)->s[(i) & ((w)->cap - 1)])
+#define MAXQ(w, i)      ((w)->maxq[(i) & ((w)->cap - 1)])
+#define MINQ(w, i)      ((w)->minq[(i) & ((w)->cap - 1)])
+
+/*
+ * room for at least maxsamples samples covering span seconds
+ */
+int
+wxwininit(wxwin_t *w, time_t span, int maxsamples)
+{
+    memset((void *)w, 0, sizeof(wxwin_t));
+    w->span = span;
+    w->cap = 2;
+    while (w->cap < (unsigned int)maxsamples) {
+        w->cap <<= 1;
+    }
+    if (!(w->s = calloc(w->cap, sizeof(wxwinsamp_t))) ||
+        !(w->maxq = calloc(w->cap, sizeof(unsigned int))) ||
+        !(w->minq = calloc(w->cap, sizeof(unsigned int)))) {
+        perror("wxwininit - calloc");
+        free(w->s);
+        free(w->maxq);
+        w->cap = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+wxwinevict(wxwin_t *w)
+{
+    wxwinsamp_t *sp;
+
+    sp = &SAMP(w, w->tail);
+    w->sum -= sp->v;
+    w->sumsq -= (long long)sp->v * sp->v;
+    if (w->maxh != w->maxt && MAXQ(w, w->maxt) == w->tail) {
+        ++w->maxt;
+    }
+    if (w->minh != w->mint && MINQ(w, w->mint) == w->tail) {
+        ++w->mint;
+    }
+    ++w->tail;
+}
+
+void
+wxwinpush(wxwin_t *w, time_t t, int v, int aux)
+{
+    wxwinsamp_t *sp;
+
+    if (w->cap == 0) {
+        return;
+    }
+    while (w->head != w->tail &&
+           (SAMP(w, w->tail).t <= t - w->span || w->head - w->tail >= w->cap)) {
+        wxwinevict(w);
+    }
+    sp = &SAMP(w, w->head);
+    sp->t = t;
+    sp->v = v;
+    sp->aux = aux;
+    w->sum += v;
+    w->sumsq += (long long)v * v;
+    /* ties go to the newer sample */
+    while (w->maxh != w->maxt && SAMP(w, MAXQ(w, w->maxh - 1)).v <= v) {
+        --w->maxh;
+    }
+    MAXQ(w, w->maxh++) = w->head;
+    while (w->minh != w->mint && SAMP(w, MINQ(w, w->minh - 1)).v >= v) {
+        --w->minh;
+    }
+    MINQ(w, w->minh++) = w->head;
+    ++w->head;
+}
+
+/*
+ * drop samples that have aged out without pushing a new one
+ */
+void
+wxwinage(wxwin_t *w, time_t now)
+{
+    while (w->head != w->tail && SAMP(w, w->tail).t <= now - w->span) {
+        wxwinevict(w);
+    }
+}
+
+int
+wxwincount(const wxwin_t *w)
+{
+    return (int)(w->head - w->tail);
+}
+
+/*
+ * the largest value in the window (and its aux), 0 if it's empty
+ */
+int
+wxwinmax(const wxwin_t *w, int *auxp)
+{
+    const wxwinsamp_t *sp;
+
+    if (w->maxh == w->maxt) {
+        if (auxp) {
+            *auxp = 0;
+        }
+        return 0;
+    }
+    sp = &SAMP(w, MAXQ(w, w->maxt));
+    if (auxp) {
+        *auxp = sp->aux;
+    }
+    return sp->v;
+}
+
+int
+wxwinmin(const wxwin_t *w, int *auxp)
+{
+    const wxwinsamp_t *sp;
+
+    if (w->minh == w->mint) {
+        if (auxp) {
+            *auxp = 0;
+        }
+        return 0;
+    }
+    sp = &SAMP(w, MINQ(w, w->mint));
+    if (auxp) {
+        *auxp = sp->aux;
+    }
+    return sp->v;
+}
+
+long
+wxwinsum(const wxwin_t *w)
+{
+    return w->sum;
+}
+
+/*
+ * variance of v over the window (in v squared), 0 if it's empty
+ */
+long
+wxwinvar(const wxwin_t *w)
+{
+    long long n;
+
+    if ((n = (long long)(w->head - w->tail)) == 0) {
+        return 0;
+    }
+    return (long)((n * w->sumsq - (long long)w->sum * w->sum) / (n * n));
+}
+
+/*
+ * the oldest sample still in the window, NULL if it's empty
+ */
+const wxwinsamp_t *
+wxwinoldest(const wxwin_t *w)
+{
+    return w->head == w->tail ? (const wxwinsamp_t *)0 : &SAMP(w, w->tail);
+}
+
+const wxwinsamp_t *
+wxwinnewest(const wxwin_t *w)
+{
+    return w->head == w->tail ? (const wxwinsamp_t *)0 : &SAMP(w, w->head - 1);
+}
@@ -0,0 +1,174 @@
+/*
+ * FreeWX - logger for Davis weather stations
+ *
+ * Copyright 2003-2019 Michael Galassi, all rights reserved.
+ *
+ * This code may be re-distributed under the terms and conditions of
+ * the BSD 2 clause license.
+ *
+ * All questions & comments should be directed to me at michael at
+ * galassi dot us.
+ */
+
+/*
+ * Append-only record writer with group commit.  The file stays open
+ * between records.  With no commit policy each record is written as
+ * it comes in (what fopen/fprintf/fclose used to give us, minus the
+ * open & close).  With one, records are collected and written and
+ * fsync()ed together every syncrecs records or syncsecs seconds,
+ * whichever comes first.
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "fwx.h"
+
+int wxwclose(wxwriter_t *wp);
+
+void
+wxwinit(wxwriter_t *wp, int syncrecs, int syncsecs)
+{
+    memset((void *)wp, 0, sizeof(wxwriter_t));
+    wp->fd = -1;
+    wp->syncrecs = syncrecs;
+    wp->syncsecs = syncsecs;
+}
+
+int
+wxwopen(wxwriter_t *wp, const char *path)
+{
+    if (wp->fd != -1) {
+        (void)wxwclose(wp);
+    }
+    if ((wp->fd = open(path, O_WRONLY|O_APPEND|O_CREAT, 0644)) == -1) {
+        perror("wxwopen - open");
+        return -1;
+    }
+    strncpy(wp->path, path, sizeof(wp->path)-1);
+    if ((wp->size = lseek(wp->fd, 0, SEEK_END)) == -1) {
+        perror("wxwopen - lseek");
+        wp->size = 0;
+    }
+    wp->len = 0;
+    wp->pending = 0;
+    wp->lastcommit = time((time_t *)0);
+    return 0;
+}
+
+/*
+ * the buffer only ever holds whole records, if it doesn't all make it
+ * out cut the file back to where it was so there's no torn record for
+ * the next write to land after
+ */
+static int
+wxwflush(wxwriter_t *wp)
+{
+    const char *p;
+    size_t left;
+    ssize_t rc;
+
+    p = wp->buf;
+    left = wp->len;
+    while (left > 0) {
+        if ((rc = write(wp->fd, p, left)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("wxwflush - write");
+            if (left < wp->len && ftruncate(wp->fd, wp->size) == -1) {
+                perror("wxwflush - ftruncate");
+            }
+            /* toss it rather than write a torn record later */
+            wp->len = 0;
+            return -1;
+        }
+        p += rc;
+        left -= rc;
+    }
+    wp->size += (off_t)wp->len;
+    wp->len = 0;
+    return 0;
+}
+
+/*
+ * push everything collected so far to the disk
+ */
+int
+wxwcommit(wxwriter_t *wp)
+{
+    int rc;
+
+    if (wp->fd == -1) {
+        return 0;
+    }
+    rc = wxwflush(wp);
+    if (wp->pending > 0 && (wp->syncrecs || wp->syncsecs) &&
+        fsync(wp->fd) == -1) {
+        perror("wxwcommit - fsync");
+        rc = -1;
+    }
+    wp->pending = 0;
+    wp->lastcommit = time((time_t *)0);
+    return rc;
+}
+
+/*
+ * commit if the policy says it's time
+ */
+int
+wxwtick(wxwriter_t *wp, time_t now)
+{
+    if (wp->pending == 0) {
+        return 0;
+    }
+    if ((!wp->syncrecs && !wp->syncsecs) ||
+        (wp->syncrecs && wp->pending >= wp->syncrecs) ||
+        (wp->syncsecs && now - wp->lastcommit >= wp->syncsecs)) {
+        return wxwcommit(wp);
+    }
+    return 0;
+}
+
+int
+wxwrite(wxwriter_t *wp, const void *rec, size_t len, time_t now)
+{
+    if (wp->fd == -1) {
+        return -1;
+    }
+    if (wp->len + len > sizeof(wp->buf) && wxwflush(wp) != 0) {
+        return -1;
+    }
+    if (len > sizeof(wp->buf)) {
+        fprintf(stderr, "wxwrite - %zu byte record too big\n", len);
+        return -1;
+    }
+    memcpy(&wp->buf[wp->len], rec, len);
+    wp->len += len;
+    ++wp->pending;
+    return wxwtick(wp, now);
+}
+
+int
+wxwclose(wxwriter_t *wp)
+{
+    int rc;
+
+    if (wp->fd == -1) {
+        return 0;
+    }
+    rc = wxwcommit(wp);
+    if (close(wp->fd) == -1) {
+        perror("wxwclose - close");
+        rc = -1;
+    }
+    wp->fd = -1;
+    return rc;
+}